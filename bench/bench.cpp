@@ -0,0 +1,525 @@
+// Microbenchmarks for the simulator's hot paths. Each case is timed over
+// several repetitions of an auto-calibrated batch and reported as one JSON
+// object per line, so runs can be diffed or plotted:
+//   {"name":..., "ns_per_op":median, "min_ns":..., "max_ns":..., "mips":..., "reps":..., "ops_per_rep":...}
+// mips is millions of ops (moves, conditions, lines) per second at the median.
+//
+// Usage: yatta-bench [-r reps] [-t ms per rep] [filter]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../src/assembler.hpp"
+#include "../src/computer.hpp"
+#include "../src/cpu.hpp"
+#include "../src/lexer.hpp"
+#include "../src/lockstep.hpp"
+#include "../src/parser.hpp"
+#include "../src/scheduler.hpp"
+
+using namespace std;
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+// Results feed this so the compiler cannot drop the work being timed
+volatile int sink = 0;
+// Cases whose engines disagreed with the interpreter; main's exit status
+int failures = 0;
+
+struct Settings {
+    int reps = 7;
+    double rep_ms = 50;
+    string filter;
+};
+
+// `body(n)` performs about n ops, is timed as a whole and returns how many
+// it actually did
+void run_case(const Settings& settings, const string& name, const function<uint64_t(uint64_t)>& body) {
+    if (!settings.filter.empty() && name.find(settings.filter) == string::npos) return;
+
+    // grow the batch until one takes about rep_ms
+    uint64_t n = 1000;
+    for (;;) {
+        const auto start = Clock::now();
+        body(n);
+        const double ms = chrono::duration<double, milli>(Clock::now() - start).count();
+        if (ms >= settings.rep_ms || n >= (uint64_t(1) << 40)) break;
+        n = ms < 1 ? n * 10 : static_cast<uint64_t>(static_cast<double>(n) * settings.rep_ms / ms * 1.1);
+    }
+
+    vector<double> ns(static_cast<size_t>(settings.reps));
+    uint64_t ops = n;
+    for (double& sample : ns) {
+        const auto start = Clock::now();
+        ops = body(n);
+        sample = chrono::duration<double, nano>(Clock::now() - start).count() / static_cast<double>(ops);
+    }
+    sort(ns.begin(), ns.end());
+    const double median = ns[ns.size() / 2];
+    printf("{\"name\":\"%s\",\"ns_per_op\":%.3f,\"min_ns\":%.3f,\"max_ns\":%.3f,\"mips\":%.2f,\"reps\":%d,\"ops_per_rep\":%llu}\n",
+        name.c_str(), median, ns.front(), ns.back(), 1e3 / median, settings.reps, static_cast<unsigned long long>(ops));
+    fflush(stdout);
+}
+
+Instruction assemble(const string& line) {
+    return convert_line(parse_raw_instruction(line));
+}
+
+// Cpu::exec_line on one move at a time, per source and destination kind
+void bench_exec_line(const Settings& s) {
+    const pair<const char*, const char*> moves[] = {
+        { "exec_line/const->reg", "5 R1" },
+        { "exec_line/reg->reg", "R2 R1" },
+        { "exec_line/alu_result->reg", "A0 R1" },
+        { "exec_line/alu_port->reg", "A1 R1" },
+        { "exec_line/flag->reg", "ZF R1" },
+        { "exec_line/pc->reg", "PC R1" },
+        { "exec_line/reg->alu_port", "R2 A1" },
+        { "exec_line/const->trigger", "1 AF" },
+        { "exec_line/const->discard", "5 0" },
+        { "exec_line/const->halt", "0 HF" },
+        { "exec_line/const->pc", "3 PC" },
+    };
+    for (const auto& [name, text] : moves) {
+        const Instruction move = assemble(text);
+        Cpu cpu(8, 1);
+        cpu.regs[2] = 7;
+        cpu.alu[1] = 3;
+        cpu.alu[2] = 4;
+        run_case(s, name, [&](uint64_t n) -> uint64_t {
+            for (uint64_t i = 0; i < n; ++i) cpu.exec_line(move);
+            sink = static_cast<int>(cpu.regs[1]) + cpu.pc;
+            return n;
+        });
+    }
+}
+
+// Cpu::check_condition per comparator, register against constant, with the
+// outcome alternating so no branch predictor learns it
+void bench_conditions(const Settings& s) {
+    const char* const ops[] = { "==", "!=", "<", "<=", ">", ">=" };
+    const char* const names[] = { "eq", "ne", "lt", "le", "gt", "ge" };
+    for (int k = 0; k < 6; ++k) {
+        const Instruction move = assemble(string("1 R0 ? R1 ") + ops[k] + " 0");
+        Cpu cpu(8, 1);
+        run_case(s, string("check_condition/") + names[k], [&](uint64_t n) -> uint64_t {
+            int held = 0;
+            for (uint64_t i = 0; i < n; ++i) {
+                cpu.regs[1] = static_cast<unsigned int>(i & 1);
+                held += cpu.check_condition(move);
+            }
+            sink = held;
+            return n;
+        });
+    }
+    const Instruction flag = assemble("1 R0 ? ZF == 1");
+    Cpu cpu(8, 1);
+    run_case(s, "check_condition/flag", [&](uint64_t n) -> uint64_t {
+        int held = 0;
+        for (uint64_t i = 0; i < n; ++i) held += cpu.check_condition(flag);
+        sink = held;
+        return n;
+    });
+}
+
+// ALU update: a trigger latches the op, reading A0 evaluates it
+// INT_MIN / -1 (from R5 and R6) must overflow to 0 with OF on both ALU
+// paths and every engine, not kill the host with SIGFPE; a mismatch counts
+// as a failure
+void check_div_overflow() {
+    const vector<string> lines = {
+        "R5 A1", "R6 A2", "4 AF", "A0 R1", "OF R2",
+        "R5 ALU1.A1", "R6 ALU1.A2", "4 ALU1.AF", "ALU1.A0 R3", "ALU1.OF R4", "1 HF",
+    };
+    const vector<Instruction> prog = pack_bundles(parse_program_lines(lines), 1);
+    const pair<const char*, void (Computer::*)(int)> engines[] = {
+        { "interp", &Computer::run_from_ram },
+        { "threaded", &Computer::run_threaded },
+        { "jit", &Computer::run_jit },
+    };
+    for (const auto& [name, run] : engines) {
+        Computer c(static_cast<int>(prog.size() * INSTR_SLOT_SIZE), 8, 1);
+        c.set_alus(2);
+        c.put_program(prog, 0);
+        fill(c.cpu.regs.begin(), c.cpu.regs.end(), 7u);
+        c.cpu.regs[5] = 0x80000000u; // INT_MIN
+        c.cpu.regs[6] = 0xFFFFFFFFu; // -1
+        try {
+            (c.*run)(0);
+        } catch (const exception& e) {
+            fprintf(stderr, "alu/div_overflow: %s faulted: %s\n", name, e.what());
+            ++failures;
+            continue;
+        }
+        const vector<unsigned int> want = { 7, 0, 1, 0, 1 };
+        if (!equal(want.begin(), want.end(), c.cpu.regs.begin()) || c.status() != RUN_HALTED) {
+            fprintf(stderr, "alu/div_overflow: %s gave R1-R4 = %u %u %u %u\n", name,
+                c.cpu.regs[1], c.cpu.regs[2], c.cpu.regs[3], c.cpu.regs[4]);
+            ++failures;
+        }
+    }
+}
+
+void bench_alu(const Settings& s) {
+    check_div_overflow();
+    const char* const names[] = { "add", "sub", "mul", "div" };
+    for (int op = 1; op <= 4; ++op) {
+        Cpu cpu(8, 1);
+        run_case(s, string("alu/") + names[op - 1], [&](uint64_t n) -> uint64_t {
+            int acc = 0;
+            for (uint64_t i = 0; i < n; ++i) {
+                cpu.alu[1] = static_cast<int>(i & 0xFFFF);
+                cpu.alu[2] = 3;
+                cpu.trigger_alu(op);
+                acc += cpu.read_alu_result();
+            }
+            sink = acc;
+            return n;
+        });
+    }
+}
+
+const vector<string> SOURCE_LINES = {
+    "5 A1", "R3 A2", "1 AF", "A0 R0", "12 PC ? ZF == 1", "R1 R2 ? R3 >= 10", "ZF R4", "1 HF", "PC R7", "3 A2 ? NF != 0",
+};
+
+// The assembler front ends, per source line
+void bench_parsing(const Settings& s) {
+    run_case(s, "parse_raw_instruction", [&](uint64_t n) -> uint64_t {
+        size_t total = 0;
+        for (uint64_t i = 0; i < n; ++i) total += parse_raw_instruction(SOURCE_LINES[i % SOURCE_LINES.size()]).dest.size();
+        sink = static_cast<int>(total);
+        return n;
+    });
+    vector<RawInstruction> raw;
+    for (const string& line : SOURCE_LINES) raw.push_back(parse_raw_instruction(line));
+    run_case(s, "convert_line", [&](uint64_t n) -> uint64_t {
+        int total = 0;
+        for (uint64_t i = 0; i < n; ++i) total += convert_line(raw[i % raw.size()]).dest_type;
+        sink = total;
+        return n;
+    });
+    run_case(s, "lex_move", [&](uint64_t n) -> uint64_t {
+        int total = 0;
+        for (uint64_t i = 0; i < n; ++i) total += lex_move(SOURCE_LINES[i % SOURCE_LINES.size()]).dest_type;
+        sink = total;
+        return n;
+    });
+}
+
+// Whole programs through each engine; one op is one cycle
+void bench_engines(const Settings& s) {
+    // counts R0 to the bound in R1 in the ALU, then halts
+    const vector<string> loop = {
+        "0 R0", "R0 A1", "1 A2", "1 AF", "A0 R0", "R0 A1", "R1 A2", "2 AF", "1 PC ? NF == 1", "1 HF",
+    };
+    const vector<Instruction> prog = pack_bundles(parse_program_lines(loop), 1);
+    const pair<const char*, void (Computer::*)(int)> engines[] = {
+        { "run_from_ram", &Computer::run_from_ram },
+        { "run_threaded", &Computer::run_threaded },
+        { "run_jit", &Computer::run_jit },
+    };
+    for (const auto& [name, run] : engines) {
+        // loaded once; the bound is a register, so the code never changes and
+        // the threaded translation made by the warm-up run is kept. run_jit
+        // compiles its blocks on every call, so that stays in its time
+        Computer c(static_cast<int>(prog.size() * INSTR_SLOT_SIZE), 8, 1);
+        c.put_program(prog, 0);
+        auto run_to = [&, run = run](uint64_t bound) {
+            c.cpu.regs[1] = static_cast<unsigned int>(min<uint64_t>(bound, 0x7FFFFFFF));
+            c.cpu.halted = 0;
+            c.cpu.cycles = 0;
+            (c.*run)(0);
+            return c.cpu.cycles;
+        };
+        run_to(1);
+        // the bound is set so each batch runs about n cycles
+        run_case(s, name, [&](uint64_t n) -> uint64_t {
+            const uint64_t cycles = run_to(n / 8 + 1);
+            sink = static_cast<int>(c.cpu.regs[0]);
+            return cycles;
+        });
+    }
+}
+
+// Block copies through the LSU (a load and a store per word, looped in
+// moves) and through one DMA trigger; one op is one word copied
+void bench_memory_units(const Settings& s) {
+    constexpr int window = 1 << 20; // words per copy
+    auto machine = [&](const vector<string>& lines, int& from, int& to) {
+        const vector<Instruction> prog = pack_bundles(parse_program_lines(lines), 1);
+        from = static_cast<int>(prog.size() * INSTR_SLOT_SIZE / 4 + 1);
+        to = from + window;
+        return prog;
+    };
+    int from = 0, to = 0;
+    const vector<string> lsu_loop = {
+        "R0 L1", "L0 L2", "R1 L3", "R0 A1", "1 A2", "1 AF", "A0 R0", "R1 A1", "1 AF", "A0 R1",
+        "R0 A1", "0 A2", "2 AF", "0 PC ? NF == 1", "1 HF",
+    };
+    const vector<Instruction> lsu_prog = machine(lsu_loop, from, to);
+    Computer lsu(static_cast<int>((to + window) * 4), 8, 1);
+    run_case(s, "copy/lsu", [&](uint64_t n) -> uint64_t {
+        const int words = static_cast<int>(min<uint64_t>(n, window));
+        vector<Instruction> sized = lsu_prog;
+        sized[11].source_value = from + words;
+        lsu.put_program(sized, 0);
+        lsu.cpu.regs[0] = static_cast<unsigned int>(from);
+        lsu.cpu.regs[1] = static_cast<unsigned int>(to);
+        lsu.cpu.halted = 0;
+        lsu.run_from_ram(0);
+        sink = lsu.cpu.lsu[0];
+        return static_cast<uint64_t>(words);
+    });
+
+    // the trigger repeats in a loop counted in R0
+    const vector<string> dma_loop = {
+        "0 D1", "0 D2", "0 D3", "1 D0", "R0 A1", "1 A2", "1 AF", "A0 R0", "R0 A1", "0 A2", "2 AF", "0 PC ? NF == 1", "1 HF",
+    };
+    const vector<Instruction> dma_prog = machine(dma_loop, from, to);
+    Computer dma(static_cast<int>((to + window) * 4), 8, 1);
+    run_case(s, "copy/dma", [&](uint64_t n) -> uint64_t {
+        const uint64_t words = min<uint64_t>(n, window), passes = max<uint64_t>(n / words, 1);
+        vector<Instruction> sized = dma_prog;
+        sized[0].source_value = from;
+        sized[1].source_value = to;
+        sized[2].source_value = static_cast<int>(words);
+        sized[9].source_value = static_cast<int>(passes);
+        dma.put_program(sized, 0);
+        dma.cpu.regs[0] = 0;
+        dma.cpu.halted = 0;
+        dma.run_from_ram(0);
+        sink = dma.cpu.dma[0];
+        return words * passes;
+    });
+}
+
+// Two independent accumulations through the threaded engine, first both on
+// the one ALU and then one per ALU in bundles of two; one op is one step of
+// either chain. The one ALU reloads both its ports for every step. Two keep
+// each chain's sum and constant in their own ports and only store the sums
+// when the first passes the bound in R3: 1.5 cycles a step instead of 4.5.
+// Before timing, each result is checked.
+void bench_alu_chains(const Settings& s) {
+    const vector<string> one_alu = {
+        "R1 A1", "3 A2", "1 AF", "A0 R1", "R2 A1", "5 A2", "1 AF", "A0 R2", "0 PC ? R1 < R3", "1 HF",
+    };
+    const vector<string> two_alus = {
+        "R1 A1 | R2 ALU1.A1", "3 A2 | 5 ALU1.A2", "1 AF | 1 ALU1.AF", "A0 A1 | ALU1.A0 ALU1.A1", "2 PC ? A1 < R3",
+        "A0 R1 | ALU1.A0 R2", "1 HF",
+    };
+    const pair<const char*, const vector<string>*> cases[] = { { "chains/one_alu", &one_alu }, { "chains/two_alus", &two_alus } };
+    for (const auto& [name, lines] : cases) {
+        const int alus = lines == &two_alus ? 2 : 1;
+        const vector<Instruction> prog = pack_bundles(parse_program_lines(*lines), alus);
+        Computer c(static_cast<int>(prog.size() * INSTR_SLOT_SIZE), 8, alus);
+        c.set_alus(alus);
+        c.bundle_width = alus;
+        c.put_program(prog, 0);
+        auto run_steps = [&](uint64_t steps) {
+            c.cpu.regs[1] = c.cpu.regs[2] = 0;
+            c.cpu.regs[3] = static_cast<unsigned int>(3 * steps);
+            c.cpu.halted = 0;
+            c.run_threaded(0);
+        };
+        run_steps(1000);
+        if (c.cpu.regs[1] != 3000 || c.cpu.regs[2] != 5000 || c.status() != RUN_HALTED) {
+            fprintf(stderr, "%s: R1 R2 = %u %u\n", name, c.cpu.regs[1], c.cpu.regs[2]);
+            ++failures;
+        }
+        run_case(s, name, [&](uint64_t n) -> uint64_t {
+            // R2 grows by 5 a step and must not wrap
+            const uint64_t steps = min<uint64_t>(n / 2 + 1, 0x7FFFFFFF / 5);
+            run_steps(steps);
+            sink = static_cast<int>(c.cpu.regs[1] + c.cpu.regs[2]);
+            return steps * 2;
+        });
+    }
+}
+
+// One image on many register sets: every lane counts R0 up to its own
+// bound in R1, as LockstepBatch lanes and as one Computer::step run per
+// set. Bounds differ by lane so the lanes branch apart and regroup. One op
+// is one lane cycle. Before timing, every lane is checked against its
+// scalar run.
+void bench_lockstep(const Settings& s) {
+    const vector<string> loop = {
+        "0 R0", "R0 A1", "1 A2", "1 AF", "A0 R0", "R0 A1", "R1 A2", "2 AF", "1 PC ? NF == 1", "1 HF",
+    };
+    const vector<Instruction> prog = pack_bundles(parse_program_lines(loop), 1);
+    constexpr int lanes = 256;
+    Computer c(static_cast<int>(prog.size() * INSTR_SLOT_SIZE), 8, 1);
+    c.put_program(prog, 0);
+    auto bound = [](int lane, uint64_t base) { return static_cast<int>(min<uint64_t>(base + static_cast<uint64_t>(lane % 16), 0x7FFFFFFF)); };
+    auto scalar = [&](int lane, uint64_t base) {
+        fill(c.cpu.regs.begin(), c.cpu.regs.end(), 0u);
+        c.cpu.regs[1] = static_cast<unsigned int>(bound(lane, base));
+        fill(c.cpu.alu, c.cpu.alu + 3, 0);
+        c.cpu.flags = 0;
+        c.cpu.halted = 0;
+        c.cpu.pc = 0;
+        c.cpu.cycles = 0;
+        c.step(UINT64_MAX);
+        return c.cpu.cycles;
+    };
+
+    LockstepBatch batch(lanes, 8);
+    Cpu seed(8, 1);
+    auto run_lanes = [&](uint64_t base) {
+        // import_lane also clears the halt the last run left
+        for (int l = 0; l < lanes; ++l) {
+            seed.regs[1] = static_cast<unsigned int>(bound(l, base));
+            batch.import_lane(l, seed);
+        }
+        batch.run(c, 0);
+        uint64_t cycles = 0;
+        for (int l = 0; l < lanes; ++l) cycles += batch.cycles(l);
+        return cycles;
+    };
+
+    run_lanes(40);
+    for (int l = 0; l < lanes; ++l) {
+        const uint64_t cycles = scalar(l, 40);
+        bool same = batch.status(l) == LANE_HALTED && batch.cycles(l) == cycles && batch.pc(l) == c.cpu.pc;
+        for (int r = 0; r < 8; ++r) same &= batch.reg(l, r) == static_cast<int>(c.cpu.regs[static_cast<size_t>(r)]);
+        if (!same) {
+            fprintf(stderr, "lockstep: lane %d differs from Computer::step\n", l);
+            ++failures;
+            return;
+        }
+    }
+
+    const uint64_t per_bound = 8 * lanes; // cycles one step of every bound adds
+    run_case(s, "lockstep/lanes", [&](uint64_t n) -> uint64_t {
+        const uint64_t cycles = run_lanes(n / per_bound + 1);
+        sink = batch.reg(0, 0);
+        return cycles;
+    });
+    run_case(s, "lockstep/scalar", [&](uint64_t n) -> uint64_t {
+        uint64_t cycles = 0;
+        for (int l = 0; l < lanes; ++l) cycles += scalar(l, n / per_bound + 1);
+        sink = static_cast<int>(c.cpu.regs[0]);
+        return cycles;
+    });
+}
+
+// Scheduler over many guests counting to different bounds, next to running
+// them one after another; first checks that a runaway `0 PC` guest ahead
+// of them in the queue delays none of them past its own quanta
+void bench_scheduler(const Settings& s) {
+    const vector<string> loop = {
+        "0 R0", "R0 A1", "1 A2", "1 AF", "A0 R0", "R0 A1", "R1 A2", "2 AF", "1 PC ? NF == 1", "1 HF",
+    };
+    const vector<Instruction> prog = pack_bundles(parse_program_lines(loop), 1);
+    const vector<Instruction> runaway = pack_bundles(parse_program_lines({ "0 PC" }), 1);
+    constexpr int guests = 64;
+    constexpr uint64_t quantum = 1000;
+    auto guest = [&](const vector<Instruction>& code, uint64_t bound) {
+        auto c = make_unique<Computer>(static_cast<int>(code.size() * INSTR_SLOT_SIZE), 8, 1);
+        c->put_program(code, 0);
+        c->cpu.regs[1] = static_cast<unsigned int>(min<uint64_t>(bound, 0x7FFFFFFF));
+        c->cpu.pc = 0;
+        c->cpu.increment_pc = true;
+        return c;
+    };
+    auto bound = [](int g, uint64_t base) { return base + static_cast<uint64_t>(g % 16) * base / 4; };
+
+    {
+        Scheduler sched(quantum);
+        const size_t spin = sched.add(guest(runaway, 0));
+        vector<uint64_t> rounds_needed;
+        for (int g = 0; g < guests; ++g) {
+            auto alone = guest(prog, bound(g, 500));
+            alone->step(UINT64_MAX);
+            rounds_needed.push_back((alone->cpu.cycles + quantum - 1) / quantum);
+            sched.add(guest(prog, bound(g, 500)));
+        }
+        uint64_t rounds = 0;
+        vector<uint64_t> finished(guests, 0);
+        while (sched.runnable() > 1) {
+            sched.round();
+            ++rounds;
+            for (int g = 0; g < guests; ++g)
+                if (!finished[g] && sched.status(static_cast<size_t>(g) + 1) != RUN_BUDGET_EXHAUSTED) finished[g] = rounds;
+        }
+        for (int g = 0; g < guests; ++g) {
+            if (finished[g] != rounds_needed[static_cast<size_t>(g)] || sched.status(static_cast<size_t>(g) + 1) != RUN_HALTED) {
+                fprintf(stderr, "scheduler: guest %d finished in round %llu, expected %llu\n", g,
+                    static_cast<unsigned long long>(finished[g]), static_cast<unsigned long long>(rounds_needed[static_cast<size_t>(g)]));
+                ++failures;
+                return;
+            }
+        }
+        if (sched.guest(spin).cpu.cycles != rounds * quantum) {
+            fprintf(stderr, "scheduler: runaway guest ran %llu cycles in %llu quanta\n",
+                static_cast<unsigned long long>(sched.guest(spin).cpu.cycles), static_cast<unsigned long long>(rounds));
+            ++failures;
+            return;
+        }
+    }
+
+    const uint64_t per_bound = 8 * guests; // cycles one step of every bound adds
+    run_case(s, "scheduler/guests", [&](uint64_t n) -> uint64_t {
+        Scheduler sched(quantum);
+        for (int g = 0; g < guests; ++g) sched.add(guest(prog, bound(g, n / per_bound / 3 + 1)));
+        sched.run();
+        uint64_t cycles = 0;
+        for (size_t g = 0; g < sched.size(); ++g) cycles += sched.guest(g).cpu.cycles;
+        sink = static_cast<int>(cycles);
+        return cycles;
+    });
+    run_case(s, "scheduler/sequential", [&](uint64_t n) -> uint64_t {
+        uint64_t cycles = 0;
+        for (int g = 0; g < guests; ++g) {
+            auto c = guest(prog, bound(g, n / per_bound / 3 + 1));
+            c->run_for(UINT64_MAX);
+            cycles += c->cpu.cycles;
+        }
+        sink = static_cast<int>(cycles);
+        return cycles;
+    });
+}
+
+int usage() {
+    fprintf(stderr, "Usage: yatta-bench [-r reps] [-t ms per rep] [filter]\n");
+    return 2;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Settings settings;
+    for (int i = 1; i < argc; ++i) {
+        const string arg = argv[i];
+        if ((arg == "-r" || arg == "-t") && i + 1 < argc) {
+            const double value = atof(argv[++i]);
+            if (value <= 0) return usage();
+            if (arg == "-r") settings.reps = static_cast<int>(value);
+            else settings.rep_ms = value;
+        }
+        else if (!arg.empty() && arg[0] == '-') return usage();
+        else settings.filter = arg;
+    }
+
+    bench_exec_line(settings);
+    bench_conditions(settings);
+    bench_alu(settings);
+    bench_parsing(settings);
+    bench_engines(settings);
+    bench_memory_units(settings);
+    bench_alu_chains(settings);
+    bench_lockstep(settings);
+    bench_scheduler(settings);
+    return failures ? 1 : 0;
+}
@@ -1,14 +1,25 @@
 #include "cpu.hpp"
+#include "assembler.hpp"
+#include "batch.hpp"
+#include "encoding.hpp"
+#include "lexer.hpp"
+#include "memory.hpp"
 #include "parser.hpp"
+#include "units.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
 #include <sstream>
 #include <stdexcept>
+#include <string_view>
+#include <thread>
 #include <cstring>
 
 using namespace std;
 
 Instruction convert_line(const RawInstruction& line_raw) {
-    // Initialize: source_type, source_value, dest_type, dest_value, comp[], cond1_type, cond1, cond2_type, cond2
-    Instruction prog = { 0, 0, 0, 0, {0}, -1, 0, -1, 0 };
+    // Initialize: source_type, source_value, dest_type, dest_value, cmp, cond1_type, cond1, cond2_type, cond2
+    Instruction prog = { 0, 0, 0, 0, CMP_NONE, -1, 0, -1, 0 };
     // --- CONDITION PARSING ---
     if (!line_raw.condition.empty()) {
         string lhs, rhs, op;
@@ -20,14 +31,15 @@ Instruction convert_line(const RawInstruction& line_raw) {
                 rhs = line_raw.condition.substr(pos + op.size());
                 string lhs_trim = trim(lhs);
                 string rhs_trim = trim(rhs);
-                string comp_str = ops_map[op];
-                // copy comparison mnemonic into fixed-size field
-                strncpy(prog.comp, comp_str.c_str(), sizeof(prog.comp)-1);
-                prog.comp[sizeof(prog.comp)-1] = '\0';
+                prog.cmp = ops_map[op];
 
                 // Parse lhs and rhs into typed operands (reuse source parsing rules)
                 auto parse_operand = [&](const string& tok)->pair<int,int>{
                     if (tok.empty()) throw runtime_error("empty condition operand");
+                    int unit_type = 0, unit_value = 0;
+                    if (parse_unit_operand(tok, unit_type, unit_value)) {
+                        return {unit_type, unit_value}; // e.g. ALU1.ZF
+                    }
                     if (all_of(tok.begin(), tok.end(), ::isdigit)) {
                         return {0, stoi(tok)}; // constant
                     }
@@ -45,6 +57,7 @@ Instruction convert_line(const RawInstruction& line_raw) {
                             case 'N': v = 3; break;
                             case 'O': v = 4; break;
                             case 'H': v = 5; break;
+                            case 'T': v = 6; break;
                             default: throw runtime_error("unknown flag symbol in condition: '" + tok + "'");
                         }
                         return {3, v};
@@ -52,6 +65,12 @@ Instruction convert_line(const RawInstruction& line_raw) {
                     if (tok[0] == 'A' && tok.size() > 1 && isdigit(tok[1])) {
                         return {2, stoi(tok.substr(1))};
                     }
+                    if (tok[0] == 'L' && tok.size() > 1 && isdigit(tok[1])) {
+                        return {5, stoi(tok.substr(1))};
+                    }
+                    if (tok[0] == 'D' && tok.size() > 1 && isdigit(tok[1])) {
+                        return {6, stoi(tok.substr(1))};
+                    }
                     throw runtime_error("unknown token in condition: '" + tok + "'");
                 };
 
@@ -65,18 +84,21 @@ Instruction convert_line(const RawInstruction& line_raw) {
                 break;
             }
         }
-        if (prog.comp[0] == '\0') {
+        if (prog.cmp == CMP_NONE) {
             throw runtime_error("Conditional statement '" + line_raw.condition + "' contains no valid comparison operator.");
         }
     } else {
         // no condition
         prog.cond1_type = -1;
         prog.cond2_type = -1;
-        prog.comp[0] = '\0';
+        prog.cmp = CMP_NONE;
     }
     
     // --- SOURCE PARSING ---
-    if (all_of(line_raw.src.begin(), line_raw.src.end(), ::isdigit) && !line_raw.src.empty()) {
+    if (parse_unit_operand(line_raw.src, prog.source_type, prog.source_value)) {
+        // long unit spelling, e.g. ALU1.A0
+    }
+    else if (all_of(line_raw.src.begin(), line_raw.src.end(), ::isdigit) && !line_raw.src.empty()) {
         prog.source_type = 0; // number
         prog.source_value = stoi(line_raw.src);
     }
@@ -97,6 +119,7 @@ Instruction convert_line(const RawInstruction& line_raw) {
             case 'N': prog.source_value = 3; break;
             case 'O': prog.source_value = 4; break;
             case 'H': prog.source_value = 5; break;
+            case 'T': prog.source_value = 6; break;
             default: throw runtime_error("unknown flag symbol '" + line_raw.src + "'");
         }
     }
@@ -104,12 +127,23 @@ Instruction convert_line(const RawInstruction& line_raw) {
         prog.source_type = 2;
         prog.source_value = stoi(line_raw.src.substr(1));
     }
+    else if (line_raw.src[0] == 'L' && line_raw.src.size() > 1 && isdigit(line_raw.src[1])) {
+        prog.source_type = 5; // load/store unit
+        prog.source_value = stoi(line_raw.src.substr(1));
+    }
+    else if (line_raw.src[0] == 'D' && line_raw.src.size() > 1 && isdigit(line_raw.src[1])) {
+        prog.source_type = 6; // DMA unit
+        prog.source_value = stoi(line_raw.src.substr(1));
+    }
     else {
         throw runtime_error("unknown symbol '" + line_raw.src + "' in source");
     }
 
     // --- DESTINATION PARSING ---
-    if (line_raw.dest == "PC") {
+    if (parse_unit_operand(line_raw.dest, prog.dest_type, prog.dest_value)) {
+        // long unit spelling, e.g. ALU1.AF
+    }
+    else if (line_raw.dest == "PC") {
         prog.dest_type = 4;
         prog.dest_value = 0;
     }
@@ -121,6 +155,10 @@ Instruction convert_line(const RawInstruction& line_raw) {
         prog.dest_type = 3;
         prog.dest_value = 5;
     }
+    else if (line_raw.dest == "TF") {
+        prog.dest_type = 3;
+        prog.dest_value = 6;
+    }
     else if (line_raw.dest[0] == 'R' && line_raw.dest.size() > 1 && isdigit(line_raw.dest[1])) {
         prog.dest_type = 1;
         prog.dest_value = stoi(line_raw.dest.substr(1));
@@ -129,6 +167,14 @@ Instruction convert_line(const RawInstruction& line_raw) {
         prog.dest_type = 2;
         prog.dest_value = stoi(line_raw.dest.substr(1));
     }
+    else if (line_raw.dest[0] == 'L' && line_raw.dest.size() > 1 && isdigit(line_raw.dest[1])) {
+        prog.dest_type = 5;
+        prog.dest_value = stoi(line_raw.dest.substr(1));
+    }
+    else if (line_raw.dest[0] == 'D' && line_raw.dest.size() > 1 && isdigit(line_raw.dest[1])) {
+        prog.dest_type = 6;
+        prog.dest_value = stoi(line_raw.dest.substr(1));
+    }
     else if (all_of(line_raw.dest.begin(), line_raw.dest.end(), ::isdigit) && !line_raw.dest.empty()) {
         prog.dest_type = 0;
         prog.dest_value = 0;
@@ -151,6 +197,491 @@ vector<Instruction> decode_program(const vector<RawInstruction>& prog_raw) {
     return prog_decoded;
 }
 
+// Operand spelling shared by sources, destinations and conditions
+static string operand_text(int type, int value) {
+    static const char* const FLAGS[7] = { "?F", "AF", "ZF", "NF", "OF", "HF", "TF" };
+    switch (type) {
+    case 0: return to_string(value);
+    case 1: return "R" + to_string(value);
+    case 3: return FLAGS[value >= 1 && value <= 6 ? value : 0];
+    case 4: return "PC";
+    default: return unit_kind(type) ? unit_operand_name(type, value) : "?";
+    }
+}
+
+string disassemble(const Instruction& move) {
+    static const char* const CMP_TEXT[8] = { "", "==", "!=", "<", "<=", ">", ">=", "??" };
+    string text = operand_text(move.source_type, move.source_value) + " " + operand_text(move.dest_type, move.dest_value);
+    if (move.cmp != CMP_NONE) {
+        text += " ? " + operand_text(move.cond1_type, move.cond1) + " " + CMP_TEXT[move.cmp & 7] + " "
+            + operand_text(move.cond2_type, move.cond2);
+    }
+    return text;
+}
+
+int bundle_width(const vector<RawInstruction>& prog_raw) {
+    int width = 1, run = 0;
+    for (const auto& raw_instr : prog_raw) {
+        run = raw_instr.parallel ? run + 1 : 1;
+        width = max(width, run);
+    }
+    return width;
+}
+
+vector<Instruction> pack_bundles(const vector<RawInstruction>& prog_raw, int width) {
+    if (width < 1) throw runtime_error("pack_bundles: bundle width must be >= 1");
+    const Instruction nop = { 0, 0, 0, 0, CMP_NONE, -1, 0, -1, 0 };
+    vector<Instruction> prog;
+    prog.reserve(prog_raw.size());
+
+    size_t i = 0;
+    while (i < prog_raw.size()) {
+        const size_t first = prog.size();
+        const size_t bundle = first / static_cast<size_t>(width);
+        do {
+            if (prog.size() - first == static_cast<size_t>(width)) {
+                throw runtime_error("bundle " + to_string(bundle) + " has more than " + to_string(width) + " moves");
+            }
+            Instruction instr = convert_line(prog_raw[i]);
+            // unconditional moves to the same place can never share a cycle
+            for (size_t j = first; j < prog.size(); ++j) {
+                if (instr.dest_type != 0 && instr.cmp == CMP_NONE && prog[j].cmp == CMP_NONE
+                    && prog[j].dest_type == instr.dest_type && prog[j].dest_value == instr.dest_value) {
+                    throw runtime_error("bundle " + to_string(bundle) + " writes '" + prog_raw[i].dest + "' twice");
+                }
+            }
+            prog.push_back(instr);
+            ++i;
+        } while (i < prog_raw.size() && prog_raw[i].parallel);
+        prog.resize(first + static_cast<size_t>(width), nop);
+    }
+    return prog;
+}
+
+// assemble_file splits the source into chunks of about this many bytes, cut
+// at line ends; chunks are lexed and encoded on a thread pool
+constexpr size_t ASSEMBLE_CHUNK_BYTES = size_t(1) << 18;
+
+// A run of whole source lines and, after encoding, their image slots
+struct SourceChunk {
+    string_view text;
+    size_t first_line = 0;   // global number of the line before `text`
+    size_t lines = 0;
+    size_t first_bundle = 0; // global index of the chunk's first bundle
+    size_t bundles = 0, moves = 0;
+    size_t width = 1;
+    vector<uint64_t> hashes; // per bundle line, for incremental assembly
+    vector<string_view> line_text; // the lines hashed, to confirm a match
+    vector<uint8_t> slots;
+    size_t error_line = 0;   // first error in the chunk; local in pass 1
+    string error;
+};
+
+// Call fn(line, line_number) for each trimmed line holding moves, numbering
+// from `line_no` + 1. Returns the number of lines seen.
+template <typename Fn>
+static size_t for_each_line(string_view text, size_t line_no, Fn&& fn) {
+    const size_t first = line_no;
+    for (size_t pos = 0; pos < text.size();) {
+        size_t end = text.find('\n', pos);
+        if (end == string_view::npos) end = text.size();
+        ++line_no;
+        const string_view line = trim_view(text.substr(pos, end - pos));
+        if (!line.empty() && line[0] != ';') fn(line, line_no);
+        pos = end + 1;
+    }
+    return line_no - first;
+}
+
+// 64-bit FNV-1a
+static uint64_t hash_line(string_view line) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (char c : line) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+static string_view map_source(const string& src_path, Memory& source) {
+    error_code ec;
+    const uintmax_t size = filesystem::file_size(src_path, ec);
+    if (ec) throw runtime_error("cannot open source " + src_path);
+    source.map_file(src_path, 0, static_cast<size_t>(size), MEMORY_READ_ONLY);
+    return string_view(reinterpret_cast<const char*>(source.data()), source.size());
+}
+
+static vector<SourceChunk> split_chunks(string_view text) {
+    vector<SourceChunk> chunks;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find('\n', min(pos + ASSEMBLE_CHUNK_BYTES, text.size()) - 1);
+        end = end == string_view::npos ? text.size() : end + 1;
+        SourceChunk chunk;
+        chunk.text = text.substr(pos, end - pos);
+        chunks.push_back(move(chunk));
+        pos = end;
+    }
+    return chunks;
+}
+
+// No more workers than chunks
+static unsigned pool_size(unsigned threads, size_t chunks) {
+    return static_cast<unsigned>(min<size_t>(threads ? threads : thread::hardware_concurrency(), max<size_t>(chunks, 1)));
+}
+
+// Pass 1: count bundles, moves and lines, and find the widest bundle
+static void measure_chunk(SourceChunk& chunk, bool hash) {
+    chunk.lines = for_each_line(chunk.text, 0, [&](string_view line, size_t line_no) {
+        const size_t moves = 1 + static_cast<size_t>(count(line.begin(), line.end(), '|'));
+        if (moves > UINT16_MAX && chunk.error.empty()) {
+            chunk.error_line = line_no;
+            chunk.error = "bundle has more than " + to_string(UINT16_MAX) + " moves";
+        }
+        chunk.moves += moves;
+        chunk.bundles++;
+        chunk.width = max(chunk.width, moves);
+        if (hash) {
+            chunk.hashes.push_back(hash_line(line));
+            chunk.line_text.push_back(line);
+        }
+    });
+}
+
+// Run pass 1 over every chunk, then number lines and bundles globally
+static AssemblyStats measure_chunks(vector<SourceChunk>& chunks, WorkStealingPool& pool, bool hash) {
+    pool.run(chunks.size(), [&](size_t i) { measure_chunk(chunks[i], hash); });
+
+    AssemblyStats stats;
+    size_t width = 1, lines = 0;
+    for (auto& chunk : chunks) {
+        if (!chunk.error.empty()) throw runtime_error("line " + to_string(lines + chunk.error_line) + ": " + chunk.error);
+        chunk.first_line = lines;
+        chunk.first_bundle = stats.bundles;
+        lines += chunk.lines;
+        stats.bundles += chunk.bundles;
+        stats.moves += chunk.moves;
+        width = max(width, chunk.width);
+    }
+    stats.width = static_cast<int>(width);
+    if (stats.bundles * width > UINT32_MAX) throw runtime_error("assemble_file: program too large for an image");
+    return stats;
+}
+
+// Lex one source line into `width` encoded slots. `bundle` and `dests` are
+// scratch space for `width` entries.
+static void encode_bundle(string_view line, size_t bundle_no, size_t width, Instruction* bundle, string_view* dests, uint8_t* slots) {
+    const Instruction nop = { 0, 0, 0, 0, CMP_NONE, -1, 0, -1, 0 };
+    size_t n = 0, start = 0;
+    while (true) {
+        const size_t bar = line.find('|', start);
+        bundle[n] = lex_move(line.substr(start, bar == string_view::npos ? string_view::npos : bar - start), &dests[n]);
+        // unconditional moves to the same place can never share a cycle
+        for (size_t j = 0; j < n; ++j) {
+            if (bundle[n].dest_type != 0 && bundle[n].cmp == CMP_NONE && bundle[j].cmp == CMP_NONE
+                && bundle[j].dest_type == bundle[n].dest_type && bundle[j].dest_value == bundle[n].dest_value) {
+                throw runtime_error("bundle " + to_string(bundle_no) + " writes '" + string(dests[n]) + "' twice");
+            }
+        }
+        ++n;
+        if (bar == string_view::npos) break;
+        start = bar + 1;
+    }
+    fill(bundle + n, bundle + width, nop);
+    for (size_t k = 0; k < width; ++k) encode_instruction(bundle[k], slots + k * INSTR_SLOT_SIZE);
+}
+
+// Pass 2: lex and encode every bundle into chunk.slots, `width` slots each.
+// Stops at the first error.
+static void encode_chunk(SourceChunk& chunk, size_t width) {
+    vector<Instruction> bundle(width);
+    vector<string_view> dests(width);
+    chunk.slots.resize(chunk.bundles * width * INSTR_SLOT_SIZE);
+    size_t bundle_no = chunk.first_bundle;
+    try {
+        for_each_line(chunk.text, chunk.first_line, [&](string_view line, size_t line_no) {
+            try {
+                uint8_t* slots = chunk.slots.data() + (bundle_no - chunk.first_bundle) * width * INSTR_SLOT_SIZE;
+                encode_bundle(line, bundle_no, width, bundle.data(), dests.data(), slots);
+            } catch (const exception&) {
+                chunk.error_line = line_no;
+                throw;
+            }
+            ++bundle_no;
+        });
+    } catch (const exception& e) {
+        chunk.error = e.what();
+        chunk.slots.clear();
+    }
+}
+
+// Header and pass 2. Encodes a few chunks per worker at a time and writes
+// them in source order, so memory stays bounded and the first error
+// reported is the earliest in the file.
+static void write_chunks(vector<SourceChunk>& chunks, const AssemblyStats& stats, WorkStealingPool& pool, ostream& out) {
+    const size_t width = static_cast<size_t>(stats.width);
+    ImageHeader header;
+    header.width = static_cast<uint16_t>(width);
+    header.count = static_cast<uint32_t>(stats.bundles * width);
+    write_image_header(out, header);
+
+    const size_t wave = static_cast<size_t>(pool.size()) * 2;
+    for (size_t first = 0; first < chunks.size(); first += wave) {
+        const size_t count = min(wave, chunks.size() - first);
+        pool.run(count, [&](size_t i) { encode_chunk(chunks[first + i], width); });
+        for (size_t i = first; i < first + count; ++i) {
+            if (!chunks[i].error.empty()) throw runtime_error("line " + to_string(chunks[i].error_line) + ": " + chunks[i].error);
+            out.write(reinterpret_cast<const char*>(chunks[i].slots.data()), static_cast<streamsize>(chunks[i].slots.size()));
+            vector<uint8_t>().swap(chunks[i].slots);
+        }
+    }
+    if (!out) throw runtime_error("assemble_file: write failed");
+}
+
+AssemblyStats assemble_file(const string& src_path, ostream& out, unsigned threads) {
+    Memory source;
+    vector<SourceChunk> chunks = split_chunks(map_source(src_path, source));
+    WorkStealingPool pool(pool_size(threads, chunks.size()));
+    AssemblyStats stats = measure_chunks(chunks, pool, false);
+    write_chunks(chunks, stats, pool, out);
+    stats.encoded = stats.bundles;
+    return stats;
+}
+
+// --- Incremental assembly ---
+// The line cache beside the output holds one hash per bundle line of the
+// source it was built from, plus the output's modification time, so an
+// image changed behind the cache's back is rebuilt rather than patched.
+// The lines themselves follow, so a matching hash is confirmed against the
+// text and a collision re-encodes the line instead of keeping stale slots.
+//   u32 magic, u16 version, u16 width, u64 bundle count, i64 output mtime,
+//   then one u64 line hash per bundle, one u32 line length per bundle and
+//   the lines back to back. Little endian.
+constexpr uint32_t LINE_CACHE_MAGIC = 0x43415459; // "YTAC"
+constexpr uint16_t LINE_CACHE_VERSION = 2;
+constexpr size_t LINE_CACHE_HEADER_SIZE = 24;
+
+// Re-encoding more than this share of the bundles falls back to a full,
+// parallel rebuild
+constexpr size_t INCREMENTAL_MAX_DIRTY_SHARE = 4;
+
+static int64_t output_mtime(const string& path) {
+    return static_cast<int64_t>(filesystem::last_write_time(path).time_since_epoch().count());
+}
+
+static uint64_t get_le(const uint8_t* p, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; ++i) v |= static_cast<uint64_t>(p[i]) << (8 * i);
+    return v;
+}
+
+static void put_le(uint8_t* p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; ++i) p[i] = static_cast<uint8_t>(v >> (8 * i));
+}
+
+// Bundle lines of one build of a source
+struct SourceLines {
+    vector<uint64_t> hashes;
+    vector<string_view> text;
+    // Line i here is line j of `other`: same hash, then same text
+    bool same(size_t i, const SourceLines& other, size_t j) const {
+        return hashes[i] == other.hashes[j] && text[i] == other.text[j];
+    }
+};
+
+// Lines from a cache that still describes `out_path`, viewing into `storage`;
+// false if there is no usable cache
+static bool read_line_cache(const string& cache_path, const string& out_path, size_t& width, SourceLines& lines, string& storage) {
+    ifstream in(cache_path, ios::binary);
+    uint8_t header[LINE_CACHE_HEADER_SIZE];
+    if (!in || !in.read(reinterpret_cast<char*>(header), LINE_CACHE_HEADER_SIZE)) return false;
+    if (get_le(header, 4) != LINE_CACHE_MAGIC || get_le(header + 4, 2) != LINE_CACHE_VERSION) return false;
+    width = static_cast<size_t>(get_le(header + 6, 2));
+    const uint64_t count = get_le(header + 8, 8);
+
+    error_code ec;
+    const uintmax_t size = filesystem::file_size(out_path, ec);
+    if (ec || width == 0 || size != IMAGE_HEADER_SIZE + count * width * INSTR_SLOT_SIZE) return false;
+    if (static_cast<int64_t>(get_le(header + 16, 8)) != output_mtime(out_path)) return false;
+
+    const size_t n = static_cast<size_t>(count);
+    vector<uint8_t> raw(n * 12);
+    if (!in.read(reinterpret_cast<char*>(raw.data()), static_cast<streamsize>(raw.size()))) return false;
+    lines.hashes.resize(n);
+    size_t text_bytes = 0;
+    for (size_t i = 0; i < n; ++i) {
+        lines.hashes[i] = get_le(raw.data() + i * 8, 8);
+        text_bytes += static_cast<size_t>(get_le(raw.data() + n * 8 + i * 4, 4));
+    }
+    storage.resize(text_bytes);
+    if (!in.read(storage.data(), static_cast<streamsize>(text_bytes))) return false;
+    lines.text.resize(n);
+    for (size_t i = 0, at = 0; i < n; ++i) {
+        const size_t length = static_cast<size_t>(get_le(raw.data() + n * 8 + i * 4, 4));
+        lines.text[i] = string_view(storage).substr(at, length);
+        at += length;
+    }
+    return true;
+}
+
+static void write_line_cache(const string& cache_path, const string& out_path, size_t width, const SourceLines& lines) {
+    const size_t n = lines.hashes.size();
+    size_t text_bytes = 0;
+    for (string_view line : lines.text) text_bytes += line.size();
+    vector<uint8_t> raw(LINE_CACHE_HEADER_SIZE + n * 12 + text_bytes);
+    put_le(raw.data(), LINE_CACHE_MAGIC, 4);
+    put_le(raw.data() + 4, LINE_CACHE_VERSION, 2);
+    put_le(raw.data() + 6, width, 2);
+    put_le(raw.data() + 8, n, 8);
+    put_le(raw.data() + 16, static_cast<uint64_t>(output_mtime(out_path)), 8);
+    uint8_t* text = raw.data() + LINE_CACHE_HEADER_SIZE + n * 12;
+    for (size_t i = 0; i < n; ++i) {
+        put_le(raw.data() + LINE_CACHE_HEADER_SIZE + i * 8, lines.hashes[i], 8);
+        put_le(raw.data() + LINE_CACHE_HEADER_SIZE + n * 8 + i * 4, lines.text[i].size(), 4);
+        text = copy(lines.text[i].begin(), lines.text[i].end(), text);
+    }
+
+    const string partial = cache_path + ".part";
+    {
+        ofstream out(partial, ios::binary);
+        out.write(reinterpret_cast<const char*>(raw.data()), static_cast<streamsize>(raw.size()));
+        if (!out) throw runtime_error("assemble_incremental: cannot write " + cache_path);
+    }
+    filesystem::rename(partial, cache_path);
+}
+
+// Move `bytes` within `f` from offset `from` to `to`; the ranges may overlap
+static void move_bytes(fstream& f, uint64_t from, uint64_t to, uint64_t bytes) {
+    vector<char> buffer(size_t(1) << 20);
+    for (uint64_t done = 0; done < bytes;) {
+        const uint64_t n = min<uint64_t>(buffer.size(), bytes - done);
+        // moving towards the end copies from the back so nothing is overwritten unread
+        const uint64_t at = to > from ? bytes - done - n : done;
+        f.seekg(static_cast<streamoff>(from + at));
+        f.read(buffer.data(), static_cast<streamsize>(n));
+        f.seekp(static_cast<streamoff>(to + at));
+        f.write(buffer.data(), static_cast<streamsize>(n));
+        done += n;
+    }
+}
+
+AssemblyStats assemble_incremental(const string& src_path, const string& out_path, unsigned threads) {
+    Memory source;
+    vector<SourceChunk> chunks = split_chunks(map_source(src_path, source));
+    WorkStealingPool pool(pool_size(threads, chunks.size()));
+    AssemblyStats stats = measure_chunks(chunks, pool, true);
+    const size_t width = static_cast<size_t>(stats.width);
+    SourceLines lines; // views into `source`, which outlives them
+    lines.hashes.reserve(stats.bundles);
+    lines.text.reserve(stats.bundles);
+    for (auto& chunk : chunks) {
+        lines.hashes.insert(lines.hashes.end(), chunk.hashes.begin(), chunk.hashes.end());
+        lines.text.insert(lines.text.end(), chunk.line_text.begin(), chunk.line_text.end());
+        vector<uint64_t>().swap(chunk.hashes);
+        vector<string_view>().swap(chunk.line_text);
+    }
+
+    const string cache_path = out_path + ".cache";
+    size_t cached_width = 0;
+    SourceLines cached;
+    string cached_storage;
+    bool patch = read_line_cache(cache_path, out_path, cached_width, cached, cached_storage) && cached_width == width;
+
+    // unchanged lines at both ends keep their slots; with the same line
+    // count only the lines that differ are dirty, otherwise everything
+    // between the two unchanged ends is
+    const size_t n_old = cached.hashes.size(), n_new = lines.hashes.size();
+    size_t prefix = 0, suffix = 0;
+    vector<size_t> dirty;
+    if (patch) {
+        const size_t common = min(n_old, n_new);
+        while (prefix < common && cached.same(prefix, lines, prefix)) ++prefix;
+        while (suffix < common - prefix && cached.same(n_old - 1 - suffix, lines, n_new - 1 - suffix)) ++suffix;
+        for (size_t i = prefix; i < n_new - suffix; ++i) {
+            if (n_old != n_new || !cached.same(i, lines, i)) dirty.push_back(i);
+        }
+        patch = dirty.size() * INCREMENTAL_MAX_DIRTY_SHARE <= n_new;
+    }
+
+    if (!patch) {
+        // full rebuild beside the output, then swap it in
+        filesystem::remove(cache_path);
+        const string partial = out_path + ".part";
+        {
+            ofstream out(partial, ios::binary);
+            if (!out) throw runtime_error("assemble_incremental: cannot open " + partial);
+            try {
+                write_chunks(chunks, stats, pool, out);
+            } catch (...) {
+                out.close();
+                filesystem::remove(partial);
+                throw;
+            }
+        }
+        filesystem::rename(partial, out_path);
+        stats.encoded = stats.bundles;
+        write_line_cache(cache_path, out_path, width, lines);
+        return stats;
+    }
+
+    // lex just the dirty bundles, visiting only the chunks that hold them;
+    // the output is not touched until all of them have encoded
+    const size_t bundle_bytes = width * INSTR_SLOT_SIZE;
+    vector<uint8_t> encoded(dirty.size() * bundle_bytes);
+    vector<Instruction> bundle(width);
+    vector<string_view> dests(width);
+    size_t next = 0;
+    for (const auto& chunk : chunks) {
+        if (next == dirty.size()) break;
+        if (dirty[next] >= chunk.first_bundle + chunk.bundles) continue;
+        size_t bundle_no = chunk.first_bundle;
+        for_each_line(chunk.text, chunk.first_line, [&](string_view line, size_t line_no) {
+            if (next < dirty.size() && dirty[next] == bundle_no) {
+                try {
+                    encode_bundle(line, bundle_no, width, bundle.data(), dests.data(), encoded.data() + next * bundle_bytes);
+                } catch (const exception& e) {
+                    throw runtime_error("line " + to_string(line_no) + ": " + e.what());
+                }
+                ++next;
+            }
+            ++bundle_no;
+        });
+    }
+
+    // patch a copy beside the output and swap it in, so a crash leaves the
+    // old image whole and a machine with it mapped keeps the old file
+    const string partial = out_path + ".part";
+    filesystem::copy_file(out_path, partial, filesystem::copy_options::overwrite_existing);
+    try {
+        fstream f(partial, ios::in | ios::out | ios::binary);
+        if (!f) throw runtime_error("assemble_incremental: cannot open " + partial);
+        if (n_old != n_new) {
+            move_bytes(f, IMAGE_HEADER_SIZE + (n_old - suffix) * bundle_bytes, IMAGE_HEADER_SIZE + (n_new - suffix) * bundle_bytes, suffix * bundle_bytes);
+            ImageHeader header;
+            header.width = static_cast<uint16_t>(width);
+            header.count = static_cast<uint32_t>(n_new * width);
+            f.seekp(0);
+            write_image_header(f, header);
+        }
+        for (size_t k = 0; k < dirty.size(); ++k) {
+            f.seekp(static_cast<streamoff>(IMAGE_HEADER_SIZE + dirty[k] * bundle_bytes));
+            f.write(reinterpret_cast<const char*>(encoded.data() + k * bundle_bytes), static_cast<streamsize>(bundle_bytes));
+        }
+        if (!f) throw runtime_error("assemble_incremental: write to " + partial + " failed");
+        f.close();
+        if (n_new < n_old) filesystem::resize_file(partial, IMAGE_HEADER_SIZE + n_new * bundle_bytes);
+    } catch (...) {
+        filesystem::remove(partial);
+        throw;
+    }
+    // the old cache no longer describes the image once it is swapped in
+    filesystem::remove(cache_path);
+    filesystem::rename(partial, out_path);
+    stats.encoded = dirty.size();
+    write_line_cache(cache_path, out_path, width, lines);
+    return stats;
+}
+
 // string_to_instr used to convert a machine-code string into an Instruction.
 // Removed implementation (kept here commented for reference).
 /*
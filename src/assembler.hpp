@@ -1,9 +1,54 @@
 #pragma once
 
 #include "cpu.hpp"
+#include <cstddef>
+#include <iosfwd>
+#include <string>
 
 // Convert a RawInstruction into a space-delimited machine-code string
 Instruction convert_line(const RawInstruction& line_raw);
 
 // Encode an entire program (RawInstruction vector) into machine-code lines
 std::vector<Instruction> decode_program(const std::vector<RawInstruction>& prog_raw);
+
+// Inverse of convert_line: the move as assembly text, e.g. "R3 R1 ? ZF == 1".
+// Operands no assembly can express print as '?'.
+std::string disassemble(const Instruction& move);
+
+// Widest bundle in the program: the longest run of moves marked parallel, plus one
+int bundle_width(const std::vector<RawInstruction>& prog_raw);
+
+// Encode a program as bundles of exactly `width` slots, one bundle per source
+// line, padding short bundles with NOPs. PC values then count bundles.
+// Throws std::runtime_error if a bundle is too wide or two unconditional
+// moves in it write the same destination.
+std::vector<Instruction> pack_bundles(const std::vector<RawInstruction>& prog_raw, int width);
+
+struct AssemblyStats {
+    size_t moves = 0;   // moves in the source
+    size_t bundles = 0; // source lines that hold moves
+    int width = 1;      // slots per bundle in the image
+    size_t encoded = 0; // bundles lexed and encoded; the rest were reused
+};
+
+// Streaming assembler: maps `src_path`, splits it into chunks of whole lines
+// and lexes and encodes the chunks on `threads` workers (0 = one per hardware
+// thread), writing them to `out` in source order a few at a time, so memory
+// use does not grow with the source. Produces the same image as
+// parse_program_lines, pack_bundles and write_image. Throws
+// std::runtime_error prefixed with the 1-based line of the earliest error in
+// the source; `out` is then left incomplete.
+AssemblyStats assemble_file(const std::string& src_path, std::ostream& out, unsigned threads = 0);
+
+// Incremental assemble_file into the image at `out_path`. A line cache beside
+// it (`out_path` + ".cache") records every bundle line and its hash; when the
+// bundle width is unchanged only lines that differ (a hash match is confirmed
+// against the cached text) are lexed and patched into a copy of the existing
+// image, and unchanged trailing lines keep their encoded slots even if lines
+// were inserted or removed before them. The copy is renamed over `out_path`,
+// so the update is atomic and a machine mapping the old image keeps it.
+// Lexing and encoding scale with the edit; hashing the source, copying the
+// image and reading the cache still scale with the file. Falls back to a full
+// rebuild when there is no usable cache or most of the file changed. Throws
+// like assemble_file, leaving the image intact.
+AssemblyStats assemble_incremental(const std::string& src_path, const std::string& out_path, unsigned threads = 0);
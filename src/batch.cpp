@@ -0,0 +1,406 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "batch.hpp"
+#include "computer.hpp"
+#include "encoding.hpp"
+#include "lockstep.hpp"
+#include "optimizer.hpp"
+#include "parser.hpp"
+
+using namespace std;
+
+WorkStealingPool::WorkStealingPool(unsigned threads) {
+    if (threads == 0) threads = thread::hardware_concurrency();
+    workers = max(threads, 1u);
+    queues = make_unique<Queue[]>(workers);
+}
+
+bool WorkStealingPool::take(unsigned self, size_t& job) {
+    {
+        Queue& own = queues[self];
+        lock_guard<mutex> guard(own.lock);
+        if (!own.jobs.empty()) {
+            job = own.jobs.front();
+            own.jobs.pop_front();
+            return true;
+        }
+    }
+    // nothing is queued after run() starts, so all queues empty means done
+    for (unsigned k = 1; k < workers; ++k) {
+        Queue& victim = queues[(self + k) % workers];
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.jobs.empty()) {
+            job = victim.jobs.back();
+            victim.jobs.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::run(size_t count, const function<void(size_t)>& task) {
+    for (unsigned w = 0; w < workers; ++w) {
+        deque<size_t>& jobs = queues[w].jobs;
+        jobs.clear();
+        for (size_t i = count * w / workers; i < count * (w + 1) / workers; ++i) jobs.push_back(i);
+    }
+
+    mutex error_lock;
+    exception_ptr error;
+    auto worker = [&](unsigned self) {
+        size_t job;
+        while (take(self, job)) {
+            try {
+                task(job);
+            } catch (...) {
+                lock_guard<mutex> guard(error_lock);
+                if (!error) error = current_exception();
+            }
+        }
+    };
+
+    // the calling thread is worker 0
+    vector<thread> threads;
+    for (unsigned w = 1; w < workers; ++w) threads.emplace_back(worker, w);
+    worker(0);
+    for (auto& t : threads) t.join();
+    if (error) rethrow_exception(error);
+}
+
+vector<string> collect_images(const vector<string>& inputs) {
+    vector<string> files;
+    for (const auto& input : inputs) {
+        if (!input.empty() && input[0] == '@') {
+            // list file: one image path per line
+            ifstream list(input.substr(1));
+            if (!list) throw runtime_error("cannot open list file " + input.substr(1));
+            string line;
+            while (getline(list, line)) {
+                line = trim(line);
+                if (!line.empty() && line[0] != ';') files.push_back(line);
+            }
+        }
+        else if (filesystem::is_directory(input)) {
+            vector<string> found;
+            for (const auto& entry : filesystem::directory_iterator(input)) {
+                if (entry.is_regular_file() && entry.path().extension() == ".bin") found.push_back(entry.path().string());
+            }
+            sort(found.begin(), found.end());
+            files.insert(files.end(), found.begin(), found.end());
+        }
+        else {
+            files.push_back(input); // missing files are reported per job
+        }
+    }
+    return files;
+}
+
+vector<vector<int>> read_register_sets(const string& path) {
+    ifstream in(path);
+    if (!in) throw runtime_error("cannot open register sets " + path);
+    vector<vector<int>> sets;
+    string line;
+    while (getline(in, line)) {
+        line = trim(line);
+        if (line.empty() || line[0] == ';') continue;
+        vector<int> set;
+        istringstream values(line);
+        long long v;
+        while (values >> v) set.push_back(static_cast<int>(v));
+        if (!values.eof()) throw runtime_error("bad register set: " + line);
+        sets.push_back(move(set));
+    }
+    if (sets.empty()) throw runtime_error("no register sets in " + path);
+    return sets;
+}
+
+// Load `file` into `c` as the options say; false with result.status "error" if it does not load
+static bool load_job(Computer& c, const string& file, const BatchOptions& options, BatchResult& result) {
+    try {
+        ifstream in(file, ios::binary);
+        if (!in) throw runtime_error("cannot open image");
+        if (options.load == "copy" || options.optimize) {
+            vector<uint8_t> body;
+            ImageHeader header = read_image(in, body);
+            if (options.optimize) optimize_image(header, body, options.regs);
+            if (header.width > c.bus_num) c.set_buses(header.width);
+            c.load_image(header, body, 0);
+        } else {
+            // run the file in place; only the header is read up front
+            ImageHeader header = read_image_header(in);
+            if (header.width > c.bus_num) c.set_buses(header.width);
+            c.map_image(file, options.load == "cow" ? MEMORY_COPY_ON_WRITE : MEMORY_READ_ONLY);
+        }
+        c.cpu.trap_vector = options.trap_vector;
+    } catch (const exception& e) {
+        result.status = "error";
+        result.error = e.what();
+        return false;
+    }
+    return true;
+}
+
+static void seed_registers(Cpu& cpu, const vector<int>& regs) {
+    for (size_t r = 0; r < regs.size() && r < cpu.regs.size(); ++r) cpu.regs[r] = static_cast<unsigned int>(regs[r]);
+}
+
+BatchResult run_job(const string& file, const BatchOptions& options, const vector<int>* regs) {
+    BatchResult result;
+    result.file = file;
+
+    Computer c(0, options.regs, options.buses);
+    if (!load_job(c, file, options, result)) return result;
+    if (regs) seed_registers(c.cpu, *regs);
+
+    if (options.max_cycles > 0) {
+        // budgeted runs are interpreted or threaded; jit falls back to
+        // threaded unless -c 0 lifts the budget
+        RunStatus status = options.engine == "interp" ? c.step(options.max_cycles) : c.run_for(options.max_cycles);
+        result.status = run_status_name(status);
+        if (status == RUN_FAULT) result.error = c.fault;
+    } else {
+        void (Computer::*run_fn)(int) = &Computer::run_threaded;
+        if (options.engine == "interp") run_fn = &Computer::run_from_ram;
+        else if (options.engine == "jit") run_fn = &Computer::run_jit;
+        try {
+            (c.*run_fn)(c.entry_point);
+            result.status = c.cpu.halted ? "halted" : "exited";
+        } catch (const exception& e) {
+            result.status = "fault";
+            result.error = e.what();
+        }
+    }
+
+    c.cpu.settle_alu();
+    result.cycles = c.cpu.cycles;
+    result.pc = c.cpu.pc;
+    result.regs = c.cpu.regs;
+    for (int k = 0; k < 3; ++k) result.alu[k] = c.cpu.alu[k];
+    result.flags = c.cpu.flags;
+    return result;
+}
+
+// How a checked lane differs from its scalar run, or empty
+static string lane_difference(const BatchResult& lane, const BatchResult& scalar) {
+    if (lane.status != scalar.status) return "status " + lane.status + ", run_from_ram " + scalar.status;
+    if (lane.error != scalar.error) return "fault '" + lane.error + "', run_from_ram '" + scalar.error + "'";
+    if (lane.cycles != scalar.cycles) return "cycles " + to_string(lane.cycles) + ", run_from_ram " + to_string(scalar.cycles);
+    if (lane.pc != scalar.pc) return "pc " + to_string(lane.pc) + ", run_from_ram " + to_string(scalar.pc);
+    for (size_t r = 0; r < lane.regs.size(); ++r) {
+        if (lane.regs[r] != scalar.regs[r]) return "R" + to_string(r) + " " + to_string(static_cast<int>(lane.regs[r])) + ", run_from_ram " + to_string(static_cast<int>(scalar.regs[r]));
+    }
+    for (int k = 0; k < 3; ++k) {
+        if (lane.alu[k] != scalar.alu[k]) return "A" + to_string(k) + " " + to_string(lane.alu[k]) + ", run_from_ram " + to_string(scalar.alu[k]);
+    }
+    if (lane.flags != scalar.flags) return "flags " + to_string(lane.flags) + ", run_from_ram " + to_string(scalar.flags);
+    return {};
+}
+
+vector<BatchResult> run_lockstep_job(const string& file, const BatchOptions& options, const vector<vector<int>>& sets) {
+    vector<BatchResult> results(sets.size());
+    BatchResult loaded;
+    loaded.file = file;
+    Computer c(0, options.regs, options.buses);
+    if (!load_job(c, file, options, loaded)) {
+        for (size_t i = 0; i < sets.size(); ++i) {
+            results[i] = loaded;
+            results[i].set = static_cast<int>(i);
+        }
+        return results;
+    }
+
+    LockstepBatch lanes(static_cast<int>(sets.size()), options.regs);
+    for (size_t i = 0; i < sets.size(); ++i) {
+        for (size_t r = 0; r < sets[i].size() && r < static_cast<size_t>(options.regs); ++r) {
+            lanes.set_reg(static_cast<int>(i), static_cast<int>(r), sets[i][r]);
+        }
+    }
+    lanes.run(c, c.entry_point, options.max_cycles > 0 ? options.max_cycles : UINT64_MAX);
+
+    Cpu out(options.regs, 1);
+    for (size_t i = 0; i < sets.size(); ++i) {
+        const int lane = static_cast<int>(i);
+        BatchResult& result = results[i];
+        result.file = file;
+        result.set = lane;
+        switch (lanes.status(lane)) {
+        case LANE_HALTED: result.status = "halted"; break;
+        case LANE_EXITED: result.status = "exited"; break;
+        case LANE_FAULTED: result.status = "fault"; result.error = lanes.fault(lane); break;
+        default: result.status = "budget"; break;
+        }
+        lanes.export_lane(lane, out);
+        result.cycles = lanes.cycles(lane);
+        result.pc = out.pc;
+        result.regs = out.regs;
+        for (int k = 0; k < 3; ++k) result.alu[k] = out.alu[k];
+        result.flags = out.flags;
+
+        if (options.check) {
+            // the same inputs on the interpreter, budgeted the same way
+            BatchOptions scalar = options;
+            scalar.engine = "interp";
+            const string difference = lane_difference(result, run_job(file, scalar, &sets[i]));
+            if (!difference.empty()) {
+                result.status = "mismatch";
+                result.error = difference;
+            }
+        }
+    }
+    return results;
+}
+
+static string json_string(const string& s) {
+    string out = "\"";
+    for (char ch : s) {
+        switch (ch) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(ch) < 0x20) {
+                char esc[8];
+                snprintf(esc, sizeof esc, "\\u%04x", static_cast<unsigned>(static_cast<unsigned char>(ch)));
+                out += esc;
+            } else {
+                out += ch;
+            }
+        }
+    }
+    return out + "\"";
+}
+
+void write_results(ostream& out, const vector<BatchResult>& results) {
+    for (const auto& r : results) {
+        out << "{\"file\":" << json_string(r.file);
+        if (r.set >= 0) out << ",\"set\":" << r.set;
+        out << ",\"status\":\"" << r.status << "\"";
+        if (!r.error.empty()) out << ",\"error\":" << json_string(r.error);
+        if (r.status != "error") {
+            // registers hold the signed words the programs compute with
+            out << ",\"cycles\":" << r.cycles << ",\"pc\":" << r.pc << ",\"regs\":[";
+            for (size_t i = 0; i < r.regs.size(); ++i) out << (i ? "," : "") << static_cast<int>(r.regs[i]);
+            out << "],\"alu\":[" << r.alu[0] << "," << r.alu[1] << "," << r.alu[2] << "],\"flags\":" << r.flags;
+        }
+        out << "}\n";
+    }
+}
+
+static int batch_usage() {
+    cerr << "Usage: yatta batch [-o results.jsonl] [-j threads] [-e interp|threaded|jit|lockstep] [-r regs] [-b buses]"
+            " [-c max_cycles (default 1e8, 0 = none)] [-m copy|map|cow] [-t trap_pc] [-s register_sets] [-k] [-O] <image.bin|dir|@list>..." << endl;
+    return 2;
+}
+
+int batch_main(int argc, char** argv) {
+    BatchOptions options;
+    try {
+        for (int i = 0; i < argc; ++i) {
+            const string arg = argv[i];
+            if (arg == "-O") {
+                options.optimize = true;
+            }
+            else if (arg == "-k") {
+                options.check = true;
+            }
+            else if (arg.size() == 2 && arg[0] == '-') {
+                if (i + 1 >= argc) return batch_usage();
+                const string value = argv[++i];
+                switch (arg[1]) {
+                case 'o': options.output = value; break;
+                case 'j': options.threads = static_cast<unsigned>(stoul(value)); break;
+                case 'e': options.engine = value; break;
+                case 'r': options.regs = stoi(value); break;
+                case 'b': options.buses = stoi(value); break;
+                case 'c': options.max_cycles = stoull(value); break;
+                case 'm': options.load = value; break;
+                case 't': options.trap_vector = stoi(value); break;
+                case 's': options.sweep = value; break;
+                default: return batch_usage();
+                }
+            } else {
+                options.inputs.push_back(arg);
+            }
+        }
+    } catch (const exception&) {
+        return batch_usage();
+    }
+    if (options.inputs.empty() || options.regs < 0 || options.buses < 1 || options.trap_vector < -1) return batch_usage();
+    if (options.load != "copy" && options.load != "map" && options.load != "cow") return batch_usage();
+    const bool lockstep = options.engine == "lockstep";
+    if (!lockstep && options.engine != "interp" && options.engine != "threaded" && options.engine != "jit") {
+        cerr << "Unknown engine: " << options.engine << " (expected interp, threaded, jit or lockstep)" << endl;
+        return 2;
+    }
+    // lanes have no trap vector, and -k only means something for lanes
+    if (lockstep && (options.sweep.empty() || options.trap_vector >= 0)) {
+        cerr << "The lockstep engine needs -s and takes no -t" << endl;
+        return 2;
+    }
+    if (options.check && !lockstep) return batch_usage();
+
+    try {
+        const vector<string> files = collect_images(options.inputs);
+        vector<vector<int>> sets;
+        if (!options.sweep.empty()) sets = read_register_sets(options.sweep);
+        // a sweep runs every image once per set, results grouped by image
+        const size_t per_file = max<size_t>(sets.size(), 1);
+        vector<BatchResult> results(files.size() * per_file);
+        WorkStealingPool pool(options.threads);
+
+        const auto start = chrono::steady_clock::now();
+        if (lockstep) {
+            pool.run(files.size(), [&](size_t i) {
+                vector<BatchResult> lanes = run_lockstep_job(files[i], options, sets);
+                move(lanes.begin(), lanes.end(), results.begin() + static_cast<ptrdiff_t>(i * per_file));
+            });
+        } else if (!sets.empty()) {
+            pool.run(results.size(), [&](size_t i) {
+                results[i] = run_job(files[i / per_file], options, &sets[i % per_file]);
+                results[i].set = static_cast<int>(i % per_file);
+            });
+        } else {
+            pool.run(files.size(), [&](size_t i) { results[i] = run_job(files[i], options); });
+        }
+        const double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        if (options.output.empty()) {
+            write_results(cout, results);
+        } else {
+            ofstream out(options.output);
+            if (!out) throw runtime_error("cannot open output " + options.output);
+            write_results(out, results);
+        }
+
+        size_t counts[6] = { 0, 0, 0, 0, 0, 0 }; // halted, exited, fault, error, budget, mismatch
+        for (const auto& r : results) {
+            counts[r.status == "halted" ? 0 : r.status == "exited" ? 1 : r.status == "fault" ? 2 : r.status == "error" ? 3
+                : r.status == "mismatch" ? 5 : 4]++;
+        }
+        cerr << "batch: " << files.size() << " images";
+        if (!sets.empty()) cerr << " x " << sets.size() << " register sets";
+        cerr << " on " << pool.size() << " threads in " << ms << " ms ("
+             << counts[0] << " halted, " << counts[1] << " exited, " << counts[2] << " faulted, "
+             << counts[3] << " failed to load";
+        if (options.max_cycles > 0) cerr << ", " << counts[4] << " out of budget";
+        if (options.check) cerr << ", " << counts[5] << " differ from run_from_ram";
+        cerr << ")" << endl;
+        if (counts[5]) return 1;
+    } catch (const exception& e) {
+        cerr << "Batch error: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Fixed set of worker threads for independent jobs. Each worker starts with
+// a contiguous share of the job indices and works through it front to back;
+// once its own queue is empty it steals from the back of the others', so
+// uneven job lengths still keep every core busy.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned threads); // 0 = one per hardware thread
+    unsigned size() const { return workers; }
+
+    // Call task(i) for every i in [0, count) and return once all are done.
+    // The first exception a task throws is rethrown here after the join.
+    void run(size_t count, const std::function<void(size_t)>& task);
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<size_t> jobs;
+    };
+    bool take(unsigned self, size_t& job);
+
+    unsigned workers;
+    std::unique_ptr<Queue[]> queues;
+};
+
+struct BatchOptions {
+    std::vector<std::string> inputs; // images, directories of *.bin, or @listfile
+    std::string output;              // results file; empty writes to stdout
+    unsigned threads = 0;
+    std::string engine = "threaded"; // interp, threaded, jit or lockstep
+    int regs = 8;
+    int buses = 1;                   // raised to the image bundle width if needed
+    // Per-image budget, so an image that never halts (a trailing `0 PC`)
+    // still ends the batch; 0 runs to completion
+    uint64_t max_cycles = 100000000;
+    std::string load = "map";        // copy, map (read-only mmap) or cow
+    int trap_vector = -1;            // PC guest faults jump to; -1 ends the job
+    bool optimize = false;           // run optimize_image before loading
+    // File of register sets, one per line as R0 R1 ...; every image runs
+    // once per set. The lockstep engine runs the sets of an image as lanes
+    // of one LockstepBatch.
+    std::string sweep;
+    bool check = false;              // lockstep: rerun every lane on run_from_ram and compare
+};
+
+// Final state of one job. status is "halted" (HF set), "exited" (PC left
+// the image), "budget" (max_cycles ran out), "fault" (a trap the guest did
+// not take), "error" (the image did not load) or "mismatch" (a checked
+// lockstep lane ended unlike run_from_ram; error says how).
+struct BatchResult {
+    std::string file;
+    int set = -1; // register set of a sweep, -1 without one
+    std::string status;
+    std::string error;
+    uint64_t cycles = 0;
+    int pc = 0;
+    std::vector<unsigned int> regs;
+    int alu[3] = { 0, 0, 0 };
+    uint32_t flags = 0;
+};
+
+// Expand inputs into image paths, in order
+std::vector<std::string> collect_images(const std::vector<std::string>& inputs);
+// Register sets for BatchOptions::sweep
+std::vector<std::vector<int>> read_register_sets(const std::string& path);
+// Load one image into its own Computer, seed the registers from `regs` if
+// given and run it from its entry point
+BatchResult run_job(const std::string& file, const BatchOptions& options, const std::vector<int>* regs = nullptr);
+// Run one image once per register set as the lanes of a LockstepBatch
+std::vector<BatchResult> run_lockstep_job(const std::string& file, const BatchOptions& options, const std::vector<std::vector<int>>& sets);
+// One JSON object per line, in job order
+void write_results(std::ostream& out, const std::vector<BatchResult>& results);
+
+// `yatta batch ...` entry point; argv excludes the program name and "batch"
+int batch_main(int argc, char** argv);
@@ -2,113 +2,608 @@
 #include <stdexcept>
 #include <cstdint>
 #include <cstring>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <type_traits>
 
 #include "cpu.hpp"
 #include "assembler.hpp"
 #include "computer.hpp"
+#include "encoding.hpp"
+#include "verifier.hpp"
 
 using namespace std;
 
-Computer::Computer(int memory_size, int regs, int bus) : cpu(regs, bus) {
+const char* run_status_name(RunStatus status) {
+    switch (status) {
+    case RUN_HALTED: return "halted";
+    case RUN_BUDGET_EXHAUSTED: return "budget";
+    case RUN_PC_OUT_OF_RANGE: return "exited";
+    default: return "fault";
+    }
+}
+
+Computer::Computer(int memory_size, int regs, int bus) : cpu(regs, bus), panel(regs) {
     // initialize member counts
     reg_num = regs;
     bus_num = bus;
     // memory holds raw bytes now; memory_size is total bytes
-    memory.resize(static_cast<size_t>(memory_size), 0); 
+    memory.assign(static_cast<size_t>(memory_size)); 
+    // the LSU and DMA work on the same bytes as the program
+    cpu.ram = &memory;
+    cpu.on_write = [this](size_t offset, size_t bytes) { unit_wrote(offset, bytes); };
+}
+
+void Computer::resize_memory(size_t bytes) {
+    const size_t old = memory.size();
+    memory.resize(bytes);
+    threaded_current = false;
+    touch_pages(0, memory.size()); // the last page changes length
+    recheck();
+    // new bytes are zero, a no-op move, but may complete a bundle that was
+    // partial before
+    if (bytes > old) reverify(old, bytes - old);
+}
+
+void Computer::set_buses(int bus) {
+    if (bus < bundle_width) {
+        throw runtime_error("set_buses: loaded program issues " + to_string(bundle_width) + " moves per bundle");
+    }
+    bus_num = bus;
+    cpu.set_bus_count(bus);
+}
+
+void Computer::set_alus(int count) {
+    recheck();
+    cpu.set_alu_count(count);
+    alu_num = count;
+    // bound operands point into the old bank
+    threaded_current = false;
+    jit_current = false;
+    const size_t bundle_count = memory.size() / (static_cast<size_t>(bundle_width) * INSTR_SLOT_SIZE);
+    verified = verify_slots(memory.data(), 0, bundle_count, bundle_width, reg_num, alu_num).empty();
 }
 
 void Computer::put_program(const vector<RawInstruction> &prog_raw, int start_address) {
+    put_program(pack_bundles(prog_raw, bundle_width), start_address);
+}
+
+void Computer::put_program(const vector<Instruction> &prog, int start_address) {
     if (start_address < 0) {
         throw runtime_error("start_address must be >= 0");
     }
 
-    // decode_program now returns vector<Instruction>
-    vector<Instruction> prog = decode_program(prog_raw);
     size_t prog_count = prog.size();
     if (prog_count == 0) return;
+    const size_t width = static_cast<size_t>(bundle_width);
+    if (prog_count % width != 0) {
+        throw runtime_error("put_program: program is not a whole number of bundles");
+    }
 
-    const size_t instr_size = sizeof(Instruction);
-    size_t required_bytes = (static_cast<size_t>(start_address) + prog_count) * instr_size;
+    const size_t first_slot = static_cast<size_t>(start_address) * width;
+    size_t required_bytes = (first_slot + prog_count) * INSTR_SLOT_SIZE;
     if (required_bytes > memory.size()) {
         throw runtime_error("Not enough memory to load program at given start_address (bytes)");
     }
+    for (size_t i = 0; i < prog_count; i += width) {
+        string problem = check_bundle(prog.data() + i, bundle_width, reg_num, static_cast<size_t>(start_address) + i / width, alu_num);
+        if (!problem.empty()) throw runtime_error("put_program: " + problem);
+    }
 
-    // memcpy each Instruction into the raw byte memory at the correct byte offset
-    uint8_t* mem_ptr = memory.data();
+    // pack each Instruction into its slot in the raw byte memory
+    threaded_current = false;
+    touch_pages(first_slot * INSTR_SLOT_SIZE, prog_count * INSTR_SLOT_SIZE);
+    uint8_t* mem_ptr = memory.writable();
     for (size_t i = 0; i < prog_count; ++i) {
-        memcpy(mem_ptr + (static_cast<size_t>(start_address) + i) * instr_size,
-               &prog[i],
-               instr_size);
+        encode_instruction(prog[i], mem_ptr + (first_slot + i) * INSTR_SLOT_SIZE);
     }
 }
 
-void Computer::put_program(const vector<Instruction> &prog, int start_address) {
-    if (start_address < 0) {
-        throw runtime_error("start_address must be >= 0");
+void Computer::check_image(const ImageHeader& header, int start_address, const char* who) const {
+    if (start_address < 0) throw runtime_error(string(who) + ": start_address must be >= 0");
+    if (header.width > bus_num) {
+        throw runtime_error(string(who) + ": image issues " + to_string(header.width) + " moves per bundle but the machine has "
+            + to_string(bus_num) + " bus(es)");
     }
+}
 
-    size_t prog_count = prog.size();
-    if (prog_count == 0) return;
+void Computer::adopt_image(const ImageHeader& header, int start_address) {
+    bundle_width = header.width;
+    entry_point = start_address + static_cast<int>(header.entry);
+    threaded_current = false;
+    jit_current = false;
+    verified = true; // callers verify before adopting
+    recheck_begin = recheck_end = 0;
+    touch_pages(0, memory.size());
+    cpu.pc = entry_point;
+    cpu.increment_pc = true;
+    panel.publish(cpu, false);
+}
 
-    const size_t instr_size = sizeof(Instruction);
-    size_t required_bytes = (static_cast<size_t>(start_address) + prog_count) * instr_size;
-    if (required_bytes > memory.size()) {
-        throw runtime_error("Not enough memory to load program at given start_address (bytes)");
-    }
+void Computer::load_image(const ImageHeader& header, const vector<uint8_t>& body, int start_address) {
+    check_image(header, start_address, "load_image");
+    // positions in diagnostics count from the start of the image
+    string problem = verify_slots(body.data(), 0, body.size() / INSTR_SLOT_SIZE / header.width, header.width, reg_num, alu_num);
+    if (!problem.empty()) throw runtime_error("load_image: " + problem);
+    // memory becomes exactly the image, placed at start_address
+    size_t offset = static_cast<size_t>(start_address) * header.width * INSTR_SLOT_SIZE;
+    memory.assign(offset + body.size());
+    copy(body.begin(), body.end(), memory.writable() + offset);
+    adopt_image(header, start_address);
+}
 
-    uint8_t* mem_ptr = memory.data();
-    for (size_t i = 0; i < prog_count; ++i) {
-        memcpy(mem_ptr + (static_cast<size_t>(start_address) + i) * instr_size,
-               &prog[i],
-               instr_size);
+void Computer::map_image(const string& path, MemoryMapping mode) {
+    ifstream in(path, ios::binary);
+    if (!in) throw runtime_error("map_image: cannot open " + path);
+    ImageHeader header = read_image_header(in);
+    check_image(header, 0, "map_image");
+    // the slots follow the header directly, so the file is the memory
+    const size_t bytes = static_cast<size_t>(header.count) * INSTR_SLOT_SIZE;
+    {
+        // verified through a throwaway view so a rejected file leaves memory alone
+        Memory probe;
+        probe.map_file(path, IMAGE_HEADER_SIZE, bytes, MEMORY_READ_ONLY);
+        string problem = verify_slots(probe.data(), 0, header.count / header.width, header.width, reg_num, alu_num);
+        if (!problem.empty()) throw runtime_error("map_image: " + path + ": " + problem);
     }
+    memory.map_file(path, IMAGE_HEADER_SIZE, bytes, mode);
+    adopt_image(header, 0);
 }
 
 Instruction Computer::read_program(int start_address) {
-    const size_t instr_size = sizeof(Instruction);
     if (start_address < 0) throw runtime_error("read_program: start_address must be >= 0");
-    size_t byte_offset = static_cast<size_t>(start_address) * instr_size;
-    if (byte_offset + instr_size > memory.size()) {
+    size_t byte_offset = static_cast<size_t>(start_address) * INSTR_SLOT_SIZE;
+    if (byte_offset + INSTR_SLOT_SIZE > memory.size()) {
         throw runtime_error("read_program: start_address out of range (bytes)");
     }
-    Instruction inst;
-    memcpy(&inst, memory.data() + byte_offset, instr_size);
-    return inst;
+    return decode_instruction(memory.data() + byte_offset);
 }
 
 void Computer::run_from_ram(int start_address) {
-    const size_t instr_size = sizeof(Instruction);
     if (start_address < 0) throw runtime_error("run_from_ram: start_address must be >= 0");
-    // Check that start PC maps to valid instruction memory
-    size_t byte_offset_check = static_cast<size_t>(start_address) * instr_size;
-    if (byte_offset_check >= memory.size()) throw runtime_error("run_from_ram: start_address out of range");
+    // Only whole bundles are executable; a trailing partial one is ignored
+    const size_t bundle_count = memory.size() / INSTR_SLOT_SIZE / static_cast<size_t>(bundle_width);
+    if (static_cast<size_t>(start_address) >= bundle_count) throw runtime_error("run_from_ram: start_address out of range");
 
     cpu.pc = start_address;
     cpu.increment_pc = true;
+    run_published([this](uint64_t slice, bool) { interpret(slice); });
+}
+
+static uint64_t now_ns() {
+    return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void Computer::account(uint64_t from_cycle, uint64_t from_ns) {
+    telemetry.add_cycles(cpu.cycles >= from_cycle ? cpu.cycles - from_cycle : 0, now_ns() - from_ns);
+}
+
+void Computer::run_published(const function<void(uint64_t, bool)>& run_slice) {
+    // slices are long enough that publishing between them costs nothing
+    // measurable, and the engine loops themselves stay untouched
+    panel.publish(cpu, true);
+    telemetry.set_running(true);
+    cpu.trap = TRAP_NONE;
+    try {
+        bool first = true;
+        do {
+            const uint64_t from_cycle = cpu.cycles, from_ns = now_ns();
+            try {
+                run_slice(PANEL_SLICE, first);
+            } catch (...) {
+                account(from_cycle, from_ns);
+                throw;
+            }
+            account(from_cycle, from_ns);
+            first = false;
+            panel.publish(cpu, true);
+        } while (status() == RUN_BUDGET_EXHAUSTED && !stop_requested.load(memory_order_relaxed));
+    } catch (...) {
+        // the host failed, e.g. out of memory; guest faults arrive as traps
+        telemetry.add_fault();
+        telemetry.set_status(RUN_FAULT);
+        telemetry.set_running(false);
+        panel.publish(cpu, false);
+        throw;
+    }
+    const RunStatus result = status();
+    if (result == RUN_FAULT) {
+        fault = cpu.trap_message();
+        telemetry.add_fault();
+    }
+    telemetry.set_status(result);
+    telemetry.set_running(false);
+    panel.publish(cpu, false);
+    // run_* have no status to return, so a fault the guest did not take
+    // becomes an exception here
+    if (result == RUN_FAULT) throw runtime_error(fault);
+}
+
+void Computer::interpret(uint64_t budget) {
+    // counted in locals and handed over once per call, so the loop does no
+    // atomic work of its own
+    MoveTally tally;
+    recheck(); // what unit stores wrote since the last call
+    try {
+        // decided once per call, so an uninstrumented run pays nothing for it
+        if (profile && tracer) interpret_loop<true, true, 0, 0>(budget, tally);
+        else if (profile) interpret_loop<true, false, 0, 0>(budget, tally);
+        else if (tracer) interpret_loop<false, true, 0, 0>(budget, tally);
+        else (this->*fixed_loop(reg_num, bundle_width))(budget, tally);
+    } catch (...) {
+        telemetry.add(tally);
+        throw;
+    }
+    telemetry.add(tally);
+}
 
-    while (cpu.pc >= 0 && static_cast<size_t>(cpu.pc) * instr_size < memory.size()) {
+Computer::InterpretLoop Computer::fixed_loop(int regs, int width) {
+    struct Shape {
+        int regs, width;
+        InterpretLoop loop;
+    };
+#define YATTA_SHAPE_LOOP(R, W) { R, W, &Computer::interpret_loop<false, false, R, W> },
+    static constexpr Shape shapes[] = { YATTA_FIXED_SHAPES(YATTA_SHAPE_LOOP) };
+#undef YATTA_SHAPE_LOOP
+    for (const Shape& shape : shapes) {
+        if (shape.regs == regs && shape.width == width) return shape.loop;
+    }
+    return &Computer::interpret_loop<false, false, 0, 0>;
+}
+
+template <bool Profiled, bool Traced, int Regs, int Width>
+void Computer::interpret_loop(uint64_t budget, MoveTally& tally) {
+    const size_t bundle_count = memory.size() / INSTR_SLOT_SIZE / static_cast<size_t>(bundle_width);
+    if constexpr (Profiled) profile->cover(bundle_count);
+
+    if (Width > 1 || (Width == 0 && bundle_width > 1)) {
+        // one bundle per cycle, decoded into a fixed array when the width is
+        // known here
+        const size_t bundle_bytes = static_cast<size_t>(bundle_width) * INSTR_SLOT_SIZE;
+        conditional_t<(Width > 0), array<Instruction, static_cast<size_t>(Width)>, vector<Instruction>> bundle {};
+        if constexpr (Width == 0) bundle.resize(static_cast<size_t>(bundle_width));
+        for (; budget > 0 && cpu.pc >= 0 && static_cast<size_t>(cpu.pc) < bundle_count; --budget) {
+            if (cpu.halted) break;
+            const int at = cpu.pc;
+            const uint8_t* slot = memory.data() + static_cast<size_t>(at) * bundle_bytes;
+            for (size_t i = 0; i < bundle.size(); ++i) bundle[i] = decode_instruction(slot + i * INSTR_SLOT_SIZE);
+            if constexpr (Profiled) ++profile->pcs[static_cast<size_t>(at)].executed;
+            if constexpr (Width > 0) {
+                if (trusted()) cpu.step_fixed<true, Regs, Width>(bundle.data());
+                else cpu.step_fixed<false, Regs, Width>(bundle.data());
+            } else {
+                if (trusted()) cpu.step_bundle_verified(bundle.data(), bundle_width);
+                else cpu.step_bundle(bundle.data(), bundle_width);
+            }
+            // a fault the guest takes costs the cycle, one it does not ends the run
+            if (cpu.trap && !cpu.take_trap()) break;
+            for (size_t i = 0; i < bundle.size(); ++i) tally.count(bundle[i], cpu.bus_active[i], static_cast<int>(cpu.bus[i]));
+            if constexpr (Traced) {
+                for (size_t i = 0; i < bundle.size(); ++i) {
+                    tracer->record(cpu.cycles, at, static_cast<int>(i), bundle[i], cpu.bus_active[i], static_cast<int>(cpu.bus[i]));
+                }
+            }
+            ++cpu.cycles;
+            if constexpr (Profiled) {
+                // bus_active tells which moves of the bundle were taken
+                PcCounters& counters = profile->pcs[static_cast<size_t>(at)];
+                for (size_t i = 0; i < bundle.size(); ++i) {
+                    if (bundle[i].cmp != CMP_NONE) ++(cpu.bus_active[i] ? counters.passed : counters.failed);
+                    if (cpu.bus_active[i] && bundle[i].dest_type == 4) ++profile->edges[Profile::edge_key(at, cpu.pc)];
+                }
+            }
+        }
+        return;
+    }
+
+    // verified code only leaves the PC range check per cycle; a store by
+    // the LSU or DMA clears `verified` and may detach a mapping, so trusted()
+    // is looked at every cycle
+    for (; budget > 0 && cpu.pc >= 0 && static_cast<size_t>(cpu.pc) < bundle_count; --budget) {
         if (cpu.halted) break;
-        // read instruction bytes into local Instruction
-        Instruction inst;
-        memcpy(&inst, memory.data() + static_cast<size_t>(cpu.pc) * instr_size, instr_size);
-
-        // If the instruction has a condition, check it using cpu.check_condition
-        bool execute = true;
-        if (inst.comp[0] != '\0') {
-            if (!cpu.check_condition(inst)) {
-                execute = false;
+        const int at = cpu.pc;
+        // fetch straight from the packed slot
+        Instruction inst = decode_instruction(memory.data() + static_cast<size_t>(at) * INSTR_SLOT_SIZE);
+
+        // condition check, move and PC increment mirror Cpu::exec_prog behavior
+        if constexpr (Profiled || Traced) {
+            if constexpr (Profiled) ++profile->pcs[static_cast<size_t>(at)].executed; // before, so a faulting move counts
+            const bool taken = trusted() ? cpu.step_verified(inst) : cpu.step(inst);
+            if (cpu.trap && !cpu.take_trap()) break;
+            if constexpr (Profiled) {
+                PcCounters& counters = profile->pcs[static_cast<size_t>(at)];
+                if (inst.cmp != CMP_NONE) ++(taken ? counters.passed : counters.failed);
+                if (taken && inst.dest_type == 4) ++profile->edges[Profile::edge_key(at, cpu.pc)];
             }
+            if constexpr (Traced) tracer->record(cpu.cycles, at, 0, inst, taken, cpu.moved);
+            tally.count(inst, taken, cpu.moved);
+        } else if constexpr (Width == 1) {
+            const bool taken = trusted() ? cpu.step_fixed<true, Regs, 1>(&inst) : cpu.step_fixed<false, Regs, 1>(&inst);
+            if (cpu.trap && !cpu.take_trap()) break;
+            tally.count(inst, taken, cpu.moved);
+        } else {
+            const bool taken = trusted() ? cpu.step_verified(inst) : cpu.step(inst);
+            if (cpu.trap && !cpu.take_trap()) break;
+            tally.count(inst, taken, cpu.moved);
         }
+        ++cpu.cycles;
+    }
+}
 
-        if (execute) {
-            cpu.exec_line(inst);
+void Computer::run_threaded(int start_address) {
+    if (start_address < 0) throw runtime_error("run_threaded: start_address must be >= 0");
+    const size_t bundle_count = memory.size() / INSTR_SLOT_SIZE / static_cast<size_t>(bundle_width);
+    if (static_cast<size_t>(start_address) >= bundle_count) throw runtime_error("run_threaded: start_address out of range");
+
+    threaded.translate(cpu, memory.data(), memory.size(), bundle_width);
+    threaded_current = true;
+
+    cpu.pc = start_address;
+    cpu.increment_pc = true;
+    run_published([this](uint64_t slice, bool) {
+        // a store into translated code sends the engine back here
+        if (!threaded_current) {
+            threaded.translate(cpu, memory.data(), memory.size(), bundle_width);
+            threaded_current = true;
         }
+        cpu.resync = false;
+        MoveTally tally;
+        threaded.run(cpu, slice, tally);
+        telemetry.add(tally);
+    });
+}
+
+void Computer::run_jit(int start_address) {
+    if (bundle_width > 1) {
+        run_threaded(start_address);
+        return;
+    }
+    if (start_address < 0) throw runtime_error("run_jit: start_address must be >= 0");
+    const size_t slot_count = memory.size() / INSTR_SLOT_SIZE;
+    if (static_cast<size_t>(start_address) >= slot_count) throw runtime_error("run_jit: start_address out of range");
+
+    cpu.pc = start_address;
+    cpu.increment_pc = true;
+    jit_current = false;
+    run_published([this](uint64_t slice, bool first) {
+        // compiled code survives between slices unless a store reached it
+        const bool resume = !first && jit_current;
+        jit_current = true;
+        jit_image = memory.data();
+        cpu.resync = false;
+        MoveTally tally;
+        jit.run(cpu, jit_image, memory.size(), slice, resume, tally);
+        telemetry.add(tally);
+    });
+    jit_current = false;
+}
+
+RunStatus Computer::status() const {
+    if (cpu.trap) return RUN_FAULT;
+    if (cpu.halted) return RUN_HALTED;
+    const size_t bundle_count = memory.size() / INSTR_SLOT_SIZE / static_cast<size_t>(bundle_width);
+    if (cpu.pc < 0 || static_cast<size_t>(cpu.pc) >= bundle_count) return RUN_PC_OUT_OF_RANGE;
+    return RUN_BUDGET_EXHAUSTED;
+}
+
+RunStatus Computer::run_for(uint64_t max_cycles) {
+    const uint64_t from_cycle = cpu.cycles, from_ns = now_ns();
+    cpu.trap = TRAP_NONE;
+    const uint64_t stop = max_cycles > UINT64_MAX - from_cycle ? UINT64_MAX : from_cycle + max_cycles;
+    try {
+        do {
+            // translated once and kept, so resuming costs nothing until a
+            // store reaches translated code
+            if (!threaded_current) {
+                threaded.translate(cpu, memory.data(), memory.size(), bundle_width);
+                threaded_current = true;
+            }
+            cpu.resync = false;
+            MoveTally tally;
+            threaded.run(cpu, stop - cpu.cycles, tally);
+            telemetry.add(tally);
+        } while (cpu.resync && cpu.cycles < stop && status() == RUN_BUDGET_EXHAUSTED);
+    } catch (const exception& e) {
+        return finish_fault(e, from_cycle, from_ns);
+    }
+    return finish(from_cycle, from_ns);
+}
+
+RunStatus Computer::step(uint64_t n) {
+    const uint64_t from_cycle = cpu.cycles, from_ns = now_ns();
+    cpu.trap = TRAP_NONE;
+    try {
+        interpret(n);
+    } catch (const exception& e) {
+        return finish_fault(e, from_cycle, from_ns);
+    }
+    return finish(from_cycle, from_ns);
+}
+
+RunStatus Computer::finish(uint64_t from_cycle, uint64_t from_ns) {
+    account(from_cycle, from_ns);
+    const RunStatus result = status();
+    if (result == RUN_FAULT) {
+        fault = cpu.trap_message();
+        telemetry.add_fault();
+    }
+    telemetry.set_status(result);
+    panel.publish(cpu, false);
+    return result;
+}
+
+RunStatus Computer::finish_fault(const exception& e, uint64_t from_cycle, uint64_t from_ns) {
+    fault = e.what();
+    account(from_cycle, from_ns);
+    telemetry.add_fault();
+    telemetry.set_status(RUN_FAULT);
+    panel.publish(cpu, false);
+    return RUN_FAULT;
+}
 
-        // PC increment logic mirrors Cpu::exec_prog behavior
-        if (cpu.increment_pc) {
-            cpu.pc++;
+void Computer::mark_dirty(size_t offset, size_t bytes) {
+    touch_pages(offset, bytes);
+    recheck();
+    reverify(offset, bytes);
+    refresh_engines(offset, bytes);
+}
+
+void Computer::unit_wrote(size_t offset, size_t bytes) {
+    touch_pages(offset, bytes);
+    // a DMA may write megabytes, so the check waits for the next interpret();
+    // until then the interpreter runs checked
+    if (verified || recheck_end > recheck_begin) {
+        verified = false;
+        recheck_begin = recheck_end > recheck_begin ? min(recheck_begin, offset) : offset;
+        recheck_end = max(recheck_end, offset + bytes);
+    }
+    refresh_engines(offset, bytes);
+}
+
+void Computer::recheck() {
+    if (recheck_end <= recheck_begin) return;
+    verified = true;
+    reverify(recheck_begin, recheck_end - recheck_begin);
+    recheck_begin = recheck_end = 0;
+}
+
+void Computer::refresh_engines(size_t offset, size_t bytes) {
+    if (bytes == 0) return;
+    // bring translations of the changed moves up to date, or have the
+    // engine using them stop so they can be rebuilt
+    const size_t bundle_bytes = static_cast<size_t>(bundle_width) * INSTR_SLOT_SIZE;
+    if (threaded_current && !threaded.refresh(cpu, memory.data(), offset / bundle_bytes, (offset + bytes - 1) / bundle_bytes + 1)) {
+        threaded_current = false;
+        cpu.resync = true;
+    }
+    // the JIT also holds on to where memory is, which the first write to a
+    // read-only mapping changes
+    if (jit_current && (memory.data() != jit_image
+                        || jit.covers(offset / INSTR_SLOT_SIZE, (offset + bytes - 1) / INSTR_SLOT_SIZE + 1))) {
+        jit_current = false;
+        cpu.resync = true;
+    }
+}
+
+void Computer::reverify(size_t offset, size_t bytes) {
+    if (!verified || bytes == 0) return;
+    const size_t bundle_bytes = static_cast<size_t>(bundle_width) * INSTR_SLOT_SIZE;
+    const size_t bundle_count = memory.size() / bundle_bytes;
+    const size_t first = offset / bundle_bytes;
+    const size_t last = min((offset + bytes - 1) / bundle_bytes + 1, bundle_count);
+    if (first < last) verified = verify_slots(memory.data(), first, last - first, bundle_width, reg_num, alu_num).empty();
+}
+
+void Computer::touch_pages(size_t offset, size_t bytes) {
+    const size_t page_count = (memory.size() + PAGE_SIZE - 1) / PAGE_SIZE;
+    if (dirty.size() != page_count) dirty.resize(page_count, 1);
+    if (bytes == 0 || page_count == 0) return;
+    const size_t last = min((offset + bytes - 1) / PAGE_SIZE, page_count - 1);
+    for (size_t i = offset / PAGE_SIZE; i <= last; ++i) {
+        if (!dirty[i]) written.push_back(i);
+        dirty[i] = 1;
+    }
+}
+
+void Computer::sync_pages() {
+    const size_t page_count = (memory.size() + PAGE_SIZE - 1) / PAGE_SIZE;
+    if (dirty.size() != page_count) dirty.resize(page_count, 1);
+    const bool same_layout = pages && pages->size() == page_count
+        && (page_count == 0 || pages->back()->size() == memory.size() - (page_count - 1) * PAGE_SIZE);
+    if (same_layout) {
+        // the common case: copy the table and only the pages in `written`.
+        // Still O(pages) for the table; the bytes copied are the written pages
+        if (written.empty()) return; // nothing written since the last snapshot
+        auto table = make_shared<PageTable>(*pages);
+        for (size_t i : written) {
+            if (i >= page_count || !dirty[i]) continue; // left over from a resize
+            const uint8_t* begin = memory.begin() + i * PAGE_SIZE;
+            const uint8_t* end = memory.begin() + min(memory.size(), (i + 1) * PAGE_SIZE);
+            (*table)[i] = make_shared<const Page>(begin, end);
+            dirty[i] = 0;
+        }
+        pages = move(table);
+        written.clear();
+        return;
+    }
+
+    // a new layout: clean pages are shared, the rest copied
+    auto table = make_shared<PageTable>(page_count);
+    for (size_t i = 0; i < page_count; ++i) {
+        if (pages && i < pages->size() && !dirty[i] && (*pages)[i]->size() == min(PAGE_SIZE, memory.size() - i * PAGE_SIZE)) {
+            (*table)[i] = (*pages)[i];
         } else {
-            cpu.increment_pc = true; // reset flag after a successful jump
+            const uint8_t* begin = memory.begin() + i * PAGE_SIZE;
+            const uint8_t* end = memory.begin() + min(memory.size(), (i + 1) * PAGE_SIZE);
+            (*table)[i] = make_shared<const Page>(begin, end);
         }
     }
+    pages = move(table);
+    fill(dirty.begin(), dirty.end(), 0);
+    written.clear();
+}
+
+Snapshot Computer::snapshot() {
+    sync_pages();
+    Snapshot snap;
+    snap.cpu = save_cpu(cpu);
+    snap.entry_point = entry_point;
+    snap.bundle_width = bundle_width;
+    snap.memory_size = memory.size();
+    snap.pages = pages;
+    return snap;
+}
+
+void Computer::restore(const Snapshot& snap) {
+    if (!snap.pages) throw runtime_error("restore: empty snapshot");
+    recheck();
+    if (snap.cpu.regs.size() != static_cast<size_t>(reg_num)) {
+        throw runtime_error("restore: snapshot has " + to_string(snap.cpu.regs.size()) + " registers, machine has " + to_string(reg_num));
+    }
+
+    const size_t page_count = snap.pages->size();
+    const bool same_layout = memory.size() == snap.memory_size && pages && pages->size() == page_count
+        && dirty.size() == page_count;
+    if (!same_layout) {
+        memory.resize(snap.memory_size);
+        dirty.assign(page_count, 1);
+    }
+    uint8_t* bytes = nullptr; // only asked for once a page must be written
+    // a page needs copying if it was written since our last snapshot or our
+    // last snapshot is not the one being restored (or shares no page with it)
+    vector<size_t> copied;
+    for (size_t i = 0; i < page_count; ++i) {
+        const auto& page = (*snap.pages)[i];
+        if (dirty[i] || !pages || (*pages)[i] != page) {
+            if (!bytes) bytes = memory.writable();
+            copy(page->begin(), page->end(), bytes + i * PAGE_SIZE);
+            copied.push_back(i);
+        }
+    }
+    pages = snap.pages;
+    fill(dirty.begin(), dirty.end(), 0);
+    written.clear();
+    if (!copied.empty()) threaded_current = false;
+
+    // snapshots may come from a file, so restored code is checked like a
+    // direct write; a new layout is checked whole
+    const int alus = 1 + static_cast<int>(snap.cpu.alus.size());
+    const bool same_code = same_layout && bundle_width == snap.bundle_width && alu_num == alus;
+    if (alu_num != alus) threaded_current = false; // bound operands point into the old bank
+    entry_point = snap.entry_point;
+    bundle_width = snap.bundle_width;
+    alu_num = alus;
+    if (!same_code || (!verified && !copied.empty())) {
+        const size_t bundle_count = memory.size() / (static_cast<size_t>(bundle_width) * INSTR_SLOT_SIZE);
+        verified = verify_slots(memory.data(), 0, bundle_count, bundle_width, reg_num, alu_num).empty();
+    } else {
+        for (size_t i : copied) reverify(i * PAGE_SIZE, PAGE_SIZE);
+    }
+    bus_num = static_cast<int>(snap.cpu.bus.size());
+    load_cpu(cpu, snap.cpu);
+    panel.publish(cpu, false);
 }
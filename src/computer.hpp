@@ -1,19 +1,158 @@
 #pragma once
 
 #include "cpu.hpp"
+#include "threaded.hpp"
+#include "jit.hpp"
+#include "encoding.hpp"
+#include "snapshot.hpp"
+#include "memory.hpp"
+#include "panel.hpp"
+#include "profiler.hpp"
+#include "telemetry.hpp"
+#include "trace.hpp"
+#include <atomic>
+#include <exception>
 #include <vector>
 #include <cstdint>
 #include <cstring>
+#include <functional>
+#include <string>
+
+// Why a budgeted run returned
+enum RunStatus : uint8_t {
+    RUN_HALTED = 0,        // HF was written
+    RUN_BUDGET_EXHAUSTED,  // cycles ran out; call again to resume
+    RUN_PC_OUT_OF_RANGE,   // PC left the loaded image
+    RUN_FAULT              // a move raised a trap the guest did not take; see Computer::fault
+};
+const char* run_status_name(RunStatus status);
 
 class Computer {
 public:
     int reg_num, bus_num;
+    int alu_num = 1; // ALU instances, ALU0 to ALU<alu_num - 1>
+    int entry_point = 0; // from the last loaded image header
+    int bundle_width = 1; // slots issued per cycle; PC counts bundles
     Computer(int memory_size, int reg, int bus);
-    std::vector<uint8_t> memory; // now a raw byte buffer
+    // Resize the bus file; must stay at least as wide as the loaded bundles
+    void set_buses(int bus);
+    // Resize the ALU bank; code already in memory is verified again against
+    // the new count, so moves naming a removed ALU only clear `verified`
+    void set_alus(int count);
+    Memory memory; // packed instruction slots, on the heap or mapped from a file
     Cpu cpu;
+    // Every whole bundle in memory passed the load-time verifier (see
+    // verifier.hpp), so the interpreter runs it without operand checks.
+    // Loading rejects code that fails; a direct write (see mark_dirty) or a
+    // restore that brings some in only clears this.
+    bool verified = true;
+    // Whether the interpreter may skip operand checks. A mapped file can be
+    // rewritten under the mapping after it was verified, so it never is.
+    bool trusted() const { return verified && !memory.mapped(); }
+    // Addresses count bundles of bundle_width slots. The program is verified
+    // before anything is written; throws std::runtime_error naming the first
+    // bad move.
     void put_program(const std::vector<RawInstruction>& prog_raw, int start_address);
-    // Overload: accept already-decoded machine instructions
+    // Overload: accept already-decoded machine instructions, as whole bundles
     void put_program(const std::vector<Instruction>& prog, int start_address);
-    Instruction read_program(int start_address);
+    // Replace memory with an image body (see encoding.hpp) placed at
+    // start_address and adopt its bundle width. Verified like put_program.
+    void load_image(const ImageHeader& header, const std::vector<uint8_t>& body, int start_address);
+    // Run an image file in place: memory maps its slots instead of copying
+    // them (read-only mappings copy on the first write to memory). Verified
+    // like put_program; a rejected file leaves memory as it was. The
+    // interpreter still checks every move while the file stays mapped.
+    void map_image(const std::string& path, MemoryMapping mode);
+    Instruction read_program(int start_address); // by slot, not bundle
     void run_from_ram(int start_address);
+    // Same semantics as run_from_ram, but translates memory once into
+    // pre-resolved handlers and dispatches through them
+    void run_threaded(int start_address);
+    // Same semantics again, compiling hot straight-line runs to native code
+    // where a JIT backend exists (x86-64 Linux) and interpreting the rest.
+    // Bundled images are not compiled and run threaded instead.
+    void run_jit(int start_address);
+    // Ask a run_* call on another thread to return at its next PANEL_SLICE
+    // boundary, leaving the machine resumable. The request stays until
+    // request_stop(false), which the caller does before starting a run, so
+    // a stop that lands before the run thread gets going is not lost
+    void request_stop(bool stop = true) { stop_requested.store(stop, std::memory_order_relaxed); }
+
+    // Budgeted, resumable execution from the current cpu.pc (load_image sets
+    // it to the entry point). run_for goes through the threaded engine,
+    // step through the interpreter; both stop after at most the given number
+    // of cycles and never throw for a fault in the guest. A fault the guest
+    // takes through cpu.trap_vector is not one; the run goes on at the vector.
+    RunStatus run_for(uint64_t max_cycles);
+    RunStatus step(uint64_t n = 1);
+    RunStatus status() const;
+    std::string fault; // message of the last RUN_FAULT
+
+    // While set, the interpreter (run_from_ram and step) counts every cycle
+    // into it; the threaded and JIT engines do not. Not owned.
+    Profile* profile = nullptr;
+    // Likewise records every move the interpreter issues. Not owned.
+    Tracer* tracer = nullptr;
+
+    // State for viewers on other threads, such as the front panel. The
+    // run_* engines publish it every PANEL_SLICE cycles and when they stop;
+    // step, run_for, loading and restore publish when they return. Only one
+    // thread may run the machine at a time.
+    PanelFeed panel;
+    // Counters for dashboards, readable from any thread (see telemetry.hpp);
+    // every run, step and run_for adds to them
+    Telemetry telemetry;
+
+    // Capture the whole machine. This is an incremental copy, not O(1): the
+    // page table is copied (one pointer per page) and every page written
+    // since the last snapshot is copied in full. Loading an image writes all
+    // of memory, so the first snapshot after a load copies all of it.
+    Snapshot snapshot();
+    // Return to a snapshot of this machine (or one with the same register
+    // count), copying back only the pages that differ from it
+    void restore(const Snapshot& snap);
+    // Code that writes `memory` directly must report the bytes it changed;
+    // the bundles they fall in are verified again and translated again by
+    // the engine running them
+    void mark_dirty(size_t offset, size_t bytes);
+    // Grow or shrink memory, e.g. to give the LSU and DMA room for data
+    // after the program; new bytes are zero
+    void resize_memory(size_t bytes);
+private:
+    void touch_pages(size_t offset, size_t bytes);
+    // Re-check the bundles overlapping a byte range and clear `verified` if one fails
+    void reverify(size_t offset, size_t bytes);
+    // Stores by the LSU and DMA: like mark_dirty, but verification waits
+    // for recheck()
+    void unit_wrote(size_t offset, size_t bytes);
+    void recheck();
+    void refresh_engines(size_t offset, size_t bytes);
+    size_t recheck_begin = 0, recheck_end = 0; // bytes unit stores left unverified
+    void check_image(const ImageHeader& header, int start_address, const char* who) const;
+    void adopt_image(const ImageHeader& header, int start_address);
+    void sync_pages();
+    std::shared_ptr<const PageTable> pages; // memory as of the last snapshot
+    std::vector<uint8_t> dirty;             // per page: changed since then
+    std::vector<size_t> written;            // the pages set in `dirty` by touch_pages
+    void interpret(uint64_t budget);
+    // Add the cycles and time since a run began to `telemetry`
+    void account(uint64_t from_cycle, uint64_t from_ns);
+    // Epilogues of run_for and step; finish_fault is for host exceptions
+    RunStatus finish(uint64_t from_cycle, uint64_t from_ns);
+    RunStatus finish_fault(const std::exception& e, uint64_t from_cycle, uint64_t from_ns);
+    // Call run_slice(PANEL_SLICE, first) until the machine halts or leaves
+    // the image (or request_stop is called), publishing to `panel` in between
+    void run_published(const std::function<void(uint64_t, bool)>& run_slice);
+    std::atomic<bool> stop_requested{false};
+    // Regs/Width > 0 fix the register count and bundle width at compile time
+    // (see Cpu::step_fixed); 0 reads them from the machine
+    template <bool Profiled, bool Traced, int Regs, int Width> void interpret_loop(uint64_t budget, MoveTally& tally);
+    using InterpretLoop = void (Computer::*)(uint64_t budget, MoveTally& tally);
+    // The uninstrumented loop compiled for this shape, or the runtime-sized one
+    static InterpretLoop fixed_loop(int regs, int width);
+    ThreadedProgram threaded;
+    bool threaded_current = false; // translation matches memory
+    JitEngine jit;
+    bool jit_current = false;          // a run_jit is under way and its code matches memory
+    const uint8_t* jit_image = nullptr; // memory.data() that run was given
 };
\ No newline at end of file
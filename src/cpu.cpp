@@ -10,150 +10,219 @@ using namespace std;
 
 // Definitions moved from header
 string ops_ordered[6] = {"==", "!=", "<=", ">=", "<", ">"};
-map<string, string> ops_map = {
-    {"==", "eq"},
-    {"!=", "ne"},
-    {"<", "lt"},
-    {"<=", "le"},
-    {">", "gt"},
-    {">=", "ge"}
+map<string, Comparator> ops_map = {
+    {"==", CMP_EQ},
+    {"!=", CMP_NE},
+    {"<", CMP_LT},
+    {"<=", CMP_LE},
+    {">", CMP_GT},
+    {">=", CMP_GE}
 };
 
 // Cpu method definitions
 
-bool Cpu::check_add_overflow(int a, int b, int& result) {
-    if (b > 0 && a > numeric_limits<int>::max() - b) {
-        return true; // Overflow
+void Cpu::trigger_alu(int op) {
+    if (op == 0) return; // no operation requested
+
+    if (op < 1 || op > 4) {
+        // unknown ops only refresh the flags from the current result, which
+        // may itself still be pending
+        settle_alu();
     }
-    if (b < 0 && a < numeric_limits<int>::min() - b) {
-        return true; // Underflow
+    else if (op == 4 && alu[2] == 0) {
+        // faults are raised at the trigger, not deferred to the first read
+        settle_alu();
+        flags = 0;
+        raise(TRAP_DIVIDE, "Division by zero in ALU", 0);
+        return;
     }
-    result = a + b;
-    return false; // No overflow
+    alu_pending = op;
+    alu_lhs = alu[1];
+    alu_rhs = alu[2];
 }
 
-bool Cpu::check_mul_overflow(int a, int b, int& result) {
-    if (a == 0 || b == 0) {
-        result = 0;
-        return false;
+void Cpu::eval_alu() {
+    const AluResult r = alu_compute(alu_pending, alu_lhs, alu_rhs, alu[0]);
+    alu[0] = r.value;
+    flags = r.flags;
+    alu_pending = 0;
+}
+
+int Cpu::read_alu_port(int value, const char* what) {
+    const UnitPort* port = unit_port(UNIT_KINDS[0], value, alu_count());
+    if (!port || !(port->use & PORT_READ)) {
+        raise(TRAP_PORT, what, value);
+        return 0;
     }
-    if (a > 0 && b > 0 && a > numeric_limits<int>::max() / b) return true;
-    if (a < 0 && b < 0 && a < numeric_limits<int>::max() / b) return true;
-    if (a > 0 && b < 0 && b < numeric_limits<int>::min() / a) return true;
-    if (a < 0 && b > 0 && a < numeric_limits<int>::min() / b) return true;
-    
-    result = a * b;
-    return false; // No overflow
-}
-
-int Cpu::update_alu() {
-    if (alu_trigger) {
-        int result = 0;
-        // Clear flags before operation
-        *alu_of = 0; 
-        *alu_nf = 0; 
-        *alu_zf = 0; 
-
-        switch (alu_trigger) {
-        case 1: // ADD
-            if (check_add_overflow(alu[1], alu[2], result)) *alu_of = 1;
-            alu[0] = result;
-            break;
-        case 2: // SUB (A - B)
-            if (check_add_overflow(alu[1], -alu[2], result)) *alu_of = 1;
-            alu[0] = result;
-            break;
-        case 3: // MUL
-            if (check_mul_overflow(alu[1], alu[2], result)) *alu_of = 1;
-            alu[0] = result;
-            break;
-        case 4: // DIV
-            if (alu[2] != 0) {
-                alu[0] = alu[1] / alu[2];
-            }
-            else {
-                throw runtime_error("Division by zero in ALU");
-            }
-            break;
-        default:
-            break;
-        }
+    const int unit = value / ALU_STRIDE, p = value % ALU_STRIDE;
+    if (unit > 0) return alus[static_cast<size_t>(unit - 1)].read(p);
+    return p == 0 ? read_alu_result() : p <= 2 ? alu[p] : read_flag(p - 2);
+}
 
-        // Set flags based on the final signed result
-        if (alu[0] == 0) {
-            *alu_zf = 1;
-        }
-        if (alu[0] < 0) {
-            *alu_nf = 1;
-        }
+void Cpu::write_alu_port(int value, int v) {
+    const UnitPort* port = unit_port(UNIT_KINDS[0], value, alu_count());
+    if (!port || !(port->use & (PORT_WRITE | PORT_TRIGGER))) {
+        raise(TRAP_PORT, "Unwritable ALU dest port", value);
+        return;
+    }
+    const int unit = value / ALU_STRIDE, p = value % ALU_STRIDE;
+    if (unit == 0) {
+        if (port->use & PORT_TRIGGER) trigger_alu(v);
+        else alu[p] = v;
+        return;
+    }
+    AluUnit& target = alus[static_cast<size_t>(unit - 1)];
+    if (!(port->use & PORT_TRIGGER)) target.port[p] = v;
+    else if (!target.trigger(v)) raise(TRAP_DIVIDE, "Division by zero in ALU", 0);
+}
 
-        alu_trigger = 0; // Reset trigger after operation
+// Words of `ram` are little endian whatever the host
+static uint32_t get_word(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8)
+        | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static void put_word(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; ++i) p[i] = static_cast<uint8_t>(v >> (8 * i));
+}
+
+size_t Cpu::ram_words() const {
+    return ram ? ram->size() / 4 : 0;
+}
+
+// [first, first + count) must lie inside memory; raises TRAP_MEMORY if not
+bool Cpu::check_span(const char* what, int first, int count, size_t words) {
+    if (first < 0 || count < 0 || static_cast<size_t>(first) > words || static_cast<size_t>(count) > words - static_cast<size_t>(first)) {
+        raise(TRAP_MEMORY, what, count < 0 ? count : first);
+        return false;
     }
-    return 0;
+    return true;
+}
+
+void Cpu::wrote_ram(size_t first_word, size_t words) {
+    if (on_write && words) on_write(first_word * 4, words * 4);
 }
 
-int Cpu::get_flag_value(const char* flag_name) const {
-    if (flag_name == nullptr) throw runtime_error("Null flag name");
-    if (strcmp(flag_name, "ZF") == 0) return *alu_zf;
-    if (strcmp(flag_name, "NF") == 0) return *alu_nf;
-    if (strcmp(flag_name, "OF") == 0) return *alu_of;
-    // allow HF/AF if needed by caller (AF handled in source_type==3)
-    throw runtime_error(string("Unknown flag name in condition: ") + flag_name);
+void Cpu::lsu_load(int address) {
+    if (!check_span("LSU load address out of range", address, 1, ram_words())) return;
+    lsu[1] = address;
+    lsu[0] = static_cast<int>(get_word(ram->data() + static_cast<size_t>(address) * 4));
+}
+
+void Cpu::lsu_store(int address) {
+    if (!check_span("LSU store address out of range", address, 1, ram_words())) return;
+    lsu[3] = address;
+    put_word(ram->writable() + static_cast<size_t>(address) * 4, static_cast<uint32_t>(lsu[2]));
+    wrote_ram(static_cast<size_t>(address), 1);
+}
+
+void Cpu::dma_start(int op) {
+    if (op == 0) return; // no transfer requested, like AF
+    if (op != 1 && op != 2) {
+        raise(TRAP_DMA_OP, "Unknown DMA op", op);
+        return;
+    }
+    const size_t words = ram_words();
+    const int count = dma[3];
+    if (!check_span("DMA destination out of range", dma[2], count, words)) return;
+    if (op == 1 && !check_span("DMA source out of range", dma[1], count, words)) return;
+    dma[0] = 0;
+
+    // writable() may move the memory, so it is asked for before any read
+    uint8_t* base = ram->writable();
+    uint8_t* to = base + static_cast<size_t>(dma[2]) * 4;
+    const size_t bytes = static_cast<size_t>(count) * 4;
+    if (op == 1) {
+        memmove(to, base + static_cast<size_t>(dma[1]) * 4, bytes);
+    } else if (bytes) {
+        // lay down one word, then double the filled run
+        put_word(to, static_cast<uint32_t>(dma[1]));
+        for (size_t done = 4; done < bytes; done *= 2) memcpy(to + done, to, min(done, bytes - done));
+    }
+    dma[0] = 1;
+    wrote_ram(static_cast<size_t>(dma[2]), static_cast<size_t>(count));
 }
 
 bool Cpu::check_condition(const Instruction& instr) {
-    if (instr.comp[0] == '\0') {
+    const bool held = condition_holds<true, 0>(instr);
+    if (trap) throw_trap();
+    return held;
+}
+
+template <bool Checked, int Regs>
+bool Cpu::condition_holds(const Instruction& instr) {
+    if (instr.cmp == CMP_NONE) {
         return true; // No condition, always execute
     }
     // Compute operand values from declared types and numeric condition values stored in Instruction.
     auto compute_value = [&](int type, int value)->int {
-        if (type == -1) throw runtime_error("Missing condition operand type; machine-code must declare types");
+        if constexpr (Checked) {
+            if (type == -1) {
+                raise(TRAP_OPERAND, "Missing condition operand type", type);
+                return 0;
+            }
+        }
         switch(type) {
             case 0: // constant
                 return value;
             case 1: // register
-                if (value < 0 || value >= reg_amount) throw runtime_error("Condition register index out of range");
-                return regs[value];
-            case 2: // ALU port
-                if (value < 0 || value > 2) throw runtime_error("Condition ALU index out of range");
-                return alu[value];
+                if constexpr (Checked) {
+                    if (value < 0 || value >= reg_limit<Regs>()) {
+                        raise(TRAP_REGISTER, "Condition register index out of range", value);
+                        return 0;
+                    }
+                }
+                return static_cast<int>(regs[static_cast<size_t>(value)]);
+            case 2: // ALU port; past A2 belongs to the other ALUs
+                if (value >= 0 && value <= 2) return value == 0 ? read_alu_result() : alu[value];
+                return read_alu_port(value, "Unreadable condition ALU port");
             case 3: // flag
                 switch(value) {
-                    case 1: return alu_trigger;
-                    case 2: return *alu_zf;
-                    case 3: return *alu_nf;
-                    case 4: return *alu_of;
+                    case 1: return 0; // AF reads as consumed
+                    case 2: case 3: case 4: return read_flag(value);
                     case 5: return halted;
-                    default: throw runtime_error("Invalid flag code in condition: " + to_string(value));
+                    case 6: return fault;
+                    default:
+                        if constexpr (Checked) raise(TRAP_FLAG, "Invalid flag code in condition", value);
+                        return 0;
                 }
             case 4: // PC
                 return pc;
+            case 5: // LSU port
+            case 6: // DMA port
+                if constexpr (Checked) {
+                    if (value < 0 || value > 3) {
+                        raise(TRAP_PORT, "Condition memory unit port out of range", value);
+                        return 0;
+                    }
+                }
+                return type == 5 ? lsu[value] : dma[value];
             default:
-                throw runtime_error("Unknown condition operand type: " + to_string(type));
+                if constexpr (Checked) raise(TRAP_OPERAND, "Unknown condition operand type", type);
+                return 0;
         }
     };
 
     int lhs_val = compute_value(instr.cond1_type, instr.cond1);
     int rhs_val = compute_value(instr.cond2_type, instr.cond2);
 
-    if (strcmp(instr.comp, "eq") == 0) return lhs_val == rhs_val;
-    if (strcmp(instr.comp, "ne") == 0) return lhs_val != rhs_val;
-    if (strcmp(instr.comp, "lt") == 0) return lhs_val < rhs_val;
-    if (strcmp(instr.comp, "le") == 0) return lhs_val <= rhs_val;
-    if (strcmp(instr.comp, "gt") == 0) return lhs_val > rhs_val;
-    if (strcmp(instr.comp, "ge") == 0) return lhs_val >= rhs_val;
-
-    return false;
+    return compare(instr.cmp, lhs_val, rhs_val);
 }
 
 int Cpu::exec_line(const Instruction& instr) {
     if (halted) {
         return 0; // CPU is halted; ignore instruction
     }
+    const int value = read_source<true, 0>(instr);
+    if (!trap) write_dest<true, 0>(instr, value);
+    if (trap) throw_trap();
+    // DEBUG: print_register_file();
+    return 0;
+}
+
+template <bool Checked, int Regs>
+int Cpu::read_source(const Instruction& instr) {
     int src_val = 0;
-    
-    // Ensure any pending ALU op is complete before reading *any* source.
-    update_alu(); 
 
     // --- 1. Read Source (Fetch Data) ---
     switch (instr.source_type) {
@@ -161,71 +230,98 @@ int Cpu::exec_line(const Instruction& instr) {
         src_val = instr.source_value;
         break;
     case 1: // register (R)
-        if (instr.source_value < 0 || instr.source_value >= reg_amount)
-            throw out_of_range("Source register index out of range: " + to_string(instr.source_value));
+        if constexpr (Checked) {
+            if (instr.source_value < 0 || instr.source_value >= reg_limit<Regs>()) {
+                raise(TRAP_REGISTER, "Source register index out of range", instr.source_value);
+                break;
+            }
+        }
         src_val = regs[instr.source_value];
         break;
-    case 2: // ALU port (A0 result, A1/A2 operands)
-        if (instr.source_value < 0 || instr.source_value > 2)
-            throw out_of_range("ALU source index out of range: " + to_string(instr.source_value));
-        src_val = alu[instr.source_value];
+    case 2: // ALU port (A0 result, A1/A2 operands; past A2 the other ALUs)
+        // only the result is lazy; A1/A2 hold the operands as written
+        if (instr.source_value >= 0 && instr.source_value <= 2) {
+            src_val = instr.source_value == 0 ? read_alu_result() : alu[instr.source_value];
+        } else {
+            src_val = read_alu_port(instr.source_value, "Unreadable source ALU port");
+        }
         break;
         
     case 3: // flag
         switch(instr.source_value) {
-            case 1: // alu flag (trigger)
-                src_val = alu_trigger;
+            case 1: // alu flag (trigger); always reads as consumed
+                src_val = 0;
                 break;
             case 2: // zero flag
-                src_val = *alu_zf;
-                break;
             case 3: // neg flag
-                src_val = *alu_nf;
-                break;
             case 4: // overflow flag
-                src_val = *alu_of;
+                src_val = read_flag(instr.source_value);
+                break;
+            case 6: // trap flag, the code of the fault last taken
+                src_val = fault;
                 break;
             default:
-                throw runtime_error("Unknown flag source value: " + to_string(instr.source_value));
+                if constexpr (Checked) raise(TRAP_FLAG, "Unknown flag source value", instr.source_value);
+                break;
         }
         break;
     case 4: // program counter (PC)
         src_val = pc;
         break;
+    case 5: // LSU port (L0 loaded word, L1/L3 last addresses, L2 store data)
+    case 6: // DMA port (D0 done, D1-D3 operands)
+        if constexpr (Checked) {
+            if (instr.source_value < 0 || instr.source_value > 3) {
+                raise(TRAP_PORT, "Memory unit source port out of range", instr.source_value);
+                break;
+            }
+        }
+        src_val = instr.source_type == 5 ? lsu[instr.source_value] : dma[instr.source_value];
+        break;
     default:
-        throw runtime_error("Unknown source type: " + to_string(instr.source_type));
+        if constexpr (Checked) raise(TRAP_OPERAND, "Unknown source type", instr.source_type);
+        break;
     }
 
+    return src_val;
+}
+
+template <bool Checked, int Regs>
+void Cpu::write_dest(const Instruction& instr, int src_val) {
     // --- 2. Write Destination (Transport Data) ---
     switch (instr.dest_type) {
     case 0: // Discard (Constant, NOP)
         break; 
     case 1: // register (R)
-        if (instr.dest_value < 0 || instr.dest_value >= reg_amount)
-            throw out_of_range("Dest register index out of range: " + to_string(instr.dest_value));
+        if constexpr (Checked) {
+            if (instr.dest_value < 0 || instr.dest_value >= reg_limit<Regs>()) {
+                raise(TRAP_REGISTER, "Dest register index out of range", instr.dest_value);
+                break;
+            }
+        }
         regs[instr.dest_value] = src_val; 
         break;
-    case 2: // ALU port (A0/A1/A2) - WRITE
-        if (instr.dest_value < 1 || instr.dest_value > 2) {
-            throw out_of_range("ALU dest port must be A1 or A2: " + to_string(instr.dest_value));
-        }
-        alu[instr.dest_value] = src_val;
-        update_alu();
+    case 2: // ALU port (A1/A2, or another ALU's A1/A2/AF) - WRITE
+        if (instr.dest_value == 1 || instr.dest_value == 2) alu[instr.dest_value] = src_val;
+        else write_alu_port(instr.dest_value, src_val);
         break;
         
     case 3: // ALU flag (set trigger 'AF')
         switch(instr.dest_value) {
             case 1: // alu flag (AF)
-                alu_trigger = src_val;
-                update_alu();
+                trigger_alu(src_val);
                 break;
             case 5: // halt flag (HF)
                 if (src_val != 0) {
                     halted = 1;
                 }
                 break;
+            case 6: // trap flag; clearing it re-arms the trap vector
+                fault = src_val;
+                break;
             default:
-                throw runtime_error("Unknown or read-only flag destination value: " + to_string(instr.dest_value));
+                if constexpr (Checked) raise(TRAP_FLAG, "Unknown or read-only flag destination value", instr.dest_value);
+                break;
         }
         break;
         
@@ -233,11 +329,246 @@ int Cpu::exec_line(const Instruction& instr) {
         pc = src_val;
         increment_pc = false;
         break;
+    case 5: // LSU: L1 triggers a load, L3 a store, L2 holds the data
+        if constexpr (Checked) {
+            if (instr.dest_value < 1 || instr.dest_value > 3) {
+                raise(TRAP_PORT, "LSU dest port must be L1, L2 or L3", instr.dest_value);
+                break;
+            }
+        }
+        if (instr.dest_value == 1) lsu_load(src_val);
+        else if (instr.dest_value == 3) lsu_store(src_val);
+        else lsu[2] = src_val;
+        break;
+    case 6: // DMA: D0 triggers a transfer, D1-D3 hold its operands
+        if constexpr (Checked) {
+            if (instr.dest_value < 0 || instr.dest_value > 3) {
+                raise(TRAP_PORT, "DMA dest port out of range", instr.dest_value);
+                break;
+            }
+        }
+        if (instr.dest_value == 0) dma_start(src_val);
+        else dma[instr.dest_value] = src_val;
+        break;
     default:
-        throw runtime_error("Unknown dest type: " + to_string(instr.dest_type));
+        if constexpr (Checked) raise(TRAP_OPERAND, "Unknown dest type", instr.dest_type);
+        break;
     }
-    // DEBUG: print_register_file();
-    return 0;
+}
+
+template <bool Checked, int Regs>
+bool Cpu::issue_move(const Instruction& instr) {
+    // If the instruction has a condition, only execute when it holds.
+    // Verified operands cannot fault, only the units they write to can.
+    const bool taken = condition_holds<Checked, Regs>(instr);
+    if constexpr (Checked) {
+        if (trap) return taken;
+    }
+    if (taken && !halted) {
+        moved = read_source<Checked, Regs>(instr);
+        if constexpr (Checked) {
+            if (trap) return taken;
+        }
+        write_dest<Checked, Regs>(instr, moved);
+        if (trap) return taken; // the faulting move keeps its PC
+    }
+
+    if (increment_pc) {
+        pc++;
+    } else {
+        increment_pc = true; // reset flag after a successful jump
+    }
+    return taken;
+}
+
+bool Cpu::step(const Instruction& instr) {
+    return issue_move<true, 0>(instr);
+}
+
+bool Cpu::step_verified(const Instruction& instr) {
+    return issue_move<false, 0>(instr);
+}
+
+void Cpu::step_bundle(const Instruction* moves, int count) {
+    issue_bundle<true, 0, 0>(moves, count);
+}
+
+void Cpu::step_bundle_verified(const Instruction* moves, int count) {
+    issue_bundle<false, 0, 0>(moves, count);
+}
+
+template <bool Verified, int Regs, int Width>
+bool Cpu::step_fixed(const Instruction* moves) {
+    if constexpr (Width == 1) {
+        return issue_move<!Verified, Regs>(*moves);
+    } else {
+        issue_bundle<!Verified, Regs, Width>(moves, Width);
+        return true;
+    }
+}
+
+template <bool Checked, int Regs>
+void Cpu::check_commit(const Instruction* moves, int count, int i) {
+    const Instruction& m = moves[i];
+    const int v = static_cast<int>(bus[i]);
+    // a port's value once the bundle's stores have landed
+    auto staged = [&](int type, int value, int current) {
+        for (int j = 0; j < count; ++j) {
+            if (bus_active[j] && moves[j].dest_type == type && moves[j].dest_value == value) return static_cast<int>(bus[j]);
+        }
+        return current;
+    };
+    switch (m.dest_type) {
+    case 0:
+    case 4:
+        break;
+    case 1:
+        if (Checked && (m.dest_value < 0 || m.dest_value >= reg_limit<Regs>())) {
+            raise(TRAP_REGISTER, "Dest register index out of range", m.dest_value);
+        }
+        break;
+    case 2: {
+        if (m.dest_value == 1 || m.dest_value == 2) break;
+        const UnitPort* port = unit_port(UNIT_KINDS[0], m.dest_value, alu_count());
+        if (!port || !(port->use & (PORT_WRITE | PORT_TRIGGER))) {
+            raise(TRAP_PORT, "Unwritable ALU dest port", m.dest_value);
+            break;
+        }
+        if (!(port->use & PORT_TRIGGER) || v != 4) break;
+        const int unit = m.dest_value / ALU_STRIDE;
+        const int a2 = unit > 0 ? alus[static_cast<size_t>(unit - 1)].port[2] : alu[2];
+        if (staged(2, unit * ALU_STRIDE + 2, a2) == 0) raise(TRAP_DIVIDE, "Division by zero in ALU", 0);
+        break;
+    }
+    case 3:
+        if (m.dest_value == 1) {
+            if (v == 4 && staged(2, 2, alu[2]) == 0) raise(TRAP_DIVIDE, "Division by zero in ALU", 0);
+        } else if (Checked && m.dest_value != 5 && m.dest_value != 6) {
+            raise(TRAP_FLAG, "Unknown or read-only flag destination value", m.dest_value);
+        }
+        break;
+    case 5:
+        if (Checked && (m.dest_value < 1 || m.dest_value > 3)) {
+            raise(TRAP_PORT, "LSU dest port must be L1, L2 or L3", m.dest_value);
+        } else if (m.dest_value == 1) {
+            check_span("LSU load address out of range", v, 1, ram_words());
+        } else if (m.dest_value == 3) {
+            check_span("LSU store address out of range", v, 1, ram_words());
+        }
+        break;
+    case 6: {
+        if (Checked && (m.dest_value < 0 || m.dest_value > 3)) {
+            raise(TRAP_PORT, "DMA dest port out of range", m.dest_value);
+            break;
+        }
+        if (m.dest_value != 0 || v == 0) break;
+        if (v != 1 && v != 2) {
+            raise(TRAP_DMA_OP, "Unknown DMA op", v);
+            break;
+        }
+        const size_t words = ram_words();
+        const int count_words = staged(6, 3, dma[3]);
+        if (!check_span("DMA destination out of range", staged(6, 2, dma[2]), count_words, words)) break;
+        if (v == 1) check_span("DMA source out of range", staged(6, 1, dma[1]), count_words, words);
+        break;
+    }
+    default:
+        if constexpr (Checked) raise(TRAP_OPERAND, "Unknown dest type", m.dest_type);
+        break;
+    }
+}
+
+template <bool Checked, int Regs, int Width>
+void Cpu::issue_bundle(const Instruction* moves, int count) {
+    if constexpr (Width > 0) count = Width; // a constant bound, so the loops below unroll
+    if (count > bus_amount) {
+        raise(TRAP_BUS, "Bundle needs more buses than the machine has, moves", count);
+        return;
+    }
+
+    const int issued = halted ? 0 : count; // a halted CPU ignores the bundle
+    if (issued) {
+        // 1. every taken move reads its condition and source from the state
+        //    before the cycle and drives the value onto its own bus
+        for (int i = 0; i < count; ++i) {
+            const Instruction& m = moves[i];
+            bus_active[i] = condition_holds<Checked, Regs>(m);
+            if (Checked && trap) return;
+            if (!bus_active[i]) continue;
+            bus[i] = static_cast<unsigned int>(read_source<Checked, Regs>(m));
+            if (Checked && trap) return;
+            if (m.dest_type == 0) continue;
+            // the verifier rules out conflicts between unconditional moves,
+            // but a guarded move may still collide with another taken one
+            for (int j = 0; j < i; ++j) {
+                if (bus_active[j] && moves[j].dest_type == m.dest_type && moves[j].dest_value == m.dest_value) {
+                    raise(TRAP_BUS, "Bus conflict: two taken moves write the same destination, the second is move", i);
+                    return;
+                }
+            }
+        }
+        // 2. every fault the commit could take is found before it starts, so
+        //    a faulting bundle changes nothing and its PC can be retried
+        for (int i = 0; i < count; ++i) {
+            if (!bus_active[i]) continue;
+            check_commit<Checked, Regs>(moves, count, i);
+            if (trap) return;
+        }
+        // 3. commit: stores, HF and PC first, then triggers
+        for (int i = 0; i < count; ++i) {
+            if (bus_active[i] && !is_trigger(moves[i].dest_type, moves[i].dest_value)) write_dest<Checked, Regs>(moves[i], static_cast<int>(bus[i]));
+        }
+        for (int i = 0; i < count; ++i) {
+            if (bus_active[i] && is_trigger(moves[i].dest_type, moves[i].dest_value)) write_dest<Checked, Regs>(moves[i], static_cast<int>(bus[i]));
+        }
+    }
+    for (int i = issued; i < bus_amount; ++i) bus_active[i] = 0;
+
+    if (increment_pc) {
+        pc++;
+    } else {
+        increment_pc = true;
+    }
+}
+
+bool Cpu::take_trap() {
+    if (trap_vector < 0 || fault != TRAP_NONE) return false;
+    fault = trap;
+    fault_pc = pc;
+    pc = trap_vector;
+    increment_pc = true;
+    trap = TRAP_NONE;
+    return true;
+}
+
+string Cpu::trap_message() const {
+    if (trap == TRAP_DIVIDE) return trap_what;
+    return string(trap_what) + ": " + to_string(trap_value);
+}
+
+void Cpu::throw_trap() {
+    const string message = trap_message();
+    trap = TRAP_NONE;
+    throw runtime_error(message);
+}
+
+// the shapes Computer::interpret picks from
+#define YATTA_INSTANTIATE_SHAPE(R, W) \
+    template bool Cpu::step_fixed<true, R, W>(const Instruction*); \
+    template bool Cpu::step_fixed<false, R, W>(const Instruction*);
+YATTA_FIXED_SHAPES(YATTA_INSTANTIATE_SHAPE)
+#undef YATTA_INSTANTIATE_SHAPE
+
+void Cpu::set_bus_count(int count) {
+    if (count < 1) throw runtime_error("Bus count must be >= 1");
+    bus_amount = count;
+    bus.assign(static_cast<size_t>(count), 0);
+    bus_active.assign(static_cast<size_t>(count), 0);
+}
+
+void Cpu::set_alu_count(int count) {
+    if (count < 1 || count > MAX_ALUS) throw runtime_error("ALU count must be between 1 and " + to_string(MAX_ALUS));
+    alus.resize(static_cast<size_t>(count - 1));
 }
 
 Cpu::Cpu(int reg, int bus_) {
@@ -245,6 +576,7 @@ Cpu::Cpu(int reg, int bus_) {
     bus_amount = bus_;
     regs.resize(reg_amount, 0);
     bus.resize(bus_amount, 0);
+    bus_active.resize(bus_amount, 0);
 }
 
 int Cpu::exec_prog(const vector<Instruction>& prog) {
@@ -256,7 +588,7 @@ int Cpu::exec_prog(const vector<Instruction>& prog) {
         bool execute = true;
 
         // Conditional Check Block
-        if (instr.comp[0] != '\0') {
+        if (instr.cmp != CMP_NONE) {
             if (!check_condition(instr)) {
                 // Condition failed: skip execution
                 cout << "PC " << pc << ": Condition FAILED. Skipping." << endl;
@@ -290,17 +622,28 @@ int Cpu::exec_prog(const vector<Instruction>& prog) {
 }
 
 void Cpu::print_register_file() {
+    settle_alu();
     cout << "\n[ RF State ] ";
     for (int i = 0; i < reg_amount; ++i) {
         cout << "R" << i << "=" << regs[i] << (i < reg_amount - 1 ? " | " : "");
     }
     cout << endl << "[ ALU State ]";
     for (int i = 0; i < 3; ++i) {
-        cout << " ALU" << i << "=" << alu[i];
+        cout << " A" << i << "=" << alu[i];
     }
         cout << endl << " PC: " << pc << endl;
-    cout << "ALU flags: ZF=" << *alu_zf << " NF=" << *alu_nf << " OF=" << *alu_of;
+    cout << "ALU flags: ZF=" << (flags & FLAG_ZF ? 1 : 0) << " NF=" << (flags & FLAG_NF ? 1 : 0) << " OF=" << (flags & FLAG_OF ? 1 : 0);
+    for (size_t k = 0; k < alus.size(); ++k) {
+        const AluUnit& unit = alus[k];
+        cout << endl << "[ ALU" << k + 1 << " ] A0=" << unit.port[0] << " A1=" << unit.port[1] << " A2=" << unit.port[2]
+             << " ZF=" << unit.read(4) << " NF=" << unit.read(5) << " OF=" << unit.read(6);
+    }
+    cout << endl << "[ Units ] L0=" << lsu[0] << " L1=" << lsu[1] << " L2=" << lsu[2] << " L3=" << lsu[3]
+         << " | D0=" << dma[0] << " D1=" << dma[1] << " D2=" << dma[2] << " D3=" << dma[3];
     cout << endl << "Halted: " << halted;
+    if (fault || trap_vector >= 0) {
+        cout << " | TF=" << fault << " at PC " << fault_pc << " | trap vector " << trap_vector;
+    }
     cout << "\n" << endl;
 }
 
@@ -8,6 +8,11 @@
 #include <algorithm>
 #include <limits>
 #include <map>
+#include <cstdint>
+#include <functional>
+
+#include "memory.hpp"
+#include "units.hpp"
 
 
 
@@ -17,9 +22,49 @@ using namespace std;
 constexpr int NUM_REGISTERS_SAMPLE = 8;
 constexpr int BUS_COUNT_SAMPLE = 1;
 
+// Machine shapes (registers, bundle width) the interpreter is also compiled
+// for, with both counts constant; any other shape runs the runtime-sized code
+#define YATTA_FIXED_SHAPES(X) \
+    X(8, 1) X(8, 2) X(8, 4) X(16, 1) X(16, 2) X(16, 4) X(32, 1) X(32, 2) X(32, 4)
+
+enum Comparator : uint8_t {
+    CMP_NONE = 0, // unconditional move
+    CMP_EQ,
+    CMP_NE,
+    CMP_LT,
+    CMP_LE,
+    CMP_GT,
+    CMP_GE,
+    CMP_INVALID // decoded from a corrupt slot; never satisfied
+};
+
+// Truth table per comparator, indexed by the ordering of lhs vs rhs
+// (bit 0: lhs < rhs, bit 1: equal, bit 2: lhs > rhs)
+constexpr uint8_t CMP_TRUTH[8] = { 0b111, 0b010, 0b101, 0b001, 0b011, 0b100, 0b110, 0b000 };
+
+// Evaluate a comparator without branching on it.
+inline bool compare(Comparator cmp, int lhs, int rhs) {
+    const int ordering = (lhs > rhs) - (lhs < rhs) + 1;
+    return (CMP_TRUTH[cmp & 7] >> ordering) & 1;
+}
+
+// Guest faults. A faulting move raises one of these in Cpu::trap instead of
+// throwing and keeps its PC; codes are what the guest reads from TF.
+enum Trap : uint8_t {
+    TRAP_NONE = 0,
+    TRAP_REGISTER,      // register index out of range
+    TRAP_PORT,          // unit port that does not exist or allow the access
+    TRAP_FLAG,          // flag code that does not exist or allow the access
+    TRAP_OPERAND,       // unknown or missing operand type
+    TRAP_DIVIDE,        // DIV by zero
+    TRAP_MEMORY,        // LSU or DMA address outside memory, or no memory
+    TRAP_DMA_OP,        // unknown DMA op
+    TRAP_BUS,           // two taken moves wrote one destination, or too few buses
+};
+
 // Declare globals as extern here; definitions live in cpu.cpp
 extern std::string ops_ordered[6];
-extern std::map<std::string, std::string> ops_map;
+extern std::map<std::string, Comparator> ops_map;
 
 struct Instruction {
     int source_type = 0;
@@ -27,11 +72,10 @@ struct Instruction {
     int dest_type = 0;
     int dest_value = 0;
 
-    // Comparison mnemonic (fixed-size so Instruction is trivially-copyable)
-    char comp[8];  // e.g., "eq","ne","lt",...
+    Comparator cmp = CMP_NONE;
 
     // Typed condition operands: (type, value) pairs, same format as source/dest
-    // type: 0=const,1=reg,2=alu,3=flag,4=pc
+    // type: 0=const,1=reg,2=alu,3=flag,4=pc,5=lsu,6=dma (see units.hpp)
     int cond1_type = -1;
     int cond1 = 0; // numeric operand (mirrors source_value)
     int cond2_type = -1;
@@ -42,39 +86,151 @@ struct RawInstruction {
     std::string src;
     std::string dest;
     std::string condition;
+    bool parallel = false; // issued in the same bundle as the previous move
 };
 
 class Cpu {
 private:
-    bool check_add_overflow(int a, int b, int& result);
-    bool check_mul_overflow(int a, int b, int& result);
-    int update_alu();
-    int get_flag_value(const char* flag_name) const;
+    void eval_alu();
+    // ALU ports outside the first ALU's A0-A2 (value = ALU * ALU_STRIDE + port)
+    int read_alu_port(int value, const char* what);
+    void write_alu_port(int value, int v);
+    // Checked = false trusts the operands, as for moves that passed the
+    // load-time verifier (see verifier.hpp). Regs > 0 is the register count
+    // fixed at compile time, Width > 0 the bundle width; 0 uses the runtime
+    // counts.
+    template <bool Checked, int Regs> int read_source(const Instruction& instr);
+    template <bool Checked, int Regs> void write_dest(const Instruction& instr, int value);
+    template <bool Checked, int Regs> bool condition_holds(const Instruction& instr);
+    template <bool Checked, int Regs> bool issue_move(const Instruction& instr);
+    template <bool Checked, int Regs, int Width> void issue_bundle(const Instruction* moves, int count);
+    // Raise the fault taken move i of a bundle would take at commit, reading
+    // the ports a trigger depends on as the bundle's stores will leave them
+    template <bool Checked, int Regs> void check_commit(const Instruction* moves, int count, int i);
+    // Record a fault for the current move; the first one raised wins
+    void raise(Trap code, const char* what, int value) {
+        if (trap != TRAP_NONE) return;
+        trap = code;
+        trap_what = what;
+        trap_value = value;
+    }
+    template <int Regs> int reg_limit() const {
+        if constexpr (Regs > 0) return Regs;
+        else return reg_amount;
+    }
+    // Memory unit triggers; addresses count 32-bit words of `ram`
+    void lsu_load(int address);
+    void lsu_store(int address);
+    void dma_start(int op);
+    size_t ram_words() const; // 0 with no memory attached
+    bool check_span(const char* what, int first, int count, size_t words);
+    void wrote_ram(size_t first_word, size_t words);
 
 public:
     int halted = 0;
     bool increment_pc = true;
     int pc = 0;
+    uint64_t cycles = 0; // cycles retired by the Computer run loops
     
     std::vector<unsigned int> regs, bus;
+    std::vector<uint8_t> bus_active; // bus carried a taken move last bundle
     int alu[3] = { 0,0,0 };
     int* alu_result = &alu[0]; 
     int* alu_op1 = &alu[1]; 
     int* alu_op2 = &alu[2]; 
-    int alu_regs[3] = { 0,0,0 };
-    unsigned int alu_trigger = 0; 
-    int* alu_zf = &alu_regs[0]; // zero flag
-    int* alu_nf = &alu_regs[1]; // negative flag
-    int* alu_of = &alu_regs[2]; // overflow flag
+    // ALU ops are evaluated lazily: a trigger latches the op and its operands,
+    // and alu[0]/flags are only brought up to date when A0 or a flag is read
+    int alu_pending = 0; // latched op, 0 when alu[0]/flags are current
+    int alu_lhs = 0, alu_rhs = 0;
+    uint32_t flags = 0;  // FLAG_ZF | FLAG_NF | FLAG_OF
+    int moved = 0;       // value carried by the last move step / step_verified took
+    uint64_t not_taken = 0; // moves the threaded engine found their condition failing
+    // AF writes the threaded engine carried out, by op: ADD, SUB, MUL, DIV,
+    // then any other non-zero code (see AluOpKind)
+    uint64_t triggered[5] = {};
+    void count_trigger(int op) { if (op) ++triggered[op >= 1 && op <= 4 ? op - 1 : 4]; }
+    // ALU1 and up, addressed as ALU<n>.A1 etc.; the fields above are ALU0
+    std::vector<AluUnit> alus;
+
+    // Load/store unit: writing L1 loads the word at that address into L0,
+    // writing L3 stores L2 to that address. L1/L3 read back the last address.
+    int lsu[4] = { 0,0,0,0 };
+    // DMA unit: writing D0 starts a transfer of D3 words, op 1 copying from
+    // address D1 to D2, op 2 filling from D2 with the value D1. Transfers
+    // finish in the triggering cycle, and D0 reads 1 once one has.
+    int dma[4] = { 0,0,0,0 };
+    // Memory the units address, as little-endian 32-bit words; without it
+    // every access faults. Not owned.
+    Memory* ram = nullptr;
+    // Told about every byte range the units wrote, after the write
+    std::function<void(size_t offset, size_t bytes)> on_write;
+    // Set by the owner of `ram` when a write left translated code stale;
+    // the threaded and JIT engines return at the next block boundary
+    bool resync = false;
+
+    // Fault raised by the last move and not taken by the guest; the engines
+    // stop on it, leaving PC on the faulting move, and the Computer reports it
+    Trap trap = TRAP_NONE;
+    const char* trap_what = "";   // what faulted, e.g. "Source register index out of range"
+    int trap_value = 0;           // the offending index, address or op
+    // Guest trap vector: with one set (>= 0), a fault that arrives while TF
+    // is clear is taken instead of stopping the run. TF gets the fault code,
+    // fault_pc the faulting move's PC, and execution continues at the vector.
+    // Writing TF (usually 0) re-arms it; a fault while TF is set still stops.
+    int trap_vector = -1;
+    int fault = TRAP_NONE; // TF
+    int fault_pc = 0;
 
     int reg_amount = 0, bus_amount = 0;
     Cpu(int reg, int bus_);
+    void set_bus_count(int count);
+    // ALUs including the first; between 1 and MAX_ALUS. New ones start clear.
+    void set_alu_count(int count);
+    int alu_count() const { return 1 + static_cast<int>(alus.size()); }
 
     int exec_prog(const std::vector<Instruction>& prog); // DEBUG
     void print_register_file();
     bool check_condition(const Instruction& instr);
 
+    // Deliver `trap` to the trap vector if the guest can take it (see
+    // trap_vector); false leaves it for the host
+    bool take_trap();
+    // Describe `trap` for the host
+    std::string trap_message() const;
+    // Throw `trap` as std::runtime_error and clear it; for the entry points
+    // below that report faults by throwing
+    [[noreturn]] void throw_trap();
+
+    // AF write: latch op `op` with the current A1/A2; DIV by zero raises
+    // TRAP_DIVIDE and latches nothing
+    void trigger_alu(int op);
+    void settle_alu() { if (alu_pending) eval_alu(); }
+    int read_alu_result() { settle_alu(); return alu[0]; }
+    // flag codes as in operands: 2=ZF, 3=NF, 4=OF
+    int read_flag(int code) { settle_alu(); return static_cast<int>((flags >> (code - 2)) & 1); }
+
+    // exec_line and check_condition throw faults as std::runtime_error
     int exec_line(const Instruction& instr);
+    // One machine cycle: condition check, move, then PC update. Returns
+    // whether the move was taken (its condition held). A fault sets `trap`
+    // and leaves PC alone; so do step_bundle and the variants below.
+    bool step(const Instruction& instr);
+    // One machine cycle issuing `count` moves (at most bus_amount) on separate
+    // buses. Every condition and source is read before any destination is
+    // written; then plain stores commit, then triggers (AF, ALU<n>.AF, L1,
+    // L3, D0, so a trigger sees operands moved in the same bundle), then the
+    // PC advances or jumps.
+    // Two taken moves may not write the same destination.
+    void step_bundle(const Instruction* moves, int count);
+    // step / step_bundle without operand range and type checks, for moves
+    // that passed check_bundle (see verifier.hpp) on this register count
+    bool step_verified(const Instruction& instr);
+    void step_bundle_verified(const Instruction* moves, int count);
+    // step (Width 1) or step_bundle of Width moves for a machine with Regs
+    // registers, both known at compile time so range checks compare against
+    // constants and the bundle loops unroll. Only the YATTA_FIXED_SHAPES are
+    // instantiated; returns whether a single move was taken.
+    template <bool Verified, int Regs, int Width> bool step_fixed(const Instruction* moves);
 };
 
 int run_prog(const std::vector<RawInstruction>& prog_raw);// DEBUG
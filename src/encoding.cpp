@@ -0,0 +1,218 @@
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+#include "cpu.hpp"
+#include "encoding.hpp"
+
+using namespace std;
+
+static void put_u16(uint8_t* p, uint16_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+}
+
+static void put_u32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; ++i) p[i] = static_cast<uint8_t>(v >> (8 * i));
+}
+
+static uint16_t get_u16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8)
+        | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static uint32_t pack_type(int type, int lo, int hi, const char* what) {
+    if (type < lo || type > hi) {
+        throw runtime_error(string("encode_instruction: ") + what + " " + to_string(type) + " does not fit the packed format");
+    }
+    return static_cast<uint32_t>(type - lo);
+}
+
+static bool fits(int value, int bits) {
+    return value >= -(1 << (bits - 1)) && value < (1 << (bits - 1));
+}
+
+static uint32_t pack_signed(int value, int bits, const char* what) {
+    if (!fits(value, bits)) {
+        throw runtime_error(string("encode_instruction: ") + what + " " + to_string(value) + " does not fit in " + to_string(bits) + " bits");
+    }
+    return static_cast<uint32_t>(value) & ((1u << bits) - 1);
+}
+
+static uint16_t pack_short(int value, const char* what) {
+    return static_cast<uint16_t>(pack_signed(value, 16, what));
+}
+
+// Sign-extend the low `bits` bits of `v`
+static int unpack_signed(uint32_t v, int bits) {
+    const uint32_t sign = 1u << (bits - 1);
+    v &= (1u << bits) - 1;
+    return static_cast<int>(v ^ sign) - static_cast<int>(sign);
+}
+
+constexpr uint32_t WIDE_CONDITION = 1u << 15;
+constexpr uint32_t WIDE_SOURCE = 7; // source type field of the second wide layout
+
+void encode_instruction(const Instruction& in, uint8_t* out) {
+    Instruction instr = in;
+    const Comparator cmp = instr.cmp;
+    if (cmp >= CMP_INVALID) {
+        throw runtime_error("encode_instruction: unknown comparator " + to_string(static_cast<int>(cmp)));
+    }
+    const bool wide1 = cmp != CMP_NONE && !fits(instr.cond1, 16);
+    const bool wide2 = cmp != CMP_NONE && !fits(instr.cond2, 16);
+    if ((wide1 || wide2) && instr.cond1_type == 0 && instr.cond2_type == 0) {
+        // two constants always compare the same way
+        instr.cmp = compare(cmp, instr.cond1, instr.cond2) ? CMP_EQ : CMP_NE;
+        instr.cond1 = instr.cond2 = 0;
+        encode_instruction(instr, out);
+        return;
+    }
+
+    uint32_t word0 = pack_type(instr.source_type, 0, 7, "source type")
+        | pack_type(instr.dest_type, 0, 7, "dest type") << 3
+        | static_cast<uint32_t>(cmp) << 6;
+    uint32_t word1 = static_cast<uint32_t>(instr.source_value);
+    uint32_t word2 = 0;
+    if (wide1 || wide2) {
+        // the wide operand must be a constant; its type field marks it
+        const int wide_type = wide1 ? instr.cond1_type : instr.cond2_type;
+        if (wide_type != 0) pack_short(wide1 ? instr.cond1 : instr.cond2, "condition operand");
+        const int other_type = wide1 ? instr.cond2_type : instr.cond1_type;
+        const int other = wide1 ? instr.cond2 : instr.cond1;
+        // field 0 marks the wide one, so the other must name a real type
+        word0 |= WIDE_CONDITION | (pack_type(other_type, 0, 6, "condition type beside a wide constant") + 1) << (wide1 ? 12 : 9);
+        word2 = static_cast<uint32_t>(wide1 ? instr.cond1 : instr.cond2);
+        if (fits(instr.source_value, 16)) {
+            pack_type(instr.source_type, 0, 6, "source type beside a wide constant");
+            word0 |= pack_signed(instr.dest_value, 16, "dest value") << 16;
+            word1 = pack_signed(instr.source_value, 16, "source value") | pack_signed(other, 16, "condition operand") << 16;
+        } else {
+            if (instr.source_type != 0) pack_short(instr.source_value, "source value");
+            word0 = (word0 & ~7u) | WIDE_SOURCE;
+            word0 |= pack_signed(instr.dest_value, 8, "dest value beside a wide source and condition") << 16;
+            word0 |= pack_signed(other, 8, "condition operand beside a wide source") << 24;
+        }
+    } else {
+        if (cmp != CMP_NONE) {
+            word0 |= pack_type(instr.cond1_type, -1, 6, "condition type") << 9;
+            word0 |= pack_type(instr.cond2_type, -1, 6, "condition type") << 12;
+            word2 = pack_short(instr.cond1, "condition operand")
+                | static_cast<uint32_t>(pack_short(instr.cond2, "condition operand")) << 16;
+        }
+        word0 |= static_cast<uint32_t>(pack_short(instr.dest_value, "dest value")) << 16;
+    }
+
+    put_u32(out, word0);
+    put_u32(out + 4, word1);
+    put_u32(out + 8, word2);
+}
+
+Instruction decode_instruction(const uint8_t* slot) {
+    const uint32_t word0 = get_u32(slot);
+    const uint32_t word2 = get_u32(slot + 8);
+
+    Instruction instr = { 0, 0, 0, 0, CMP_NONE, -1, 0, -1, 0 };
+    instr.source_type = static_cast<int>(word0 & 7);
+    instr.source_value = static_cast<int>(get_u32(slot + 4));
+    instr.dest_type = static_cast<int>((word0 >> 3) & 7);
+    instr.dest_value = static_cast<int16_t>(word0 >> 16);
+
+    // 7 is not a comparator; it decodes to one that never holds
+    instr.cmp = static_cast<Comparator>((word0 >> 6) & 7);
+    if (instr.cmp != CMP_NONE) {
+        instr.cond1_type = static_cast<int>((word0 >> 9) & 7) - 1;
+        instr.cond2_type = static_cast<int>((word0 >> 12) & 7) - 1;
+        instr.cond1 = static_cast<int16_t>(word2 & 0xFFFF);
+        instr.cond2 = static_cast<int16_t>(word2 >> 16);
+        if (word0 & WIDE_CONDITION) {
+            // a constant needing all of word2; see the layouts in encoding.hpp
+            const bool wide1 = instr.cond1_type == -1;
+            int other;
+            if (instr.source_type == static_cast<int>(WIDE_SOURCE)) {
+                instr.source_type = 0;
+                instr.dest_value = unpack_signed(word0 >> 16, 8);
+                other = unpack_signed(word0 >> 24, 8);
+            } else {
+                const uint32_t word1 = static_cast<uint32_t>(instr.source_value);
+                instr.source_value = unpack_signed(word1, 16);
+                other = unpack_signed(word1 >> 16, 16);
+            }
+            (wide1 ? instr.cond1_type : instr.cond2_type) = 0;
+            (wide1 ? instr.cond1 : instr.cond2) = static_cast<int>(word2);
+            (wide1 ? instr.cond2 : instr.cond1) = other;
+        }
+    }
+    return instr;
+}
+
+void write_image_header(ostream& out, const ImageHeader& header) {
+    uint8_t raw[IMAGE_HEADER_SIZE] = {};
+    put_u32(raw, header.magic);
+    put_u16(raw + 4, header.version);
+    put_u16(raw + 6, header.width);
+    put_u32(raw + 8, header.count);
+    put_u32(raw + 12, header.entry);
+    out.write(reinterpret_cast<const char*>(raw), IMAGE_HEADER_SIZE);
+}
+
+void write_image(ostream& out, const vector<Instruction>& prog, uint32_t entry, uint16_t width) {
+    if (width == 0 || prog.size() % width != 0) {
+        throw runtime_error("write_image: program is not a whole number of " + to_string(width) + "-slot bundles");
+    }
+    ImageHeader header;
+    header.width = width;
+    header.count = static_cast<uint32_t>(prog.size());
+    header.entry = entry;
+
+    vector<uint8_t> body(prog.size() * INSTR_SLOT_SIZE);
+    for (size_t i = 0; i < prog.size(); ++i) {
+        encode_instruction(prog[i], body.data() + i * INSTR_SLOT_SIZE);
+    }
+    write_image_header(out, header);
+    out.write(reinterpret_cast<const char*>(body.data()), static_cast<streamsize>(body.size()));
+    if (!out) throw runtime_error("write_image: write failed");
+}
+
+ImageHeader read_image_header(istream& in) {
+    uint8_t raw[IMAGE_HEADER_SIZE];
+    if (!in.read(reinterpret_cast<char*>(raw), IMAGE_HEADER_SIZE)) {
+        throw runtime_error("read_image: file too short for an image header");
+    }
+    ImageHeader header;
+    header.magic = get_u32(raw);
+    header.version = get_u16(raw + 4);
+    header.width = get_u16(raw + 6);
+    header.count = get_u32(raw + 8);
+    header.entry = get_u32(raw + 12);
+    if (header.magic != IMAGE_MAGIC) {
+        throw runtime_error("read_image: bad magic (not a yatta image)");
+    }
+    if (header.version == 1) {
+        header.width = 1; // field was reserved
+    }
+    else if (header.version != IMAGE_VERSION) {
+        throw runtime_error("read_image: unsupported image version " + to_string(header.version));
+    }
+    if (header.width == 0 || header.count % header.width != 0) {
+        throw runtime_error("read_image: " + to_string(header.count) + " slots is not a whole number of " + to_string(header.width) + "-slot bundles");
+    }
+    return header;
+}
+
+ImageHeader read_image(istream& in, vector<uint8_t>& body) {
+    ImageHeader header = read_image_header(in);
+
+    body.resize(static_cast<size_t>(header.count) * INSTR_SLOT_SIZE);
+    if (!in.read(reinterpret_cast<char*>(body.data()), static_cast<streamsize>(body.size()))) {
+        throw runtime_error("read_image: image truncated (expected " + to_string(header.count) + " instructions)");
+    }
+    return header;
+}
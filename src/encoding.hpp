@@ -0,0 +1,61 @@
+#pragma once
+
+#include "cpu.hpp"
+#include <cstdint>
+#include <cstddef>
+#include <iosfwd>
+#include <vector>
+
+// --- Packed program image ---
+// A binary is an ImageHeader followed by `count` fixed-size instruction slots,
+// grouped into bundles of `width` slots that issue in the same cycle (PC and
+// the entry point count bundles). Version 1 images have no width and run one
+// slot per cycle. All fields are little endian regardless of host byte order.
+//
+// Slot layout (INSTR_SLOT_SIZE bytes):
+//   word0  bits  0-2  source type
+//          bits  3-5  dest type
+//          bits  6-8  comparator (Comparator, see cpu.hpp)
+//          bits  9-11 cond1 type + 1 (0 = no operand)
+//          bits 12-14 cond2 type + 1
+//          bits 16-31 dest value (signed 16-bit)
+//   word1  source value (signed 32-bit)
+//   word2  bits  0-15 cond1 value, bits 16-31 cond2 value (signed 16-bit)
+//
+// A constant condition operand that needs more than 16 bits sets bit 15 of
+// word0 and stores type field 0 for itself (it is always a constant) and its
+// value as the whole of word2. The other fields then share what is left:
+//   source value fits 16 bits:  word0 bits 16-31 dest value,
+//                               word1 bits 0-15 source value, 16-31 the
+//                               other condition operand (signed 16-bit)
+//   otherwise (source type 7):  word1 source value, word0 bits 16-23 dest
+//                               value, 24-31 the other operand (signed 8-bit)
+// A comparison of two constants is folded to 0 == 0 or 0 != 0 first.
+constexpr uint32_t IMAGE_MAGIC = 0x41545459; // "YTTA"
+constexpr uint16_t IMAGE_VERSION = 2;
+constexpr size_t IMAGE_HEADER_SIZE = 16;
+constexpr size_t INSTR_SLOT_SIZE = 12;
+
+struct ImageHeader {
+    uint32_t magic = IMAGE_MAGIC;
+    uint16_t version = IMAGE_VERSION;
+    uint16_t width = 1; // slots per bundle
+    uint32_t count = 0; // number of instruction slots
+    uint32_t entry = 0; // entry point, in instructions
+};
+
+// Pack one instruction into INSTR_SLOT_SIZE bytes at `out`.
+// Throws std::runtime_error if a field does not fit the packed layout.
+void encode_instruction(const Instruction& instr, uint8_t* out);
+Instruction decode_instruction(const uint8_t* slot);
+
+// Write just the header; `count` slots are expected to follow
+void write_image_header(std::ostream& out, const ImageHeader& header);
+// `prog` holds whole bundles, e.g. from pack_bundles
+void write_image(std::ostream& out, const std::vector<Instruction>& prog, uint32_t entry, uint16_t width = 1);
+// Read and validate just the header, leaving the stream at the first slot
+ImageHeader read_image_header(std::istream& in);
+// Read and validate a header, then read its instruction slots into `body`.
+// Throws std::runtime_error on a bad magic, unsupported version, a slot count
+// that is not whole bundles, or truncation.
+ImageHeader read_image(std::istream& in, std::vector<uint8_t>& body);
@@ -0,0 +1,528 @@
+#include <cstdint>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+#include <initializer_list>
+#include <stdexcept>
+
+#include "cpu.hpp"
+#include "encoding.hpp"
+#include "jit.hpp"
+
+#if YATTA_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+#if YATTA_JIT
+
+namespace {
+
+// Minimal x86-64 encoder for the handful of instructions the block compiler
+// needs. Only eax/ecx/edx/rax are used, so blocks need no prologue.
+class Emitter {
+public:
+    vector<uint8_t> code;
+
+    void byte(uint8_t b) { code.push_back(b); }
+    void bytes(std::initializer_list<uint8_t> bs) { code.insert(code.end(), bs); }
+    void imm32(int32_t v) {
+        for (int i = 0; i < 4; ++i) byte(static_cast<uint8_t>(static_cast<uint32_t>(v) >> (8 * i)));
+    }
+    void imm64(uint64_t v) {
+        for (int i = 0; i < 8; ++i) byte(static_cast<uint8_t>(v >> (8 * i)));
+    }
+
+    void mov_rax_addr(const void* p) { bytes({ 0x48, 0xB8 }); imm64(reinterpret_cast<uint64_t>(p)); }
+    void load_ecx(const void* p) { mov_rax_addr(p); bytes({ 0x8B, 0x08 }); }   // mov ecx, [rax]
+    void load_edx(const void* p) { mov_rax_addr(p); bytes({ 0x8B, 0x10 }); }   // mov edx, [rax]
+    void store_ecx(void* p) { mov_rax_addr(p); bytes({ 0x89, 0x08 }); }        // mov [rax], ecx
+    void store_edx(void* p) { mov_rax_addr(p); bytes({ 0x89, 0x10 }); }        // mov [rax], edx
+    void store_imm(void* p, int32_t v) { mov_rax_addr(p); bytes({ 0xC7, 0x00 }); imm32(v); }
+    void inc_u64(uint64_t* p) { mov_rax_addr(p); bytes({ 0x48, 0x83, 0x00, 0x01 }); } // add qword [rax], 1
+    void mov_ecx_imm(int32_t v) { byte(0xB9); imm32(v); }
+    void mov_edx_imm(int32_t v) { byte(0xBA); imm32(v); }
+    void mov_eax_imm(int32_t v) { byte(0xB8); imm32(v); }
+    void ret() { byte(0xC3); }
+
+    // Forward jumps: emit with a zero displacement, patch once the target is known.
+    size_t jcc(uint8_t cc) { bytes({ 0x0F, cc }); imm32(0); return code.size(); }
+    size_t jmp() { byte(0xE9); imm32(0); return code.size(); }
+    void bind(size_t after_jump) {
+        int32_t rel = static_cast<int32_t>(code.size() - after_jump);
+        memcpy(&code[after_jump - 4], &rel, 4);
+    }
+};
+
+constexpr uint8_t CC_O = 0x80, CC_E = 0x84, CC_NE = 0x85, CC_L = 0x8C,
+    CC_GE = 0x8D, CC_LE = 0x8E, CC_G = 0x8F;
+
+// Jump condition that skips a move, i.e. the negation of its comparator
+// applied to `cmp ecx, edx`.
+uint8_t skip_cc(Comparator cmp) {
+    switch (cmp) {
+    case CMP_EQ: return CC_NE;
+    case CMP_NE: return CC_E;
+    case CMP_LT: return CC_GE;
+    case CMP_LE: return CC_G;
+    case CMP_GT: return CC_LE;
+    default: return CC_L; // CMP_GE
+    }
+}
+
+// Ports and flags of one ALU
+struct AluTarget {
+    int* port;      // A0, A1, A2
+    uint32_t* flags;
+};
+
+AluTarget alu_target(Cpu& cpu, int unit) {
+    if (unit == 0) return { cpu.alu, &cpu.flags };
+    AluUnit& alu = cpu.alus[static_cast<size_t>(unit - 1)];
+    return { alu.port, &alu.flags };
+}
+
+// Where a readable operand lives. Mirrors the source switch in
+// Cpu::exec_line; conditions may additionally read HF.
+struct Operand {
+    bool is_const = false;
+    int value = 0;
+    const void* addr = nullptr;
+    int flag_bit = -1; // >= 0: read this bit of Cpu::flags
+};
+
+bool resolve_source(Cpu& cpu, int type, int value, bool in_condition, int pc, Operand& out) {
+    switch (type) {
+    case 0:
+        out.is_const = true;
+        out.value = value;
+        return true;
+    case 1:
+        if (value < 0 || value >= cpu.reg_amount) return false;
+        out.addr = &cpu.regs[static_cast<size_t>(value)];
+        return true;
+    case 2: {
+        // the first ALU is settled on entry and every other one is eager,
+        // so all ALU ports are plain storage here
+        const UnitPort* port = unit_port(UNIT_KINDS[0], value, cpu.alu_count());
+        if (!port || !(port->use & PORT_READ)) return false;
+        const AluTarget alu = alu_target(cpu, value / ALU_STRIDE);
+        const int p = value % ALU_STRIDE;
+        if (p <= 2) {
+            out.addr = alu.port + p;
+        } else {
+            out.addr = alu.flags;
+            out.flag_bit = p - 4;
+        }
+        return true;
+    }
+    case 3:
+        switch (value) {
+        case 1: // AF always reads as consumed
+            out.is_const = true;
+            out.value = 0;
+            return true;
+        case 2: case 3: case 4:
+            out.addr = &cpu.flags;
+            out.flag_bit = value - 2;
+            return true;
+        case 5:
+            if (!in_condition) return false;
+            out.addr = &cpu.halted;
+            return true;
+        default: return false;
+        }
+    case 4:
+        // the PC of a move inside a block is known at compile time
+        out.is_const = true;
+        out.value = pc;
+        return true;
+    case 5:
+    case 6:
+        if (value < 0 || value > 3) return false;
+        out.addr = type == 5 ? &cpu.lsu[value] : &cpu.dma[value];
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool supported(Cpu& cpu, const Instruction& inst, int pc) {
+    Operand scratch;
+    Comparator cmp = inst.cmp;
+    if (cmp == CMP_INVALID) return false;
+    if (cmp != CMP_NONE
+        && !(resolve_source(cpu, inst.cond1_type, inst.cond1, true, pc, scratch)
+             && resolve_source(cpu, inst.cond2_type, inst.cond2, true, pc, scratch))) {
+        return false;
+    }
+    if (!resolve_source(cpu, inst.source_type, inst.source_value, false, pc, scratch)) return false;
+    switch (inst.dest_type) {
+    case 0: return true;
+    case 1: return inst.dest_value >= 0 && inst.dest_value < cpu.reg_amount;
+    case 2: {
+        const UnitPort* port = unit_port(UNIT_KINDS[0], inst.dest_value, cpu.alu_count());
+        if (!port) return false;
+        // another ALU's AF, inlined like the first one's
+        if (port->use & PORT_TRIGGER) return inst.source_type == 0;
+        return (port->use & PORT_WRITE) != 0;
+    }
+    // the ALU op must be known at compile time to be inlined
+    case 3: return inst.dest_value == 5 || (inst.dest_value == 1 && inst.source_type == 0);
+    case 4: return true;
+    // memory unit operands only; the triggers touch memory and are interpreted
+    case 5: return inst.dest_value == 2;
+    case 6: return inst.dest_value >= 1 && inst.dest_value <= 3;
+    default: return false;
+    }
+}
+
+class BlockCompiler {
+public:
+    BlockCompiler(Cpu& cpu, MoveTally& skips) : cpu(cpu), skips(skips) {}
+
+    Emitter e;
+
+    void load(const Operand& op, bool into_edx) {
+        if (op.is_const) {
+            if (into_edx) e.mov_edx_imm(op.value); else e.mov_ecx_imm(op.value);
+        } else {
+            if (into_edx) e.load_edx(op.addr); else e.load_ecx(op.addr);
+            if (op.flag_bit > 0) {
+                e.bytes({ 0xC1, static_cast<uint8_t>(into_edx ? 0xEA : 0xE9), static_cast<uint8_t>(op.flag_bit) }); // shr reg, bit
+            }
+            if (op.flag_bit >= 0) {
+                e.bytes({ 0x83, static_cast<uint8_t>(into_edx ? 0xE2 : 0xE1), 0x01 }); // and reg, 1
+            }
+        }
+    }
+
+    // Leave the block: cpu.pc = next_pc, return status.
+    void exit_to(int next_pc, int retired, bool bail) {
+        e.store_imm(&cpu.pc, next_pc);
+        e.mov_eax_imm(retired << 1 | (bail ? 1 : 0));
+        e.ret();
+    }
+
+    // Flags word for a non-overflowing result in ecx, as set at the end of
+    // Cpu::eval_alu: FLAG_ZF if zero, FLAG_NF if negative, OF clear.
+    void set_result_flags(uint32_t* flags) {
+        e.bytes({ 0x31, 0xD2 });              // xor edx, edx
+        e.bytes({ 0x85, 0xC9 });              // test ecx, ecx
+        e.bytes({ 0x0F, 0x94, 0xC2 });        // sete dl
+        e.bytes({ 0x89, 0xC8 });              // mov eax, ecx
+        e.bytes({ 0xC1, 0xE8, 0x1F });        // shr eax, 31
+        e.bytes({ 0x01, 0xC0 });              // add eax, eax
+        e.bytes({ 0x09, 0xC2 });              // or edx, eax
+        e.store_edx(flags);
+    }
+
+    // Inline Cpu::eval_alu (or AluUnit::trigger) for a trigger value known
+    // at compile time. Compiled code evaluates eagerly, so nothing is left
+    // pending across a block. `pc`/`retired` locate the move for the divide
+    // bail-out path.
+    void alu_op(const AluTarget& alu, int op, int pc, int retired) {
+        switch (op) {
+        case 0:
+            return; // no trigger, trigger_alu does nothing
+        case 1: case 2: case 3: {
+            e.load_ecx(alu.port + 1);
+            e.load_edx(alu.port + 2);
+            if (op == 1) {
+                e.bytes({ 0x01, 0xD1 });          // add ecx, edx
+            } else if (op == 2) {
+                // eval_alu subtracts by adding the negated operand, with
+                // the same wrap for INT_MIN; neg + add reproduces that exactly
+                e.bytes({ 0xF7, 0xDA });          // neg edx
+                e.bytes({ 0x01, 0xD1 });          // add ecx, edx
+            } else {
+                e.bytes({ 0x0F, 0xAF, 0xCA });    // imul ecx, edx
+            }
+            size_t overflow = e.jcc(CC_O);
+            e.store_ecx(alu.port);
+            set_result_flags(alu.flags);
+            size_t done = e.jmp();
+            e.bind(overflow);
+            // on overflow the result stays 0 and OF is raised
+            e.store_imm(alu.port, 0);
+            e.store_imm(alu.flags, static_cast<int32_t>(FLAG_ZF | FLAG_OF));
+            e.bind(done);
+            return;
+        }
+        case 4: {
+            // division by zero and INT_MIN / -1 go back to the interpreter,
+            // which traps the first and overflows the second to 0 with OF
+            e.load_ecx(alu.port + 2);
+            e.bytes({ 0x85, 0xC9 });              // test ecx, ecx
+            size_t by_zero = e.jcc(CC_E);
+            e.load_edx(alu.port + 1);
+            e.bytes({ 0x83, 0xF9, 0xFF });        // cmp ecx, -1
+            size_t safe = e.jcc(CC_NE);
+            e.bytes({ 0x81, 0xFA }); e.imm32(INT_MIN); // cmp edx, INT_MIN
+            size_t wraps = e.jcc(CC_E);
+            e.bind(safe);
+            e.bytes({ 0x89, 0xD0 });              // mov eax, edx
+            e.byte(0x99);                         // cdq
+            e.bytes({ 0xF7, 0xF9 });              // idiv ecx
+            e.bytes({ 0x89, 0xC1 });              // mov ecx, eax
+            size_t done = e.jmp();
+            e.bind(by_zero);
+            e.bind(wraps);
+            exit_to(pc, retired, true);
+            e.bind(done);
+            break;
+        }
+        default:
+            // unknown op: flags are recomputed from the unchanged result
+            e.load_ecx(alu.port);
+            set_result_flags(alu.flags);
+            return;
+        }
+        e.store_ecx(alu.port);
+        set_result_flags(alu.flags);
+    }
+
+    // Emit one move. Returns true if the move ends the block (PC or HF write).
+    bool move(const Instruction& inst, int pc, int retired) {
+        Operand src, lhs, rhs;
+        resolve_source(cpu, inst.source_type, inst.source_value, false, pc, src);
+
+        Comparator cmp = inst.cmp;
+        size_t skip = 0;
+        if (cmp != CMP_NONE) {
+            resolve_source(cpu, inst.cond1_type, inst.cond1, true, pc, lhs);
+            resolve_source(cpu, inst.cond2_type, inst.cond2, true, pc, rhs);
+            load(lhs, false);
+            load(rhs, true);
+            e.bytes({ 0x39, 0xD1 });              // cmp ecx, edx
+            skip = e.jcc(skip_cc(cmp));
+        }
+
+        bool ends_block = false;
+        switch (inst.dest_type) {
+        case 0:
+            break;
+        case 1:
+            load(src, false);
+            e.store_ecx(&cpu.regs[static_cast<size_t>(inst.dest_value)]);
+            break;
+        case 2: {
+            const AluTarget alu = alu_target(cpu, inst.dest_value / ALU_STRIDE);
+            const int port = inst.dest_value % ALU_STRIDE;
+            if (port == 3) {
+                alu_op(alu, inst.source_value, pc, retired);
+            } else {
+                load(src, false);
+                e.store_ecx(alu.port + port);
+            }
+            break;
+        }
+        case 3:
+            if (inst.dest_value == 1) {
+                alu_op(alu_target(cpu, 0), inst.source_value, pc, retired);
+            } else {
+                load(src, false);
+                e.bytes({ 0x85, 0xC9 });          // test ecx, ecx
+                size_t zero = e.jcc(CC_E);
+                e.store_imm(&cpu.halted, 1);
+                e.bind(zero);
+                ends_block = true;
+            }
+            break;
+        case 4:
+            load(src, false);
+            e.store_ecx(&cpu.pc);
+            e.mov_eax_imm((retired + 1) << 1);
+            e.ret();
+            ends_block = true;
+            break;
+        case 5:
+            load(src, false);
+            e.store_ecx(&cpu.lsu[2]);
+            break;
+        case 6:
+            load(src, false);
+            e.store_ecx(&cpu.dma[inst.dest_value]);
+            break;
+        }
+
+        if (skip) {
+            // a failed condition lands past the move and records what the
+            // block's count took it for
+            const size_t over = e.jmp();
+            e.bind(skip);
+            MoveTally as_taken;
+            as_taken.count_static(inst, true);
+            e.inc_u64(&skips.skipped);
+            if (as_taken.jumps) e.inc_u64(&skips.jumps);
+            for (int k = 0; k < ALU_KINDS; ++k) {
+                if (as_taken.alu[k]) e.inc_u64(&skips.alu[k]);
+            }
+            e.bind(over);
+        }
+        return ends_block;
+    }
+
+private:
+    Cpu& cpu;
+    MoveTally& skips;
+};
+
+} // namespace
+
+CodeArena::~CodeArena() {
+    reset();
+}
+
+void CodeArena::reset() {
+    for (auto& c : chunks) munmap(c.base, c.size);
+    chunks.clear();
+}
+
+void* CodeArena::install(const vector<uint8_t>& code) {
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    if (chunks.empty() || chunks.back().size - chunks.back().used < code.size()) {
+        size_t size = max<size_t>(64 * 1024, (code.size() + page - 1) / page * page);
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) throw runtime_error("JIT: failed to map code memory");
+        chunks.push_back({ static_cast<uint8_t*>(p), size, 0 });
+    }
+    Chunk& c = chunks.back();
+    if (mprotect(c.base, c.size, PROT_READ | PROT_WRITE) != 0) throw runtime_error("JIT: mprotect failed");
+    uint8_t* dst = c.base + c.used;
+    memcpy(dst, code.data(), code.size());
+    c.used += (code.size() + 15) & ~static_cast<size_t>(15);
+    if (mprotect(c.base, c.size, PROT_READ | PROT_EXEC) != 0) throw runtime_error("JIT: mprotect failed");
+    return dst;
+}
+
+void JitEngine::compile(Cpu& cpu, const uint8_t* image, size_t count, int entry) {
+    BlockCompiler bc(cpu, skips);
+    MoveTally moves;
+    int pc = entry;
+    int retired = 0;
+    bool ended = false;
+    while (static_cast<size_t>(pc) < count && retired < JIT_MAX_BLOCK) {
+        Instruction inst = decode_instruction(image + static_cast<size_t>(pc) * INSTR_SLOT_SIZE);
+        if (!supported(cpu, inst, pc)) break;
+        moves.count_static(inst, true);
+        ended = bc.move(inst, pc, retired);
+        ++retired;
+        ++pc;
+        if (ended) break;
+    }
+
+    Block& b = blocks[static_cast<size_t>(entry)];
+    if (retired == 0) {
+        b.failed = true;
+        return;
+    }
+    fill(covered.begin() + entry, covered.begin() + pc, 1);
+    // fall through: resume at the first move not in the block
+    bc.exit_to(pc, retired, false);
+    b.fn = reinterpret_cast<JitBlockFn>(arena.install(bc.e.code));
+    b.length = retired;
+    b.moves = moves;
+    entries.push_back(entry);
+    ++compiled;
+}
+
+#else
+
+CodeArena::~CodeArena() {}
+void CodeArena::reset() {}
+void* CodeArena::install(const vector<uint8_t>&) {
+    throw runtime_error("JIT: no backend for this host");
+}
+void JitEngine::compile(Cpu&, const uint8_t*, size_t, int entry) {
+    blocks[static_cast<size_t>(entry)].failed = true;
+}
+
+#endif
+
+bool JitEngine::covers(size_t first, size_t end) const {
+    end = min(end, covered.size());
+    for (size_t i = first; i < end; ++i) {
+        if (covered[i]) return true;
+    }
+    return false;
+}
+
+void JitEngine::run(Cpu& cpu, const uint8_t* image, size_t image_bytes, uint64_t budget, bool resume, MoveTally& tally) {
+    skips = MoveTally{};
+    execute(cpu, image, image_bytes, budget, resume, tally);
+    // blocks count their runs, and only here are those turned into moves
+    for (int entry : entries) {
+        Block& b = blocks[static_cast<size_t>(entry)];
+        tally.add(b.moves, b.whole);
+        b.whole = 0;
+    }
+    tally.executed -= skips.skipped;
+    tally.skipped += skips.skipped;
+    tally.jumps -= skips.jumps;
+    for (int k = 0; k < ALU_KINDS; ++k) tally.alu[k] -= skips.alu[k];
+}
+
+void JitEngine::execute(Cpu& cpu, const uint8_t* image, size_t image_bytes, uint64_t budget, bool resume, MoveTally& tally) {
+    const size_t count = image_bytes / INSTR_SLOT_SIZE;
+    if (!resume || blocks.size() != count) {
+        arena.reset();
+        blocks.assign(count, Block{});
+        entries.clear();
+        covered.assign(count, 0);
+        compiled = 0;
+    }
+    const uint64_t stop = budget > UINT64_MAX - cpu.cycles ? UINT64_MAX : cpu.cycles + budget;
+
+    bool leader = true; // cpu.pc starts a block (run start, jump target or block exit)
+    while (!cpu.halted && !cpu.resync && cpu.pc >= 0 && static_cast<size_t>(cpu.pc) < count && cpu.cycles < stop) {
+        const int pc = cpu.pc;
+        if (leader) {
+            Block& b = blocks[static_cast<size_t>(pc)];
+            if (!b.fn && !b.failed && ++b.hits >= JIT_HOT_THRESHOLD) {
+                compile(cpu, image, count, pc);
+            }
+            if (b.fn) {
+                // compiled code reads alu[0]/flags directly
+                cpu.settle_alu();
+                const int done = b.fn();
+                const int retired = done >> 1;
+                cpu.cycles += static_cast<uint64_t>(retired);
+                if (retired == b.length) {
+                    ++b.whole;
+                } else {
+                    // left early for the interpreter; count the part that ran
+                    for (int i = 0; i < retired; ++i) {
+                        tally.count_static(decode_instruction(image + static_cast<size_t>(pc + i) * INSTR_SLOT_SIZE), true);
+                    }
+                }
+                if (done & 1) {
+                    const Instruction inst = decode_instruction(image + static_cast<size_t>(cpu.pc) * INSTR_SLOT_SIZE);
+                    const bool taken = cpu.step(inst);
+                    if (cpu.trap && !cpu.take_trap()) return;
+                    tally.count(inst, taken, cpu.moved);
+                    ++cpu.cycles;
+                }
+                continue;
+            }
+            const Instruction inst = decode_instruction(image + static_cast<size_t>(pc) * INSTR_SLOT_SIZE);
+            const bool taken = cpu.step(inst);
+            // a fault the guest takes costs the faulting move's cycle
+            if (cpu.trap && !cpu.take_trap()) return;
+            tally.count(inst, taken, cpu.moved);
+            ++cpu.cycles;
+            // a move that cannot be compiled ends the block before it, so the
+            // move after it is a block entry too
+            leader = b.failed || cpu.pc != pc + 1;
+            continue;
+        }
+        const Instruction inst = decode_instruction(image + static_cast<size_t>(pc) * INSTR_SLOT_SIZE);
+        const bool taken = cpu.step(inst);
+        if (cpu.trap && !cpu.take_trap()) return;
+        tally.count(inst, taken, cpu.moved);
+        ++cpu.cycles;
+        leader = cpu.pc != pc + 1;
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "cpu.hpp"
+#include "telemetry.hpp"
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define YATTA_JIT 1
+#else
+#define YATTA_JIT 0
+#endif
+
+// Blocks are compiled once their entry has been dispatched this many times.
+constexpr uint32_t JIT_HOT_THRESHOLD = 2;
+// Upper bound on the moves folded into one native block.
+constexpr int JIT_MAX_BLOCK = 256;
+
+// Compiled block. Returns (moves retired << 1) | bail; cpu.pc is already
+// updated. With bail set the move at cpu.pc must be run by the interpreter.
+using JitBlockFn = int (*)();
+
+// Executable memory for compiled blocks: mapped writable, flipped to
+// read+execute after each install so no page is ever writable and executable.
+class CodeArena {
+public:
+    CodeArena() = default;
+    CodeArena(const CodeArena&) = delete;
+    CodeArena& operator=(const CodeArena&) = delete;
+    ~CodeArena();
+
+    void* install(const std::vector<uint8_t>& code);
+    void reset();
+
+private:
+    struct Chunk {
+        uint8_t* base;
+        size_t size;
+        size_t used;
+    };
+    std::vector<Chunk> chunks;
+};
+
+// x86-64 JIT for straight-line runs of moves. Operands are baked in as
+// absolute addresses into the Cpu, so compiled code is only valid for the
+// Cpu and image it was built from; run() starts from an empty cache.
+// Anything the compiler does not handle runs through Cpu::step.
+class JitEngine {
+public:
+    // False on hosts without a backend; run() then only interprets.
+    static bool available() { return YATTA_JIT != 0; }
+
+    // Execute from cpu.pc until halt, PC leaves the image or, checked
+    // between blocks, at least `budget` cycles have retired or cpu.resync
+    // is set. `resume` keeps the code compiled by the previous call, which
+    // must have been for the same Cpu and an image that changed nowhere
+    // covers() reports. The moves that retired are added to `tally`.
+    void run(Cpu& cpu, const uint8_t* image, size_t image_bytes, uint64_t budget, bool resume, MoveTally& tally);
+
+    // Whether compiled code was built from any move in [first, end)
+    bool covers(size_t first, size_t end) const;
+    size_t compiled_blocks() const { return compiled; }
+
+private:
+    struct Block {
+        JitBlockFn fn = nullptr;
+        uint32_t hits = 0;
+        bool failed = false; // first move unsupported; always interpret
+        int length = 0;      // moves compiled
+        MoveTally moves;     // the compiled moves, counted as if all were taken
+        uint64_t whole = 0;  // runs through all of them since the last count
+    };
+
+    void compile(Cpu& cpu, const uint8_t* image, size_t count, int entry);
+    // run() before the blocks and `skips` are counted into the tally
+    void execute(Cpu& cpu, const uint8_t* image, size_t image_bytes, uint64_t budget, bool resume, MoveTally& tally);
+
+    std::vector<Block> blocks; // indexed by entry PC
+    std::vector<int> entries;  // PCs of the compiled blocks
+    std::vector<uint8_t> covered; // per PC: compiled into some block
+    CodeArena arena;
+    size_t compiled = 0;
+    // Blocks are counted whole; compiled code counts here each move whose
+    // condition failed, by what it would have counted as, so only skips
+    // cost an increment
+    MoveTally skips;
+};
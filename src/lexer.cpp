@@ -0,0 +1,147 @@
+#include <climits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "cpu.hpp"
+#include "lexer.hpp"
+#include "units.hpp"
+
+using namespace std;
+
+// Search order matters: "<=" must be tried before "<"; same as ops_ordered
+static constexpr struct { string_view text; Comparator cmp; } OPERATORS[6] = {
+    { "==", CMP_EQ }, { "!=", CMP_NE }, { "<=", CMP_LE }, { ">=", CMP_GE }, { "<", CMP_LT }, { ">", CMP_GT },
+};
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+string_view trim_view(string_view s) {
+    size_t first = s.find_first_not_of(" \t\n\r");
+    if (first == string_view::npos) return {};
+    size_t last = s.find_last_not_of(" \t\n\r");
+    return s.substr(first, last - first + 1);
+}
+
+// Next whitespace-delimited token starting at `pos`; empty at the end
+static string_view next_token(string_view s, size_t& pos) {
+    while (pos < s.size() && is_space(s[pos])) ++pos;
+    const size_t start = pos;
+    while (pos < s.size() && !is_space(s[pos])) ++pos;
+    return s.substr(start, pos - start);
+}
+
+static bool all_digits(string_view tok) {
+    if (tok.empty()) return false;
+    for (char c : tok) {
+        if (!is_digit(c)) return false;
+    }
+    return true;
+}
+
+// Leading decimal digits of `tok`, like stoi: "R12x" reads as 12
+static int leading_number(string_view tok) {
+    long long value = 0;
+    for (size_t i = 0; i < tok.size() && is_digit(tok[i]); ++i) {
+        value = value * 10 + (tok[i] - '0');
+        if (value > INT_MAX) throw runtime_error("number '" + string(tok) + "' is out of range");
+    }
+    return static_cast<int>(value);
+}
+
+static int flag_code(char c) {
+    switch (c) {
+        case 'A': return 1;
+        case 'Z': return 2;
+        case 'N': return 3;
+        case 'O': return 4;
+        case 'H': return 5;
+        case 'T': return 6;
+        default: return 0;
+    }
+}
+
+// Source and condition operands share one classification
+static bool lex_operand(string_view tok, int& type, int& value) {
+    if (parse_unit_operand(tok, type, value)) return true;
+    if (all_digits(tok)) { type = 0; value = leading_number(tok); return true; }
+    if (tok == "PC") { type = 4; value = 0; return true; }
+    if (tok.size() > 1 && tok[0] == 'R' && is_digit(tok[1])) { type = 1; value = leading_number(tok.substr(1)); return true; }
+    if (tok.size() > 1 && tok[1] == 'F') {
+        type = 3;
+        value = flag_code(tok[0]);
+        return value != 0;
+    }
+    if (tok.size() > 1 && tok[0] == 'A' && is_digit(tok[1])) { type = 2; value = leading_number(tok.substr(1)); return true; }
+    if (tok.size() > 1 && tok[0] == 'L' && is_digit(tok[1])) { type = 5; value = leading_number(tok.substr(1)); return true; }
+    if (tok.size() > 1 && tok[0] == 'D' && is_digit(tok[1])) { type = 6; value = leading_number(tok.substr(1)); return true; }
+    return false;
+}
+
+static void lex_condition(string_view condition, Instruction& instr) {
+    for (const auto& op : OPERATORS) {
+        const size_t pos = condition.find(op.text);
+        if (pos == string_view::npos) continue;
+        instr.cmp = op.cmp;
+        const string_view sides[2] = { trim_view(condition.substr(0, pos)), trim_view(condition.substr(pos + op.text.size())) };
+        int* types[2] = { &instr.cond1_type, &instr.cond2_type };
+        int* values[2] = { &instr.cond1, &instr.cond2 };
+        for (int k = 0; k < 2; ++k) {
+            if (sides[k].empty()) throw runtime_error("empty condition operand");
+            if (!lex_operand(sides[k], *types[k], *values[k])) {
+                if (*types[k] == 3) throw runtime_error("unknown flag symbol in condition: '" + string(sides[k]) + "'");
+                throw runtime_error("unknown token in condition: '" + string(sides[k]) + "'");
+            }
+        }
+        return;
+    }
+    throw runtime_error("Conditional statement '" + string(condition) + "' contains no valid comparison operator.");
+}
+
+Instruction lex_move(string_view move, string_view* dest_out) {
+    Instruction instr = { 0, 0, 0, 0, CMP_NONE, -1, 0, -1, 0 };
+
+    size_t pos = 0;
+    const string_view src = next_token(move, pos);
+    const string_view dest = next_token(move, pos);
+    if (dest.empty()) {
+        throw runtime_error("parse_raw_instruction: line must have at least source and dest");
+    }
+    if (dest_out) *dest_out = dest;
+
+    // the condition runs from the next token (after an optional '?') to the end
+    size_t after = pos;
+    string_view first = next_token(move, after);
+    if (first == "?") first = next_token(move, after);
+    if (!first.empty()) {
+        const size_t start = static_cast<size_t>(first.data() - move.data());
+        lex_condition(trim_view(move.substr(start)), instr);
+    }
+
+    // --- SOURCE ---
+    if (!lex_operand(src, instr.source_type, instr.source_value)) {
+        if (instr.source_type == 3) throw runtime_error("unknown flag symbol '" + string(src) + "'");
+        throw runtime_error("unknown symbol '" + string(src) + "' in source");
+    }
+
+    // --- DESTINATION ---
+    if (parse_unit_operand(dest, instr.dest_type, instr.dest_value)) { /* long unit spelling, e.g. ALU1.AF */ }
+    else if (dest == "PC") { instr.dest_type = 4; instr.dest_value = 0; }
+    else if (dest == "AF") { instr.dest_type = 3; instr.dest_value = 1; }
+    else if (dest == "HF") { instr.dest_type = 3; instr.dest_value = 5; }
+    else if (dest == "TF") { instr.dest_type = 3; instr.dest_value = 6; }
+    else if (dest.size() > 1 && dest[0] == 'R' && is_digit(dest[1])) { instr.dest_type = 1; instr.dest_value = leading_number(dest.substr(1)); }
+    else if (dest.size() > 1 && dest[0] == 'A' && is_digit(dest[1])) { instr.dest_type = 2; instr.dest_value = leading_number(dest.substr(1)); }
+    else if (dest.size() > 1 && dest[0] == 'L' && is_digit(dest[1])) { instr.dest_type = 5; instr.dest_value = leading_number(dest.substr(1)); }
+    else if (dest.size() > 1 && dest[0] == 'D' && is_digit(dest[1])) { instr.dest_type = 6; instr.dest_value = leading_number(dest.substr(1)); }
+    else if (all_digits(dest)) { instr.dest_type = 0; instr.dest_value = 0; }
+    else throw runtime_error("unknown symbol '" + string(dest) + "' in destination");
+
+    return instr;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string_view>
+#include "cpu.hpp"
+
+// Allocation-free assembler front end. Works on views into the source text
+// (usually a mapped file) and accepts the same moves as parse_raw_instruction
+// followed by convert_line.
+
+// Strip the characters trim() strips, without copying
+std::string_view trim_view(std::string_view s);
+
+// Lex and classify one move (e.g. "R3 R1 ? ZF == 1"). If `dest` is given it
+// receives the destination token, for diagnostics.
+// Throws std::runtime_error on parse errors.
+Instruction lex_move(std::string_view move, std::string_view* dest = nullptr);
@@ -0,0 +1,383 @@
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <stdexcept>
+
+#include "cpu.hpp"
+#include "computer.hpp"
+#include "encoding.hpp"
+#include "lockstep.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define YATTA_SSE2 1
+#else
+#define YATTA_SSE2 0
+#endif
+
+using namespace std;
+
+namespace {
+
+// Lanes per vector; rows are padded to a multiple so kernels need no tail.
+// Padding lanes are never in a group, so their mask is always 0.
+constexpr size_t VEC = 4;
+
+// Scratch rows
+enum { ROW_GROUP, ROW_TAKEN, ROW_LHS, ROW_RHS, ROW_SRC, SCRATCH_ROWS };
+
+#if YATTA_SSE2
+inline __m128i load(const int32_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+inline void store(int32_t* p, __m128i v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+// m ? a : b, with m all ones or all zeros per lane
+inline __m128i blend(__m128i m, __m128i a, __m128i b) { return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b)); }
+#endif
+
+void fill_row(int32_t* dst, int32_t v, size_t n) {
+    fill(dst, dst + n, v);
+}
+
+// dst = m ? src : dst
+void select_row(int32_t* dst, const int32_t* src, const int32_t* m, size_t n) {
+#if YATTA_SSE2
+    for (size_t i = 0; i < n; i += VEC) store(dst + i, blend(load(m + i), load(src + i), load(dst + i)));
+#else
+    for (size_t i = 0; i < n; ++i) dst[i] = m[i] ? src[i] : dst[i];
+#endif
+}
+
+// dst = (flags >> bit) & 1
+void flag_row(int32_t* dst, const int32_t* flags, int bit, size_t n) {
+#if YATTA_SSE2
+    const __m128i one = _mm_set1_epi32(1);
+    for (size_t i = 0; i < n; i += VEC) store(dst + i, _mm_and_si128(_mm_srli_epi32(load(flags + i), bit), one));
+#else
+    for (size_t i = 0; i < n; ++i) dst[i] = (flags[i] >> bit) & 1;
+#endif
+}
+
+// taken = group lanes where `a cmp b` holds
+void compare_row(int32_t* taken, const int32_t* group, Comparator cmp, const int32_t* a, const int32_t* b, size_t n) {
+#if YATTA_SSE2
+    for (size_t i = 0; i < n; i += VEC) {
+        const __m128i va = load(a + i), vb = load(b + i), g = load(group + i);
+        __m128i t;
+        switch (cmp) {
+        case CMP_EQ: t = _mm_and_si128(_mm_cmpeq_epi32(va, vb), g); break;
+        case CMP_NE: t = _mm_andnot_si128(_mm_cmpeq_epi32(va, vb), g); break;
+        case CMP_LT: t = _mm_and_si128(_mm_cmplt_epi32(va, vb), g); break;
+        case CMP_LE: t = _mm_andnot_si128(_mm_cmpgt_epi32(va, vb), g); break;
+        case CMP_GT: t = _mm_and_si128(_mm_cmpgt_epi32(va, vb), g); break;
+        default: t = _mm_andnot_si128(_mm_cmplt_epi32(va, vb), g); break; // CMP_GE
+        }
+        store(taken + i, t);
+    }
+#else
+    for (size_t i = 0; i < n; ++i) taken[i] = compare(cmp, a[i], b[i]) ? group[i] : 0;
+#endif
+}
+
+// ADD or SUB with the Cpu overflow rules: on overflow the result is 0 and
+// OF is set; SUB adds the wrapped negation of b
+void add_row(int32_t* a0, int32_t* flags, const int32_t* a, const int32_t* b, bool sub, const int32_t* taken, size_t n) {
+#if YATTA_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i zf = _mm_set1_epi32(static_cast<int>(FLAG_ZF)), of = _mm_set1_epi32(static_cast<int>(FLAG_OF));
+    for (size_t i = 0; i < n; i += VEC) {
+        const __m128i va = load(a + i);
+        const __m128i vb = sub ? _mm_sub_epi32(zero, load(b + i)) : load(b + i);
+        const __m128i sum = _mm_add_epi32(va, vb);
+        // overflow iff both inputs differ in sign from the sum
+        const __m128i ov = _mm_srai_epi32(_mm_and_si128(_mm_xor_si128(va, sum), _mm_xor_si128(vb, sum)), 31);
+        const __m128i res = _mm_andnot_si128(ov, sum);
+        __m128i f = _mm_and_si128(_mm_cmpeq_epi32(res, zero), zf);
+        f = _mm_or_si128(f, _mm_slli_epi32(_mm_srli_epi32(res, 31), 1)); // NF
+        f = _mm_or_si128(f, _mm_and_si128(ov, of));
+        const __m128i t = load(taken + i);
+        store(a0 + i, blend(t, res, load(a0 + i)));
+        store(flags + i, blend(t, f, load(flags + i)));
+    }
+#else
+    for (size_t i = 0; i < n; ++i) {
+        if (!taken[i]) continue;
+        const uint32_t ua = static_cast<uint32_t>(a[i]);
+        const uint32_t ub = sub ? 0u - static_cast<uint32_t>(b[i]) : static_cast<uint32_t>(b[i]);
+        const uint32_t sum = ua + ub;
+        const bool ov = ((ua ^ sum) & (ub ^ sum)) >> 31;
+        const int32_t res = ov ? 0 : static_cast<int32_t>(sum);
+        a0[i] = res;
+        flags[i] = static_cast<int32_t>((res == 0 ? FLAG_ZF : 0) | (res < 0 ? FLAG_NF : 0) | (ov ? FLAG_OF : 0));
+    }
+#endif
+}
+
+// halted |= taken && src != 0
+void halt_row(int32_t* halted, const int32_t* src, const int32_t* taken, size_t n) {
+#if YATTA_SSE2
+    const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi32(1);
+    for (size_t i = 0; i < n; i += VEC) {
+        const __m128i set = _mm_andnot_si128(_mm_cmpeq_epi32(load(src + i), zero), load(taken + i));
+        store(halted + i, _mm_or_si128(load(halted + i), _mm_and_si128(set, one)));
+    }
+#else
+    for (size_t i = 0; i < n; ++i) if (taken[i] && src[i] != 0) halted[i] = 1;
+#endif
+}
+
+// Group lanes advance by one (group is -1 there), or jump to target where taken
+void pc_row(int32_t* pc, const int32_t* target, const int32_t* group, const int32_t* taken, size_t n) {
+#if YATTA_SSE2
+    for (size_t i = 0; i < n; i += VEC) {
+        __m128i next = _mm_sub_epi32(load(pc + i), load(group + i));
+        if (target) next = blend(load(taken + i), load(target + i), next);
+        store(pc + i, next);
+    }
+#else
+    for (size_t i = 0; i < n; ++i) {
+        int32_t next = pc[i] - group[i];
+        if (target && taken[i]) next = target[i];
+        pc[i] = next;
+    }
+#endif
+}
+
+// Operand checks mirror Cpu::read_source / write_dest / check_condition; a
+// move that would throw there takes the scalar path so it faults per lane
+bool readable(int type, int value, int reg_num, bool in_condition) {
+    switch (type) {
+    case 0: case 4: return true;
+    case 1: return value >= 0 && value < reg_num;
+    case 2: return value >= 0 && value <= 2;
+    case 3: return (value >= 1 && value <= 4) || (in_condition && value == 5);
+    default: return false;
+    }
+}
+
+bool vector_ok(const Instruction& instr, int reg_num) {
+    if (instr.cmp == CMP_INVALID) return false;
+    if (instr.cmp != CMP_NONE && !(readable(instr.cond1_type, instr.cond1, reg_num, true)
+                                   && readable(instr.cond2_type, instr.cond2, reg_num, true))) {
+        return false;
+    }
+    if (!readable(instr.source_type, instr.source_value, reg_num, false)) return false;
+    switch (instr.dest_type) {
+    case 0: case 4: return true;
+    case 1: return instr.dest_value >= 0 && instr.dest_value < reg_num;
+    case 2: return instr.dest_value == 1 || instr.dest_value == 2;
+    case 3: return instr.dest_value == 1 || instr.dest_value == 5;
+    default: return false;
+    }
+}
+
+} // namespace
+
+LockstepBatch::LockstepBatch(int lanes, int regs_)
+    : lane_count(lanes), reg_num(regs_), scalar(regs_, 1) {
+    if (lanes < 1) throw runtime_error("LockstepBatch: need at least one lane");
+    if (regs_ < 0) throw runtime_error("LockstepBatch: negative register count");
+    stride = (static_cast<size_t>(lanes) + VEC - 1) / VEC * VEC;
+    regs.assign(static_cast<size_t>(reg_num) * stride, 0);
+    alu.assign(3 * stride, 0);
+    flags.assign(stride, 0);
+    pcs.assign(stride, 0);
+    halted.assign(stride, 0);
+    state.assign(stride, LANE_EXITED); // padding lanes never run
+    faults.assign(static_cast<size_t>(lanes), string());
+    lane_cycles.assign(static_cast<size_t>(lanes), 0);
+    scratch.assign(SCRATCH_ROWS * stride, 0);
+}
+
+void LockstepBatch::import_lane(int lane, Cpu& cpu) {
+    const size_t l = static_cast<size_t>(lane);
+    cpu.settle_alu();
+    for (int r = 0; r < reg_num; ++r) {
+        regs[row(r) + l] = r < cpu.reg_amount ? static_cast<int32_t>(cpu.regs[static_cast<size_t>(r)]) : 0;
+    }
+    for (int k = 0; k < 3; ++k) alu[row(k) + l] = cpu.alu[k];
+    flags[l] = static_cast<int32_t>(cpu.flags);
+    halted[l] = cpu.halted;
+}
+
+void LockstepBatch::export_lane(int lane, Cpu& cpu) const {
+    const size_t l = static_cast<size_t>(lane);
+    if (cpu.reg_amount < reg_num) throw runtime_error("export_lane: Cpu has too few registers");
+    for (int r = 0; r < reg_num; ++r) cpu.regs[static_cast<size_t>(r)] = static_cast<unsigned int>(regs[row(r) + l]);
+    for (int k = 0; k < 3; ++k) cpu.alu[k] = alu[row(k) + l];
+    cpu.alu_pending = 0;
+    cpu.flags = static_cast<uint32_t>(flags[l]);
+    cpu.pc = pcs[l];
+    cpu.halted = halted[l];
+    cpu.increment_pc = true;
+}
+
+const int32_t* LockstepBatch::operand(int type, int value, int32_t* out) {
+    switch (type) {
+    case 1: return &regs[row(value)];
+    case 2: return &alu[row(value)];
+    case 3:
+        if (value == 5) return halted.data();
+        if (value == 1) fill_row(out, 0, stride); // AF reads as consumed
+        else flag_row(out, flags.data(), value - 2, stride);
+        return out;
+    case 4: return pcs.data();
+    default:
+        fill_row(out, value, stride);
+        return out;
+    }
+}
+
+void LockstepBatch::run(const Computer& image, int start_address, uint64_t max_cycles) {
+    const int width = image.bundle_width;
+    const size_t slots = static_cast<size_t>(width);
+    const size_t count = image.memory.size() / INSTR_SLOT_SIZE / slots;
+    if (start_address < 0 || static_cast<size_t>(start_address) >= count) {
+        throw runtime_error("LockstepBatch::run: start_address out of range");
+    }
+
+    vector<Instruction> code(count * slots);
+    for (size_t i = 0; i < code.size(); ++i) code[i] = decode_instruction(image.memory.data() + i * INSTR_SLOT_SIZE);
+    vector<uint8_t> vectorizable(count, 0);
+    if (width == 1) {
+        for (size_t i = 0; i < count; ++i) vectorizable[i] = vector_ok(code[i], reg_num);
+    }
+    scalar.set_bus_count(width);
+
+    for (size_t l = 0; l < static_cast<size_t>(lane_count); ++l) {
+        pcs[l] = start_address;
+        state[l] = LANE_RUNNING;
+        faults[l].clear();
+        lane_cycles[l] = 0;
+    }
+    issued = 0;
+
+    int32_t* group = &scratch[ROW_GROUP * stride];
+    fill_row(group, 0, stride);
+    int next = start_address;
+    bool regroup = true;
+    uint64_t since = 0;          // `issued` when the group formed
+    uint64_t limit = UINT64_MAX; // `issued` at which a group lane runs out of budget
+    while (true) {
+        if (regroup) {
+            // charge the group's lanes for the cycles it ran; a lane that
+            // faulted did not retire its last move, as in Computer::step
+            for (size_t l = 0; l < static_cast<size_t>(lane_count); ++l) {
+                if (group[l]) lane_cycles[l] += issued - since - (state[l] == LANE_FAULTED ? 1 : 0);
+            }
+            // retire finished lanes and find the lowest PC still running
+            next = INT_MAX;
+            for (size_t l = 0; l < static_cast<size_t>(lane_count); ++l) {
+                if (state[l] != LANE_RUNNING) continue;
+                if (halted[l]) state[l] = LANE_HALTED;
+                else if (pcs[l] < 0 || static_cast<size_t>(pcs[l]) >= count) state[l] = LANE_EXITED;
+                else if (lane_cycles[l] >= max_cycles) state[l] = LANE_BUDGET;
+                else next = min(next, pcs[l]);
+            }
+            if (next == INT_MAX) break;
+
+            bool everyone = true;
+            uint64_t left = UINT64_MAX;
+            for (size_t l = 0; l < stride; ++l) {
+                const bool here = state[l] == LANE_RUNNING && pcs[l] == next;
+                everyone &= here || state[l] != LANE_RUNNING;
+                group[l] = here ? -1 : 0;
+                if (here) left = min(left, max_cycles - lane_cycles[l]);
+            }
+            regroup = !everyone;
+            since = issued;
+            limit = left > UINT64_MAX - issued ? UINT64_MAX : issued + left;
+        }
+        const size_t at = static_cast<size_t>(next);
+        // while every running lane is in the group and the move cannot jump,
+        // halt or fault, the group just falls through to the next PC
+        bool falls_through = false;
+        if (vectorizable[at]) falls_through = issue(code[at], group);
+        else issue_scalar(&code[at * slots], width, group);
+        ++issued;
+        ++next;
+        regroup |= !falls_through || static_cast<size_t>(next) >= count || issued >= limit;
+    }
+}
+
+bool LockstepBatch::issue(const Instruction& instr, const int32_t* group) {
+    int32_t* taken = &scratch[ROW_TAKEN * stride];
+    int32_t* lhs_row = &scratch[ROW_LHS * stride];
+    int32_t* rhs_row = &scratch[ROW_RHS * stride];
+    int32_t* src_row = &scratch[ROW_SRC * stride];
+
+    // conditions and source are read before any destination is written
+    if (instr.cmp != CMP_NONE) {
+        const int32_t* lhs = operand(instr.cond1_type, instr.cond1, lhs_row);
+        const int32_t* rhs = operand(instr.cond2_type, instr.cond2, rhs_row);
+        compare_row(taken, group, instr.cmp, lhs, rhs, stride);
+    } else {
+        copy(group, group + stride, taken);
+    }
+    const int32_t* src = operand(instr.source_type, instr.source_value, src_row);
+
+    switch (instr.dest_type) {
+    case 1: select_row(&regs[row(instr.dest_value)], src, taken, stride); break;
+    case 2: select_row(&alu[row(instr.dest_value)], src, taken, stride); break;
+    case 3:
+        if (instr.dest_value == 5) {
+            halt_row(halted.data(), src, taken, stride);
+        }
+        else if (instr.source_type == 0 && (instr.source_value == 1 || instr.source_value == 2)) {
+            add_row(&alu[0], flags.data(), &alu[row(1)], &alu[row(2)], instr.source_value == 2, taken, stride);
+        }
+        else if (!(instr.source_type == 0 && instr.source_value == 0)) {
+            alu_scalar(src, taken);
+            // a lane that faulted in the ALU keeps its PC, as Cpu::step would
+            int32_t* advance = &scratch[ROW_LHS * stride];
+            for (size_t l = 0; l < stride; ++l) advance[l] = state[l] == LANE_RUNNING ? group[l] : 0;
+            pc_row(pcs.data(), nullptr, advance, taken, stride);
+            return false;
+        }
+        break;
+    default: break;
+    }
+    pc_row(pcs.data(), instr.dest_type == 4 ? src : nullptr, group, taken, stride);
+    return instr.dest_type != 4 && !(instr.dest_type == 3 && instr.dest_value == 5);
+}
+
+void LockstepBatch::fault_lane(size_t lane) {
+    state[lane] = LANE_FAULTED;
+    faults[lane] = scalar.trap_message();
+    scalar.trap = TRAP_NONE;
+}
+
+void LockstepBatch::alu_scalar(const int32_t* op, const int32_t* taken) {
+    // MUL, DIV and computed ops go through Cpu::trigger_alu one lane at a time
+    for (size_t l = 0; l < static_cast<size_t>(lane_count); ++l) {
+        if (!taken[l]) continue;
+        for (int k = 0; k < 3; ++k) scalar.alu[k] = alu[row(k) + l];
+        scalar.flags = static_cast<uint32_t>(flags[l]);
+        scalar.alu_pending = 0;
+        scalar.trigger_alu(op[l]);
+        scalar.settle_alu();
+        if (scalar.trap) fault_lane(l);
+        alu[l] = scalar.alu[0];
+        flags[l] = static_cast<int32_t>(scalar.flags);
+    }
+}
+
+void LockstepBatch::issue_scalar(const Instruction* moves, int width, const int32_t* group) {
+    for (size_t l = 0; l < static_cast<size_t>(lane_count); ++l) {
+        if (!group[l]) continue;
+        for (int r = 0; r < reg_num; ++r) scalar.regs[static_cast<size_t>(r)] = static_cast<unsigned int>(regs[row(r) + l]);
+        for (int k = 0; k < 3; ++k) scalar.alu[k] = alu[row(k) + l];
+        scalar.alu_pending = 0;
+        scalar.flags = static_cast<uint32_t>(flags[l]);
+        scalar.pc = pcs[l];
+        scalar.halted = halted[l];
+        scalar.increment_pc = true;
+        if (width > 1) scalar.step_bundle(moves, width);
+        else scalar.step(*moves);
+        if (scalar.trap) fault_lane(l);
+        scalar.settle_alu();
+        for (int r = 0; r < reg_num; ++r) regs[row(r) + l] = static_cast<int32_t>(scalar.regs[static_cast<size_t>(r)]);
+        for (int k = 0; k < 3; ++k) alu[row(k) + l] = scalar.alu[k];
+        flags[l] = static_cast<int32_t>(scalar.flags);
+        pcs[l] = scalar.pc;
+        halted[l] = scalar.halted;
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "cpu.hpp"
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+class Computer;
+
+enum LaneStatus : uint8_t {
+    LANE_RUNNING = 0,
+    LANE_HALTED,  // HF was written
+    LANE_EXITED,  // PC left the image
+    LANE_FAULTED, // the move raised a trap; see fault()
+    LANE_BUDGET   // max_cycles ran out
+};
+
+// Runs one program image on many machines at once. Lane state is kept as
+// structure of arrays, one row per architectural value (regs[r][lane],
+// alu[k][lane], pc[lane], ...), so a move updates every lane with a few
+// SIMD ops (SSE2 on x86-64, plain loops elsewhere). Conditions become
+// per-lane execution masks.
+//
+// Each cycle issues the move at the lowest PC any running lane sits on, to
+// the lanes at that PC; lanes that branched elsewhere wait and regroup when
+// the others catch up. Moves the vector path does not cover (operands that
+// would fault, computed ALU ops, MUL/DIV, bundles) run lane by lane through
+// a scalar Cpu. Every lane ends exactly where Computer::run_from_ram would,
+// except that lanes have no memory and only one ALU of their own: an LSU or
+// DMA move, or one naming ALU1 and up, faults the lanes that issue it.
+// Lanes have no trap vector either, so every trap faults its lane and TF
+// always reads 0.
+class LockstepBatch {
+public:
+    LockstepBatch(int lanes, int reg_num);
+
+    int lanes() const { return lane_count; }
+
+    // Seed a lane from a Cpu (registers, ALU ports, flags) or set a register
+    void import_lane(int lane, Cpu& cpu);
+    void set_reg(int lane, int reg, int value) { regs[row(reg) + static_cast<size_t>(lane)] = value; }
+    // Copy a lane's state into a Cpu with at least reg_num registers
+    void export_lane(int lane, Cpu& cpu) const;
+
+    // Run the program in `image` from start_address on every lane until each
+    // one halts, leaves the image, faults or has run max_cycles cycles of its
+    // own, as Computer::step(max_cycles) would
+    void run(const Computer& image, int start_address, uint64_t max_cycles = UINT64_MAX);
+
+    int reg(int lane, int r) const { return regs[row(r) + static_cast<size_t>(lane)]; }
+    int pc(int lane) const { return pcs[static_cast<size_t>(lane)]; }
+    LaneStatus status(int lane) const { return state[static_cast<size_t>(lane)]; }
+    // Cycles the lane retired in the last run, as Cpu::cycles counts them
+    uint64_t cycles(int lane) const { return lane_cycles[static_cast<size_t>(lane)]; }
+    const std::string& fault(int lane) const { return faults[static_cast<size_t>(lane)]; }
+
+    // Cycles issued by the last run; each may serve many lanes
+    uint64_t issued = 0;
+
+private:
+    size_t row(int index) const { return static_cast<size_t>(index) * stride; }
+
+    bool issue(const Instruction& instr, const int32_t* group);
+    void issue_scalar(const Instruction* moves, int width, const int32_t* group);
+    void alu_scalar(const int32_t* op, const int32_t* taken);
+    // Mark a lane faulted with the scalar Cpu's trap, and clear the trap
+    void fault_lane(size_t lane);
+    const int32_t* operand(int type, int value, int32_t* scratch);
+
+    int lane_count, reg_num;
+    size_t stride; // lanes rounded up to a whole vector
+
+    std::vector<int32_t> regs;  // reg_num rows
+    std::vector<int32_t> alu;   // A0, A1, A2 rows
+    std::vector<int32_t> flags; // FLAG_* bits
+    std::vector<int32_t> pcs;
+    std::vector<int32_t> halted;
+    std::vector<LaneStatus> state;
+    std::vector<std::string> faults;
+    std::vector<uint64_t> lane_cycles;
+
+    std::vector<int32_t> scratch; // rows for masks and materialised operands
+    Cpu scalar;                   // executes the moves the vector path skips
+};
@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include "memory.hpp"
+
+#if YATTA_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+void Memory::use_heap() {
+    base = heap.data();
+    length = heap.size();
+}
+
+uint8_t* Memory::writable() {
+    if (mapped() && mode == MEMORY_READ_ONLY) {
+        // detach: the rest of the run writes to a private copy
+        vector<uint8_t> copy_of(base, base + length);
+        unmap();
+        heap = move(copy_of);
+        use_heap();
+    }
+    return base;
+}
+
+void Memory::assign(size_t bytes) {
+    unmap();
+    heap.assign(bytes, 0);
+    use_heap();
+}
+
+void Memory::resize(size_t bytes) {
+    if (mapped()) {
+        vector<uint8_t> copy_of(base, base + min(length, bytes));
+        unmap();
+        heap = move(copy_of);
+    }
+    heap.resize(bytes, 0);
+    use_heap();
+}
+
+void Memory::unmap() {
+#if YATTA_MMAP
+    if (map_base) munmap(map_base, map_length);
+#endif
+    map_base = nullptr;
+    map_length = 0;
+    mapped_file.clear();
+}
+
+#if YATTA_MMAP
+void Memory::map_file(const string& path, size_t offset, size_t bytes, MemoryMapping mapping) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw runtime_error("map_file: cannot open " + path);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < offset + bytes) {
+        close(fd);
+        throw runtime_error("map_file: " + path + " is shorter than the mapped range");
+    }
+
+    // mmap offsets must be page aligned; map from the page holding `offset`
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t lead = offset % page;
+    const size_t span = lead + bytes;
+    void* p = nullptr;
+    if (span > 0) {
+        const int prot = mapping == MEMORY_READ_ONLY ? PROT_READ : PROT_READ | PROT_WRITE;
+        p = mmap(nullptr, span, prot, MAP_PRIVATE, fd, static_cast<off_t>(offset - lead));
+    }
+    close(fd); // the mapping keeps the file alive
+    if (p == MAP_FAILED) throw runtime_error("map_file: mmap of " + path + " failed");
+
+    unmap();
+    heap.clear();
+    heap.shrink_to_fit();
+    mode = mapping;
+    if (!p) {
+        use_heap(); // empty range: nothing to map
+        return;
+    }
+    map_base = p;
+    map_length = span;
+    mapped_file = path;
+    base = static_cast<uint8_t*>(p) + lead;
+    length = bytes;
+}
+#else
+void Memory::map_file(const string& path, size_t offset, size_t bytes, MemoryMapping mapping) {
+    ifstream in(path, ios::binary);
+    if (!in) throw runtime_error("map_file: cannot open " + path);
+    vector<uint8_t> contents(bytes);
+    in.seekg(static_cast<streamoff>(offset));
+    if (!in.read(reinterpret_cast<char*>(contents.data()), static_cast<streamsize>(bytes))) {
+        throw runtime_error("map_file: " + path + " is shorter than the mapped range");
+    }
+    unmap();
+    heap = move(contents);
+    mode = mapping;
+    use_heap();
+}
+#endif
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#define YATTA_MMAP 1
+#else
+#define YATTA_MMAP 0
+#endif
+
+enum MemoryMapping : uint8_t {
+    MEMORY_READ_ONLY = 0,    // shared read-only view of the file
+    MEMORY_COPY_ON_WRITE     // private view; writes never reach the file
+};
+
+// Instruction memory: either a zeroed heap buffer or a window onto a mapped
+// file, so a large image can run without being copied in first. Reads go
+// through data(); writers ask for writable(), which turns a read-only
+// mapping into a private heap copy first. Copy-on-write mappings are written
+// in place and the kernel copies only the pages touched.
+class Memory {
+public:
+    Memory() = default;
+    explicit Memory(size_t bytes) { assign(bytes); }
+    Memory(const Memory&) = delete;
+    Memory& operator=(const Memory&) = delete;
+    ~Memory() { unmap(); }
+
+    const uint8_t* data() const { return base; }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    const uint8_t* begin() const { return base; }
+    const uint8_t* end() const { return base + length; }
+    bool mapped() const { return map_base != nullptr; }
+    // The file behind a mapping, empty on the heap. Its pages can change
+    // under the mapping if something rewrites the file in place.
+    const std::string& file() const { return mapped_file; }
+
+    uint8_t* writable();
+    // Heap-backed `bytes` zero bytes, dropping any mapping
+    void assign(size_t bytes);
+    // Heap-backed, keeping the first min(size, bytes) bytes
+    void resize(size_t bytes);
+    // Map `bytes` of `path` starting at byte `offset`. Throws
+    // std::runtime_error if the file cannot be opened or is too short. Hosts
+    // without mmap read the range into the heap instead.
+    void map_file(const std::string& path, size_t offset, size_t bytes, MemoryMapping mode);
+
+private:
+    void unmap();
+    void use_heap();
+
+    std::vector<uint8_t> heap;
+    uint8_t* base = nullptr;
+    size_t length = 0;
+    void* map_base = nullptr; // whole mapping, from a page boundary
+    size_t map_length = 0;
+    MemoryMapping mode = MEMORY_READ_ONLY;
+    std::string mapped_file;
+};
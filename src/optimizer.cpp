@@ -0,0 +1,380 @@
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "cpu.hpp"
+#include "encoding.hpp"
+#include "optimizer.hpp"
+
+using namespace std;
+
+namespace {
+
+// What the pass knows about a location at one point in a block
+struct Value {
+    enum Kind : uint8_t { UNKNOWN, CONST, COPY } kind = UNKNOWN;
+    int v = 0; // the constant, or the register the location currently equals
+};
+
+bool same(const Value& a, const Value& b) {
+    return a.kind != Value::UNKNOWN && a.kind == b.kind && a.v == b.v;
+}
+
+bool is_trigger(const Instruction& m) { return m.dest_type == 3 && m.dest_value == 1; }
+bool is_halt(const Instruction& m) { return m.dest_type == 3 && m.dest_value == 5; }
+
+void make_unconditional(Instruction& m) {
+    m.cmp = CMP_NONE;
+    m.cond1_type = m.cond2_type = -1;
+    m.cond1 = m.cond2 = 0;
+}
+
+class Optimizer {
+public:
+    Optimizer(vector<Instruction>& prog, int reg_count, OptimizeStats& stats)
+        : prog(prog), regs(reg_count), stats(stats), alu(0, 1),
+          A0(reg_count), A1(reg_count + 1), A2(reg_count + 2), F(reg_count + 3), locations(static_cast<size_t>(reg_count) + 4),
+          removed(prog.size(), 0), safe(prog.size(), 0), folded(prog.size(), 0) {}
+
+    bool run(int& entry);
+
+private:
+    vector<Instruction>& prog;
+    const int regs;
+    OptimizeStats& stats;
+    Cpu alu; // evaluates folded triggers exactly as the engines do
+    const int A0, A1, A2, F;
+    const size_t locations; // registers, A0, A1, A2, then the flags as one
+    vector<Value> vals;
+    vector<uint8_t> removed, safe, folded;
+    bool changed = false; // by the current pass
+
+    // Location an operand reads, or -1 for constants, AF, HF and bad operands
+    int source_location(int type, int value) const {
+        if (type == 1 && value >= 0 && value < regs) return value;
+        if (type == 2 && value >= 0 && value <= 2) return A0 + value;
+        if (type == 3 && value >= 2 && value <= 4) return F;
+        return -1;
+    }
+    int dest_location(const Instruction& m) const {
+        if (m.dest_type == 1 && m.dest_value >= 0 && m.dest_value < regs) return m.dest_value;
+        if (m.dest_type == 2 && (m.dest_value == 1 || m.dest_value == 2)) return A0 + m.dest_value;
+        return -1;
+    }
+    bool operand_valid(int type, int value, bool condition) const {
+        switch (type) {
+        case 0: return true;
+        case 1: return value >= 0 && value < regs;
+        case 2: return value >= 0 && value <= 2;
+        case 3: return value >= 1 && value <= (condition ? 5 : 4);
+        default: return false; // PC operands never reach the pass
+        }
+    }
+    bool dest_valid(const Instruction& m) const {
+        switch (m.dest_type) {
+        case 0: case 4: return true;
+        case 3: return m.dest_value == 1 || m.dest_value == 5;
+        default: return dest_location(m) >= 0;
+        }
+    }
+
+    Value known(int type, int value) const {
+        if (type == 0) return { Value::CONST, value };
+        if (type == 3 && value == 1) return { Value::CONST, 0 }; // AF reads as consumed
+        const int loc = source_location(type, value);
+        if (loc < 0) return {};
+        const Value& v = vals[static_cast<size_t>(loc)];
+        if (loc == F) {
+            if (v.kind != Value::CONST) return {};
+            return { Value::CONST, (v.v >> (value - 2)) & 1 };
+        }
+        if (v.kind == Value::UNKNOWN && type == 1) return { Value::COPY, value };
+        return v;
+    }
+
+    // Replace an operand by what it is known to hold
+    void propagate(int& type, int& value, bool condition) {
+        const Value v = known(type, value);
+        const int held = v.v;
+        if (v.kind == Value::CONST && type != 0) {
+            if (condition && (held < INT16_MIN || held > INT16_MAX)) return; // packed condition operands are 16-bit
+            type = 0;
+            value = held;
+        }
+        else if (v.kind == Value::COPY && !(type == 1 && value == held)) {
+            type = 1;
+            value = held;
+        }
+        else {
+            return;
+        }
+        stats.propagated++;
+        changed = true;
+    }
+
+    // Forget every location that was a copy of register `r`
+    void clobber(int r) {
+        for (auto& v : vals) {
+            if (v.kind == Value::COPY && v.v == r) v = {};
+        }
+    }
+
+    bool trigger_safe(const Value& op) const {
+        const Value& lhs = vals[static_cast<size_t>(A1)];
+        const Value& rhs = vals[static_cast<size_t>(A2)];
+        if (op.kind == Value::CONST && op.v != 4) return true;
+        // DIV faults on zero, and INT_MIN / -1 is left to the engines
+        return rhs.kind == Value::CONST && rhs.v != 0 && (rhs.v != -1 || (lhs.kind == Value::CONST && lhs.v != INT_MIN));
+    }
+
+    void remove(size_t i, size_t& counter) {
+        removed[i] = 1;
+        counter++;
+        changed = true;
+    }
+
+    bool forward(size_t begin, size_t end);
+    bool backward(size_t begin, size_t end);
+};
+
+bool Optimizer::forward(size_t begin, size_t end) {
+    vals.assign(locations, Value{});
+    changed = false;
+
+    for (size_t i = begin; i < end; ++i) {
+        if (removed[i]) continue;
+        Instruction& m = prog[i];
+
+        // --- condition ---
+        bool conditional = m.cmp != CMP_NONE;
+        bool cond_ok = true;
+        if (conditional) {
+            cond_ok = operand_valid(m.cond1_type, m.cond1, true) && operand_valid(m.cond2_type, m.cond2, true);
+            if (cond_ok) {
+                propagate(m.cond1_type, m.cond1, true);
+                propagate(m.cond2_type, m.cond2, true);
+                if (m.cond1_type == 0 && m.cond2_type == 0) {
+                    stats.folded++;
+                    if (!compare(m.cmp, m.cond1, m.cond2)) {
+                        remove(i, stats.dead); // never taken
+                        continue;
+                    }
+                    make_unconditional(m);
+                    conditional = false;
+                    changed = true;
+                }
+            }
+        }
+
+        // --- source ---
+        const bool src_ok = operand_valid(m.source_type, m.source_value, false);
+        if (src_ok) propagate(m.source_type, m.source_value, false);
+        const Value v = src_ok ? known(m.source_type, m.source_value) : Value{};
+        const bool ok = cond_ok && src_ok && dest_valid(m) && (!is_trigger(m) || trigger_safe(v));
+        safe[i] = ok;
+
+        // --- moves with no effect ---
+        const int dest = dest_location(m);
+        if (ok && m.dest_type != 4) {
+            if (m.dest_type == 0 || (is_trigger(m) && v.kind == Value::CONST && v.v == 0)
+                || (is_halt(m) && v.kind == Value::CONST && v.v == 0)) {
+                remove(i, stats.dead);
+                continue;
+            }
+            if (dest >= 0 && (same(vals[static_cast<size_t>(dest)], v) || (v.kind == Value::COPY && v.v == dest))) {
+                remove(i, stats.reloads);
+                continue;
+            }
+        }
+
+        // --- effects ---
+        if (dest >= 0) {
+            if (dest < regs) clobber(dest);
+            vals[static_cast<size_t>(dest)] = conditional ? Value{} : v;
+        }
+        else if (is_trigger(m)) {
+            Value& result = vals[static_cast<size_t>(A0)];
+            Value& flags = vals[static_cast<size_t>(F)];
+            const Value& lhs = vals[static_cast<size_t>(A1)];
+            const Value& rhs = vals[static_cast<size_t>(A2)];
+            if (!ok || conditional || v.kind != Value::CONST) {
+                result = flags = {};
+            }
+            else if (v.v >= 1 && v.v <= 4 ? lhs.kind == Value::CONST && rhs.kind == Value::CONST : result.kind == Value::CONST) {
+                // fold: run the op on a scratch ALU
+                alu.alu[0] = result.v;
+                alu.alu[1] = lhs.v;
+                alu.alu[2] = rhs.v;
+                alu.alu_pending = 0;
+                alu.trigger_alu(v.v);
+                result = { Value::CONST, alu.read_alu_result() };
+                flags = { Value::CONST, static_cast<int>(alu.flags) };
+                folded[i] = 1;
+            }
+            else {
+                if (v.v >= 1 && v.v <= 4) result = {};
+                flags = {};
+            }
+        }
+    }
+    return changed;
+}
+
+bool Optimizer::backward(size_t begin, size_t end) {
+    // everything is observable where the block ends
+    vector<uint8_t> live(locations, 1);
+    changed = false;
+
+    for (size_t i = end; i-- > begin;) {
+        if (removed[i]) continue;
+        const Instruction& m = prog[i];
+        const bool conditional = m.cmp != CMP_NONE;
+
+        // the state after a possible halt is observable
+        if (is_halt(m)) fill(live.begin(), live.end(), 1);
+
+        // locations the move must write, and those it may write
+        int defs[2];
+        int def_count = 0;
+        bool must = !conditional;
+        const int dest = dest_location(m);
+        if (dest >= 0) defs[def_count++] = dest;
+        const bool op_known = is_trigger(m) && m.source_type == 0;
+        const int op = op_known ? m.source_value : 0;
+        if (is_trigger(m)) {
+            if (!op_known || (op >= 1 && op <= 4)) defs[def_count++] = A0;
+            defs[def_count++] = F;
+            if (!op_known) must = false; // op 0 writes nothing
+        }
+
+        if (safe[i] && def_count > 0) {
+            bool any_live = false;
+            for (int k = 0; k < def_count; ++k) any_live = any_live || live[static_cast<size_t>(defs[k])];
+            if (!any_live) {
+                remove(i, stats.dead);
+                continue;
+            }
+        }
+
+        if (must) {
+            for (int k = 0; k < def_count; ++k) live[static_cast<size_t>(defs[k])] = 0;
+        }
+        auto use = [&](int type, int value) {
+            const int loc = source_location(type, value);
+            if (loc >= 0) live[static_cast<size_t>(loc)] = 1;
+        };
+        if (conditional) {
+            use(m.cond1_type, m.cond1);
+            use(m.cond2_type, m.cond2);
+        }
+        use(m.source_type, m.source_value);
+        if (is_trigger(m)) {
+            if (!op_known || (op >= 1 && op <= 4)) {
+                live[static_cast<size_t>(A1)] = live[static_cast<size_t>(A2)] = 1;
+            }
+            if (!op_known || op < 1 || op > 4) live[static_cast<size_t>(A0)] = 1;
+        }
+        // the state before a possible fault is observable
+        if (!safe[i]) fill(live.begin(), live.end(), 1);
+    }
+    return changed;
+}
+
+bool Optimizer::run(int& entry) {
+    const size_t n = prog.size();
+    // blocks start at the entry point, every jump target and after every
+    // PC write; control flow must be fully static
+    vector<uint8_t> leader(n + 1, 0);
+    leader[0] = leader[n] = 1;
+    if (entry >= 0 && static_cast<size_t>(entry) < n) leader[static_cast<size_t>(entry)] = 1;
+    auto memory_unit = [](int type) { return type == 5 || type == 6; };
+    for (size_t i = 0; i < n; ++i) {
+        const Instruction& m = prog[i];
+        if (m.source_type == 4 || (m.cmp != CMP_NONE && (m.cond1_type == 4 || m.cond2_type == 4))) return false;
+        // the LSU and DMA address the image itself, so compacting it would
+        // move the data they see
+        if (memory_unit(m.source_type) || memory_unit(m.dest_type)
+            || (m.cmp != CMP_NONE && (memory_unit(m.cond1_type) || memory_unit(m.cond2_type)))) {
+            return false;
+        }
+        if (m.dest_type != 4) continue;
+        if (m.source_type != 0) return false;
+        leader[i + 1] = 1;
+        if (m.source_value >= 0 && static_cast<size_t>(m.source_value) < n) leader[static_cast<size_t>(m.source_value)] = 1;
+    }
+
+    vector<pair<size_t, size_t>> blocks;
+    for (size_t b = 0; b < n;) {
+        size_t e = b + 1;
+        while (!leader[e]) ++e;
+        blocks.push_back({ b, e });
+        b = e;
+    }
+    for (const auto& block : blocks) {
+        // alternate until neither pass finds anything more
+        for (int round = 0; round < 8; ++round) {
+            const bool f = forward(block.first, block.second);
+            const bool b = backward(block.first, block.second);
+            if (!f && !b) break;
+        }
+    }
+
+    for (size_t i = 0; i < n; ++i) stats.folded += folded[i];
+
+    // compact, then renumber jump targets; a target whose moves all went
+    // lands on the next move that stayed
+    vector<int> renumber(n + 1);
+    int kept = 0;
+    for (size_t i = 0; i < n; ++i) {
+        renumber[i] = kept;
+        if (!removed[i]) prog[static_cast<size_t>(kept++)] = prog[i];
+    }
+    renumber[n] = kept;
+    const int dropped = static_cast<int>(n) - kept;
+    prog.resize(static_cast<size_t>(kept));
+    auto target = [&](int pc) {
+        if (pc < 0) return pc;
+        return static_cast<size_t>(pc) <= n ? renumber[static_cast<size_t>(pc)] : pc - dropped;
+    };
+    for (auto& m : prog) {
+        if (m.dest_type == 4) m.source_value = target(m.source_value);
+    }
+    // an entry point must stay a valid start address even if nothing from
+    // it on survived
+    const bool entry_inside = entry >= 0 && static_cast<size_t>(entry) < n;
+    entry = target(entry);
+    if (entry_inside && entry == kept) prog.push_back({ 0, 0, 0, 0, CMP_NONE, -1, 0, -1, 0 });
+    return true;
+}
+
+} // namespace
+
+OptimizeStats optimize_program(vector<Instruction>& prog, int width, int& entry, int reg_count) {
+    OptimizeStats stats;
+    stats.moves_before = stats.moves_after = prog.size();
+    if (width != 1 || prog.empty() || reg_count < 0) return stats;
+
+    vector<Instruction> work = prog;
+    Optimizer pass(work, reg_count, stats);
+    int new_entry = entry;
+    if (!pass.run(new_entry)) return OptimizeStats{ prog.size(), prog.size() };
+    prog.swap(work);
+    entry = new_entry;
+    stats.moves_after = prog.size();
+    return stats;
+}
+
+OptimizeStats optimize_image(ImageHeader& header, vector<uint8_t>& body, int reg_count) {
+    vector<Instruction> prog(header.count);
+    for (size_t i = 0; i < prog.size(); ++i) prog[i] = decode_instruction(body.data() + i * INSTR_SLOT_SIZE);
+    int entry = static_cast<int>(header.entry);
+    OptimizeStats stats = optimize_program(prog, header.width, entry, reg_count);
+
+    body.assign(prog.size() * INSTR_SLOT_SIZE, 0);
+    for (size_t i = 0; i < prog.size(); ++i) encode_instruction(prog[i], body.data() + i * INSTR_SLOT_SIZE);
+    header.count = static_cast<uint32_t>(prog.size());
+    header.entry = static_cast<uint32_t>(entry);
+    return stats;
+}
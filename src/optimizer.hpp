@@ -0,0 +1,37 @@
+#pragma once
+
+#include "cpu.hpp"
+#include "encoding.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct OptimizeStats {
+    size_t moves_before = 0, moves_after = 0;
+    size_t dead = 0;       // moves whose result is overwritten before any read
+    size_t reloads = 0;    // moves that store what the destination already holds
+    size_t folded = 0;     // ALU triggers and conditions evaluated at assembly time
+    size_t propagated = 0; // operands replaced by a constant or an earlier copy
+};
+
+// Optional pass between decode_program and put_program. Works block by block
+// (a block ends at every PC write and starts at every jump target) and keeps
+// the machine state at each block boundary, at every HF write and before every
+// move that can fault exactly as the original program leaves it; only the
+// moves in between change. Removed moves are compacted out, and jump targets
+// and `entry` are renumbered to match, so PC values differ from the original.
+//
+// Programs whose control flow is not known statically (a PC write from
+// anything but a constant, or any read of PC), programs that use the LSU or
+// DMA (they address the image) and bundled programs (`width` > 1) are
+// returned unchanged. `reg_count` is the register file size
+// the program will run with; accesses outside it are left alone so they
+// still fault. Only the first ALU is modelled: moves naming ALU1 and up are
+// kept like moves that may fault, and so are moves touching TF. A trap
+// vector (Cpu::trap_vector) is a jump target the pass cannot see, so a
+// program that sets one should not be optimized.
+OptimizeStats optimize_program(std::vector<Instruction>& prog, int width, int& entry, int reg_count);
+
+// optimize_program over a packed image body (see encoding.hpp), updating the
+// header's count and entry point to match
+OptimizeStats optimize_image(ImageHeader& header, std::vector<uint8_t>& body, int reg_count);
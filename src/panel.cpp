@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "panel.hpp"
+
+using namespace std;
+
+// Word layout after the registers
+enum : size_t { W_BUSES, W_BUS, W_ALU = W_BUS + PANEL_MAX_BUSES, W_FLAGS = W_ALU + 3, W_PC, W_HALTED, W_RUNNING,
+    W_CYCLES_LO, W_CYCLES_HI, W_STAMP_LO, W_STAMP_HI, W_COUNT };
+
+PanelFeed::PanelFeed(int regs) : reg_count(static_cast<size_t>(regs)), word_count(reg_count + W_COUNT),
+    words(new atomic<uint32_t>[reg_count + W_COUNT]) {
+    for (size_t i = 0; i < word_count; ++i) words[i].store(0, memory_order_relaxed);
+}
+
+void PanelFeed::publish(Cpu& cpu, bool running) {
+    cpu.settle_alu();
+    const uint64_t stamp = static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count());
+    const size_t buses = min(cpu.bus.size(), static_cast<size_t>(PANEL_MAX_BUSES));
+    auto put = [&](size_t i, uint32_t v) { words[i].store(v, memory_order_relaxed); };
+
+    const uint64_t seq = sequence.load(memory_order_relaxed);
+    sequence.store(seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    const size_t n = min(reg_count, cpu.regs.size());
+    for (size_t i = 0; i < n; ++i) put(i, cpu.regs[i]);
+    const size_t base = reg_count;
+    put(base + W_BUSES, static_cast<uint32_t>(buses));
+    for (size_t i = 0; i < buses; ++i) put(base + W_BUS + i, cpu.bus[i]);
+    for (size_t i = 0; i < 3; ++i) put(base + W_ALU + i, static_cast<uint32_t>(cpu.alu[i]));
+    put(base + W_FLAGS, cpu.flags);
+    put(base + W_PC, static_cast<uint32_t>(cpu.pc));
+    put(base + W_HALTED, static_cast<uint32_t>(cpu.halted));
+    put(base + W_RUNNING, running);
+    put(base + W_CYCLES_LO, static_cast<uint32_t>(cpu.cycles));
+    put(base + W_CYCLES_HI, static_cast<uint32_t>(cpu.cycles >> 32));
+    put(base + W_STAMP_LO, static_cast<uint32_t>(stamp));
+    put(base + W_STAMP_HI, static_cast<uint32_t>(stamp >> 32));
+    sequence.store(seq + 2, memory_order_release);
+}
+
+PanelFrame PanelFeed::read() const {
+    vector<uint32_t> copy(word_count);
+    for (;;) {
+        const uint64_t before = sequence.load(memory_order_acquire);
+        if (before & 1) {
+            this_thread::yield();
+            continue;
+        }
+        for (size_t i = 0; i < word_count; ++i) copy[i] = words[i].load(memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if (sequence.load(memory_order_relaxed) == before) break;
+    }
+
+    PanelFrame frame;
+    const size_t base = reg_count;
+    frame.regs.assign(copy.begin(), copy.begin() + static_cast<ptrdiff_t>(reg_count));
+    const size_t buses = min<size_t>(copy[base + W_BUSES], PANEL_MAX_BUSES);
+    frame.bus.assign(copy.begin() + static_cast<ptrdiff_t>(base + W_BUS), copy.begin() + static_cast<ptrdiff_t>(base + W_BUS + buses));
+    for (size_t i = 0; i < 3; ++i) frame.alu[i] = static_cast<int>(copy[base + W_ALU + i]);
+    frame.flags = copy[base + W_FLAGS];
+    frame.pc = static_cast<int>(copy[base + W_PC]);
+    frame.halted = static_cast<int>(copy[base + W_HALTED]);
+    frame.running = copy[base + W_RUNNING] != 0;
+    frame.cycles = copy[base + W_CYCLES_LO] | static_cast<uint64_t>(copy[base + W_CYCLES_HI]) << 32;
+    frame.stamp_ns = copy[base + W_STAMP_LO] | static_cast<uint64_t>(copy[base + W_STAMP_HI]) << 32;
+    return frame;
+}
+
+// Fields in draw order
+enum : size_t { F_STATE, F_PC, F_CYCLES, F_IPS, F_ALU0, F_ALU1, F_ALU2, F_FLAGS, F_FIXED };
+
+// Registers and buses are laid out four to a row
+constexpr int PER_ROW = 4;
+constexpr int CELL = 18;
+
+static string rate_text(double ips) {
+    char text[32];
+    if (ips >= 1e9) snprintf(text, sizeof text, "%.2f G", ips / 1e9);
+    else if (ips >= 1e6) snprintf(text, sizeof text, "%.2f M", ips / 1e6);
+    else if (ips >= 1e3) snprintf(text, sizeof text, "%.2f k", ips / 1e3);
+    else snprintf(text, sizeof text, "%.0f", ips);
+    return text;
+}
+
+static string goto_cell(int row, int col) {
+    return "\x1b[" + to_string(row) + ";" + to_string(col) + "H";
+}
+
+void PanelView::set(string& out, size_t field, const string& text) {
+    Field& f = fields[field];
+    if (f.shown == text) return;
+    string padded = text.substr(0, static_cast<size_t>(f.width));
+    padded.resize(static_cast<size_t>(f.width), ' ');
+    out += goto_cell(f.row, f.col) + padded;
+    f.shown = text;
+}
+
+string PanelView::draw(const PanelFrame& frame, double ips) {
+    string out;
+    if (fields.empty() || frame.regs.size() != regs || frame.bus.size() != buses) {
+        // lay out the labels once; every field starts out unshown
+        regs = frame.regs.size();
+        buses = frame.bus.size();
+        fields.assign(F_FIXED, Field{ 0, 0, 0, {} });
+        out += "\x1b[?25l\x1b[2J\x1b[H";
+        out += "yatta front panel                                   q to quit\n\n";
+        out += "State              PC                Cycles                 IPS\n";
+        out += "A0                 A1                A2                     Flags\n";
+        fields[F_STATE] = { 3, 7, 12, {} };
+        fields[F_PC] = { 3, 23, 14, {} };
+        fields[F_CYCLES] = { 3, 45, 16, {} };
+        fields[F_IPS] = { 3, 65, 12, {} };
+        fields[F_ALU0] = { 4, 4, 14, {} };
+        fields[F_ALU1] = { 4, 23, 14, {} };
+        fields[F_ALU2] = { 4, 41, 14, {} };
+        fields[F_FLAGS] = { 4, 67, 10, {} };
+        int row = 6;
+        auto lay_out = [&](size_t count, char prefix) {
+            for (size_t i = 0; i < count; ++i) {
+                const int r = row + static_cast<int>(i) / PER_ROW;
+                const int col = 1 + static_cast<int>(i % PER_ROW) * CELL;
+                const string label = prefix + to_string(i) + "=";
+                out += goto_cell(r, col) + label;
+                fields.push_back({ r, col + static_cast<int>(label.size()), CELL - 1 - static_cast<int>(label.size()), {} });
+            }
+            row += (static_cast<int>(count) + PER_ROW - 1) / PER_ROW + 1;
+        };
+        lay_out(regs, 'R');
+        lay_out(buses, 'B');
+        rows = row;
+    }
+
+    set(out, F_STATE, frame.halted ? "halted" : frame.running ? "running" : "stopped");
+    set(out, F_PC, to_string(frame.pc));
+    set(out, F_CYCLES, to_string(frame.cycles));
+    set(out, F_IPS, rate_text(ips));
+    set(out, F_ALU0, to_string(frame.alu[0]));
+    set(out, F_ALU1, to_string(frame.alu[1]));
+    set(out, F_ALU2, to_string(frame.alu[2]));
+    string flags;
+    flags += frame.flags & FLAG_ZF ? "ZF " : "-- ";
+    flags += frame.flags & FLAG_NF ? "NF " : "-- ";
+    flags += frame.flags & FLAG_OF ? "OF" : "--";
+    set(out, F_FLAGS, flags);
+    for (size_t i = 0; i < regs; ++i) set(out, F_FIXED + i, to_string(frame.regs[i]));
+    for (size_t i = 0; i < buses; ++i) set(out, F_FIXED + regs + i, to_string(frame.bus[i]));
+    if (!out.empty()) out += goto_cell(rows, 1);
+    return out;
+}
+
+string PanelView::close() const {
+    return goto_cell(rows, 1) + "\x1b[?25h";
+}
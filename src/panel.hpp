@@ -0,0 +1,67 @@
+#pragma once
+
+#include "cpu.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Cycles an engine runs between publications while it runs unattended
+constexpr uint64_t PANEL_SLICE = 1 << 16;
+// Buses beyond this many are not shown
+constexpr int PANEL_MAX_BUSES = 16;
+
+// What the front panel shows, as of one publication
+struct PanelFrame {
+    std::vector<unsigned int> regs;
+    std::vector<unsigned int> bus;
+    int alu[3] = { 0, 0, 0 };
+    uint32_t flags = 0;
+    int pc = 0;
+    int halted = 0;
+    bool running = false;  // an engine was still going when it published
+    uint64_t cycles = 0;
+    uint64_t stamp_ns = 0; // steady clock at publication, for rates
+};
+
+// Machine state handed from the thread running the machine to any number
+// of viewers through a seqlock: the writer never waits, and a reader copies
+// the words and retries if a publication overlapped, so it never sees a mix
+// of two. The words are relaxed atomics, which keeps the overlap well
+// defined.
+class PanelFeed {
+public:
+    explicit PanelFeed(int regs);
+    // Writer side; settles a pending ALU op first so A0 and the flags are current
+    void publish(Cpu& cpu, bool running);
+    PanelFrame read() const;
+
+private:
+    size_t reg_count;
+    size_t word_count;
+    std::atomic<uint64_t> sequence{0}; // odd while a publication is in progress
+    std::unique_ptr<std::atomic<uint32_t>[]> words;
+};
+
+// Draws frames with ANSI cursor addressing. The first frame lays out the
+// screen; after that only fields whose text changed are rewritten.
+class PanelView {
+public:
+    // Escape sequences that bring the screen up to `frame`; `ips` is shown
+    // as the live rate
+    std::string draw(const PanelFrame& frame, double ips);
+    // Put the cursor back below the panel and show it again
+    std::string close() const;
+
+private:
+    struct Field {
+        int row, col, width;
+        std::string shown;
+    };
+    void set(std::string& out, size_t field, const std::string& text);
+    std::vector<Field> fields;
+    size_t regs = 0, buses = 0;
+    int rows = 0;
+};
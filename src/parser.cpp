@@ -52,7 +52,18 @@ vector<RawInstruction> parse_program_lines(const vector<string>& lines) {
     for (const auto& l : lines) {
         string s = trim(l);
         if (s.empty() || s[0] == ';') continue; // skip blank lines
-        out.push_back(parse_raw_instruction(s));
+        // moves separated by '|' share one bundle
+        size_t start = 0;
+        bool parallel = false;
+        while (true) {
+            size_t bar = s.find('|', start);
+            RawInstruction instr = parse_raw_instruction(s.substr(start, bar == string::npos ? string::npos : bar - start));
+            instr.parallel = parallel;
+            out.push_back(instr);
+            if (bar == string::npos) break;
+            start = bar + 1;
+            parallel = true;
+        }
     }
     return out;
 }
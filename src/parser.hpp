@@ -9,5 +9,6 @@ std::string trim(const std::string& str);
 // Throws std::runtime_error on parse errors.
 RawInstruction parse_raw_instruction(const std::string& line);
 
-// Convenience: parse multiple lines.
+// Convenience: parse multiple lines. Moves on one line separated by '|'
+// ("R0 A1 | R1 A2") form a bundle; each but the first is marked parallel.
 std::vector<RawInstruction> parse_program_lines(const std::vector<std::string>& lines);
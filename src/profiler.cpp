@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "assembler.hpp"
+#include "encoding.hpp"
+#include "profiler.hpp"
+
+using namespace std;
+
+// "pc: move | move" for bundles inside the image, "pc" beyond it
+static string pc_label(const uint8_t* image, size_t image_bytes, int width, int pc) {
+    const size_t bundle_bytes = static_cast<size_t>(width) * INSTR_SLOT_SIZE;
+    if (pc < 0 || (static_cast<size_t>(pc) + 1) * bundle_bytes > image_bytes) return to_string(pc);
+    string label = to_string(pc) + ":";
+    for (int i = 0; i < width; ++i) {
+        label += i == 0 ? " " : " | ";
+        label += disassemble(decode_instruction(image + static_cast<size_t>(pc) * bundle_bytes + static_cast<size_t>(i) * INSTR_SLOT_SIZE));
+    }
+    return label;
+}
+
+static double percent(uint64_t part, uint64_t whole) {
+    return whole ? 100.0 * static_cast<double>(part) / static_cast<double>(whole) : 0.0;
+}
+
+// Taken jumps in a stable order
+static vector<pair<uint64_t, uint64_t>> sorted_edges(const Profile& profile) {
+    vector<pair<uint64_t, uint64_t>> edges(profile.edges.begin(), profile.edges.end());
+    sort(edges.begin(), edges.end());
+    return edges;
+}
+
+uint64_t Profile::cycles() const {
+    uint64_t total = 0;
+    for (const PcCounters& c : pcs) total += c.executed;
+    return total;
+}
+
+vector<ProfileLoop> Profile::loops() const {
+    vector<ProfileLoop> found;
+    for (const auto& [key, count] : sorted_edges(*this)) {
+        const int from = static_cast<int>(static_cast<uint32_t>(key >> 32));
+        const int to = static_cast<int>(static_cast<uint32_t>(key));
+        if (to < 0 || to > from) continue;
+        auto it = find_if(found.begin(), found.end(), [&](const ProfileLoop& l) { return l.head == to; });
+        if (it == found.end()) {
+            found.push_back({ to, from, 0, 0 });
+            it = found.end() - 1;
+        }
+        it->tail = max(it->tail, from);
+        it->iterations += count;
+    }
+    for (ProfileLoop& loop : found) {
+        const size_t end = min(static_cast<size_t>(loop.tail) + 1, pcs.size());
+        for (size_t pc = static_cast<size_t>(loop.head); pc < end; ++pc) loop.cycles += pcs[pc].executed;
+    }
+    sort(found.begin(), found.end(), [](const ProfileLoop& a, const ProfileLoop& b) {
+        return a.cycles != b.cycles ? a.cycles > b.cycles : a.head < b.head;
+    });
+    return found;
+}
+
+void Profile::write_report(ostream& out, const uint8_t* image, size_t image_bytes, int width, size_t top) const {
+    const uint64_t total = cycles();
+    vector<int> hot;
+    for (size_t pc = 0; pc < pcs.size(); ++pc) {
+        if (pcs[pc].executed) hot.push_back(static_cast<int>(pc));
+    }
+    out << total << " cycles over " << hot.size() << " PCs" << endl;
+    if (hot.empty()) return;
+
+    stable_sort(hot.begin(), hot.end(), [&](int a, int b) {
+        return pcs[static_cast<size_t>(a)].executed > pcs[static_cast<size_t>(b)].executed;
+    });
+    if (hot.size() > top) hot.resize(top);
+    const ios::fmtflags saved = out.flags();
+    out << fixed << setprecision(1);
+    out << "Hottest:\n" << setw(12) << "cycles" << setw(8) << "%" << setw(12) << "passed" << setw(12) << "failed" << "  move" << '\n';
+    for (int pc : hot) {
+        const PcCounters& c = pcs[static_cast<size_t>(pc)];
+        out << setw(12) << c.executed << setw(7) << percent(c.executed, total) << '%';
+        if (c.passed || c.failed) out << setw(12) << c.passed << setw(12) << c.failed;
+        else out << setw(12) << "-" << setw(12) << "-";
+        out << "  " << pc_label(image, image_bytes, width, pc) << '\n';
+    }
+
+    const vector<ProfileLoop> found = loops();
+    if (!found.empty()) {
+        out << "Loops:\n" << setw(12) << "cycles" << setw(8) << "%" << setw(12) << "iterations" << "  PCs" << '\n';
+        for (const ProfileLoop& loop : found) {
+            out << setw(12) << loop.cycles << setw(7) << percent(loop.cycles, total) << '%' << setw(12) << loop.iterations
+                << "  " << loop.head << "-" << loop.tail << "  (" << pc_label(image, image_bytes, width, loop.head) << ")\n";
+        }
+    }
+    out.flags(saved);
+    out.flush();
+}
+
+void Profile::write_folded(ostream& out, const uint8_t* image, size_t image_bytes, int width) const {
+    // outermost loops first, so each PC's frames nest outside in
+    vector<ProfileLoop> found = loops();
+    sort(found.begin(), found.end(), [](const ProfileLoop& a, const ProfileLoop& b) {
+        return a.tail - a.head != b.tail - b.head ? a.tail - a.head > b.tail - b.head : a.head < b.head;
+    });
+    for (size_t pc = 0; pc < pcs.size(); ++pc) {
+        if (!pcs[pc].executed) continue;
+        const int at = static_cast<int>(pc);
+        string stack = "program";
+        for (const ProfileLoop& loop : found) {
+            if (loop.head <= at && at <= loop.tail) stack += ";loop " + to_string(loop.head) + "-" + to_string(loop.tail);
+        }
+        out << stack << ';' << pc_label(image, image_bytes, width, at) << ' ' << pcs[pc].executed << '\n';
+    }
+}
+
+void Profile::write_dot(ostream& out, const uint8_t* image, size_t image_bytes, int width) const {
+    const vector<pair<uint64_t, uint64_t>> edges_in_order = sorted_edges(*this);
+    vector<int> nodes;
+    for (const auto& edge : edges_in_order) {
+        nodes.push_back(static_cast<int>(static_cast<uint32_t>(edge.first >> 32)));
+        nodes.push_back(static_cast<int>(static_cast<uint32_t>(edge.first)));
+    }
+    sort(nodes.begin(), nodes.end());
+    nodes.erase(unique(nodes.begin(), nodes.end()), nodes.end());
+
+    out << "digraph jumps {\n  node [shape=box, fontname=monospace];\n";
+    for (int pc : nodes) {
+        const uint64_t executed = pc >= 0 && static_cast<size_t>(pc) < pcs.size() ? pcs[static_cast<size_t>(pc)].executed : 0;
+        out << "  n" << static_cast<uint32_t>(pc) << " [label=\"" << pc_label(image, image_bytes, width, pc) << "\\n"
+            << executed << " cycles\"];\n";
+    }
+    for (const auto& [key, count] : edges_in_order) {
+        out << "  n" << static_cast<uint32_t>(key >> 32) << " -> n" << static_cast<uint32_t>(key) << " [label=\"" << count << "\"];\n";
+    }
+    out << "}\n";
+}
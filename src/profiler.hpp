@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <unordered_map>
+#include <vector>
+
+// Execution counts gathered by the interpreter while Computer::profile points
+// at a Profile. Everything is indexed by PC, i.e. by bundle.
+struct PcCounters {
+    uint64_t executed = 0; // cycles issued at this PC
+    uint64_t passed = 0;   // guarded moves whose condition held
+    uint64_t failed = 0;   // guarded moves skipped
+};
+
+// A back edge (a taken PC write from `tail` to `head` <= `tail`) and the
+// straight-line range it closes
+struct ProfileLoop {
+    int head = 0, tail = 0;
+    uint64_t iterations = 0; // times the back edge was taken
+    uint64_t cycles = 0;     // cycles spent at PCs head..tail
+};
+
+class Profile {
+public:
+    std::vector<PcCounters> pcs;
+    // taken PC writes, keyed by edge_key(from, to)
+    std::unordered_map<uint64_t, uint64_t> edges;
+
+    static uint64_t edge_key(int from, int to) {
+        return static_cast<uint64_t>(static_cast<uint32_t>(from)) << 32 | static_cast<uint32_t>(to);
+    }
+    void clear() { pcs.clear(); edges.clear(); }
+    // Make room for `bundle_count` PCs, keeping the counts gathered so far
+    void cover(size_t bundle_count) { if (pcs.size() < bundle_count) pcs.resize(bundle_count); }
+
+    uint64_t cycles() const;
+    // Back edges merged per head, widest tail kept; hottest first
+    std::vector<ProfileLoop> loops() const;
+
+    // The reports read moves back from the packed image (see encoding.hpp)
+    // so they can show each PC as assembly.
+
+    // Summary: the `top` hottest PCs with their condition outcomes, then loops
+    void write_report(std::ostream& out, const uint8_t* image, size_t image_bytes, int width, size_t top) const;
+    // Folded stacks ("frame;frame count" lines) for flamegraph.pl and
+    // compatible tools: each PC is a leaf under the loops that enclose it,
+    // weighted by cycles
+    void write_folded(std::ostream& out, const uint8_t* image, size_t image_bytes, int width) const;
+    // The taken jumps as a Graphviz digraph, edges labelled with counts
+    void write_dot(std::ostream& out, const uint8_t* image, size_t image_bytes, int width) const;
+};
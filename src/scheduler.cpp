@@ -0,0 +1,33 @@
+#include <stdexcept>
+
+#include "computer.hpp"
+#include "scheduler.hpp"
+
+using namespace std;
+
+Scheduler::Scheduler(uint64_t quantum_) : quantum(quantum_) {
+    if (quantum == 0) throw runtime_error("Scheduler: quantum must be at least one cycle");
+}
+
+size_t Scheduler::add(unique_ptr<Computer> guest) {
+    if (!guest) throw runtime_error("Scheduler::add: null guest");
+    const size_t id = guests.size();
+    guests.push_back(Guest{ move(guest), RUN_BUDGET_EXHAUSTED });
+    ready.push_back(id);
+    return id;
+}
+
+size_t Scheduler::round() {
+    for (size_t n = ready.size(); n > 0; --n) {
+        const size_t id = ready.front();
+        ready.pop_front();
+        Guest& g = guests[id];
+        g.status = g.computer->run_for(quantum);
+        if (g.status == RUN_BUDGET_EXHAUSTED) ready.push_back(id);
+    }
+    return ready.size();
+}
+
+void Scheduler::run() {
+    while (round() > 0) {}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "computer.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+// Multiplexes many Computers on the calling thread. Each round gives every
+// guest that is still running one quantum of Computer::run_for, in turn, so
+// a guest waits at most one quantum per other runnable guest before it runs
+// again, and a runaway guest only ever costs its own quanta.
+class Scheduler {
+public:
+    explicit Scheduler(uint64_t quantum = 10000);
+
+    // Guests resume from their current cpu.pc; returns the guest id
+    size_t add(std::unique_ptr<Computer> guest);
+
+    Computer& guest(size_t id) { return *guests[id].computer; }
+    RunStatus status(size_t id) const { return guests[id].status; }
+    size_t size() const { return guests.size(); }
+    size_t runnable() const { return ready.size(); }
+
+    // One quantum for every runnable guest; returns how many remain runnable
+    size_t round();
+    // Rounds until every guest has halted, left its image or faulted
+    void run();
+
+    uint64_t quantum;
+
+private:
+    struct Guest {
+        std::unique_ptr<Computer> computer;
+        RunStatus status = RUN_BUDGET_EXHAUSTED;
+    };
+    std::vector<Guest> guests;
+    std::deque<size_t> ready; // ids in run order
+};
@@ -1,7 +1,11 @@
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <thread>
+#include <filesystem>
 #include <fstream>
 #include <iterator>
+#include <memory>
 #include <string>
 #include <stdexcept>
 #include <cctype>
@@ -23,13 +27,39 @@
 #include "cpu.hpp"
 #include "assembler.hpp"
 #include "computer.hpp"
+#include "encoding.hpp"
+#include "optimizer.hpp"
+#include "panel.hpp"
 #include "parser.hpp"
+#include "profiler.hpp"
 #include "shell.hpp"
+#include "snapshot.hpp"
+#include "telemetry.hpp"
+#include "trace.hpp"
 
 using namespace std;
 
 // --- FRONT PANEL IMPLEMENTATION (Platform Specific) ---
 
+// Live rate between two publications of the same run
+static double panel_rate(const PanelFrame& earlier, const PanelFrame& later) {
+    if (!later.running || later.stamp_ns <= earlier.stamp_ns || later.cycles < earlier.cycles) return 0;
+    return static_cast<double>(later.cycles - earlier.cycles) * 1e9 / static_cast<double>(later.stamp_ns - earlier.stamp_ns);
+}
+
+// One refresh: the panel only reads what the running engine published, so
+// it never touches comp.cpu while another thread is executing
+static void refresh_panel(Computer& comp, PanelView& view, PanelFrame& last, double& ips) {
+    PanelFrame frame = comp.panel.read();
+    if (frame.stamp_ns != last.stamp_ns) {
+        ips = panel_rate(last, frame);
+        last = frame;
+    }
+    if (!frame.running) ips = 0;
+    cout << view.draw(frame, ips);
+    cout.flush();
+}
+
 #if os == 1
 void frontPanel(Computer& comp) {
     struct termios old_settings, new_settings;
@@ -51,19 +81,12 @@ void frontPanel(Computer& comp) {
         return;
     }
 
+    PanelView view;
+    PanelFrame last = comp.panel.read();
+    double ips = 0;
     bool running = true;
     while (running) {
-        // Clear screen and reset cursor (POSIX ANSI escape codes)
-        system("clear");
-
-        comp.cpu.print_register_file();
-        cout << "\n[ BUS State ] ";
-        for (int i = 0; i < comp.bus_num; ++i) {
-            cout << "B" << i << "=" << comp.cpu.bus[i] << (i < comp.bus_num - 1 ? " | " : "");
-        }
-        cout << endl;
-        cout << "\nPress 'q' to quit front panel." << endl;
-        cout.flush();
+        refresh_panel(comp, view, last, ips);
 
         // --- Non-blocking Input with Select (POSIX) ---
         fd_set rfds;
@@ -89,6 +112,7 @@ void frontPanel(Computer& comp) {
         }
         // else timeout -> loop and refresh display
     }
+    cout << view.close() << endl;
 
     // Restore terminal settings
     if (tcsetattr(STDIN_FILENO, TCSANOW, &old_settings) == -1) {
@@ -98,19 +122,19 @@ void frontPanel(Computer& comp) {
 }
 #elif os == 2 // Windows Implementation
 void frontPanel(Computer& comp) {
+    // the panel draws with ANSI escapes, which the console only honours
+    // with virtual terminal processing on
+    HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD old_mode = 0;
+    const bool have_mode = GetConsoleMode(console, &old_mode) != 0;
+    if (have_mode) SetConsoleMode(console, old_mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+
+    PanelView view;
+    PanelFrame last = comp.panel.read();
+    double ips = 0;
     bool running = true;
     while (running) {
-        // Clear screen (Windows command)
-        system("cls");
-
-        comp.cpu.print_register_file();
-        cout << "\n[ BUS State ] ";
-        for (int i = 0; i < comp.bus_num; ++i) {
-            cout << "B" << i << "=" << comp.cpu.bus[i] << (i < comp.bus_num - 1 ? " | " : "");
-        }
-        cout << endl;
-        cout << "\nPress 'q' to quit front panel." << endl;
-        cout.flush();
+        refresh_panel(comp, view, last, ips);
 
         // --- Non-blocking Input with _kbhit (Windows) ---
         if (_kbhit()) {
@@ -123,7 +147,8 @@ void frontPanel(Computer& comp) {
         // Delay for screen refresh (200 ms)
         Sleep(200);
     }
-    // No terminal state restoration needed for _kbhit/system("cls")
+    cout << view.close() << endl;
+    if (have_mode) SetConsoleMode(console, old_mode);
 }
 #endif
 
@@ -149,83 +174,379 @@ vector<string> tok;
 
 void shell() {
     Computer c(128, 8, 1);
+    Snapshot saved; // last `snapshot`, for `restore` without a file
+    unique_ptr<Tracer> tracer; // while `trace` is on
+    unique_ptr<TelemetryExporter> exporter; // while `stats export` is on
+    // one run at a time; commands that touch the machine wait for `stop`
+    thread runner;
+    atomic<bool> running{false};
+    auto busy = [&running] {
+        if (!running.load()) return false;
+        cout << "A run is active; `stop` it first" << endl;
+        return true;
+    };
+    auto stop = [&c, &runner] {
+        c.request_stop();
+        if (runner.joinable()) runner.join();
+    };
     cout << "> ";
     while (getline(cin, raw)) {
         tok = splitString(raw, ' ');
         if (tok[0] == "exit") {
             break;
         }
+        else if (tok[0] == "stop") {
+            // stop: end the active run at its next slice and show state
+            stop();
+            c.cpu.print_register_file();
+            cout << "Status: " << run_status_name(c.status()) << endl;
+        }
         else if (tok[0] == "assemble") {
-            // assemble <src.asm> <out.bin>
+            // assemble <src.asm> <out.bin> [incremental]
             if (tok.size() < 3) {
-                cout << "Usage: assemble <src.asm> <out.bin>" << endl;
+                cout << "Usage: assemble <src.asm> <out.bin> [incremental]" << endl;
             } else {
                 string src = tok[1];
                 string out = tok[2];
+                const bool incremental = tok.size() >= 4 && tok[3] == "incremental";
                 try {
-                    // read source file lines
-                    ifstream ifs(src);
-                    if (!ifs) { cout << "Failed to open source: " << src << endl; }
-                    vector<string> lines;
-                    string line;
-                    while (std::getline(ifs, line)) lines.push_back(line);
-
-                    // parse and assemble
-                    auto raw = parse_program_lines(lines);
-                    auto encoded = decode_program(raw);
-                    vector<Instruction> prog;
-                    prog.reserve(encoded.size());
-                    for (auto &s : encoded) prog.push_back(s);
-
-                    // write binary file
-                    ofstream ofs(out, ios::binary);
-                    if (!ofs) { cout << "Failed to open output file: " << out << endl; }
-                    for (const auto &instr : prog) {
-                        ofs.write(reinterpret_cast<const char*>(&instr), sizeof(instr));
+                    if (!ifstream(src)) { cout << "Failed to open source: " << src << endl; continue; }
+                    // the loaded machine may be running straight off that file
+                    error_code ec;
+                    if (!c.memory.file().empty() && filesystem::equivalent(out, c.memory.file(), ec)) {
+                        cout << out << " is mapped by the loaded program; `load` another first" << endl;
+                        continue;
                     }
-                    cout << "Assembled " << src << " -> " << out << " (" << prog.size() << " instr)" << endl;
+                    AssemblyStats stats;
+                    if (incremental) {
+                        // patch the existing image using the line cache beside it
+                        stats = assemble_incremental(src, out);
+                    } else {
+                        // stream the source straight into a packed image; bundles
+                        // are as wide as the widest '|' group. Written beside the
+                        // output first so a failed assembly leaves it untouched
+                        const string partial = out + ".part";
+                        {
+                            ofstream ofs(partial, ios::binary);
+                            if (!ofs) { cout << "Failed to open output file: " << out << endl; continue; }
+                            try {
+                                stats = assemble_file(src, ofs);
+                            } catch (...) {
+                                ofs.close();
+                                filesystem::remove(partial);
+                                throw;
+                            }
+                        }
+                        filesystem::rename(partial, out);
+                    }
+                    cout << "Assembled " << src << " -> " << out << " (" << stats.moves << " instr";
+                    if (stats.width > 1) cout << " in " << stats.bundles << " bundles of " << stats.width;
+                    if (incremental) cout << ", " << stats.encoded << " of " << stats.bundles << " bundles re-encoded";
+                    cout << ")" << endl;
                 } catch (const std::exception &e) {
                     cout << "Assemble error: " << e.what() << endl;
                 }
             }
         }
+        else if (tok[0] == "optimize") {
+            // optimize <in.bin> <out.bin>; registers as on this machine
+            if (tok.size() < 3) {
+                cout << "Usage: optimize <in.bin> <out.bin>" << endl;
+            } else {
+                try {
+                    ifstream ifs(tok[1], ios::binary);
+                    if (!ifs) { cout << "Failed to open binary: " << tok[1] << endl; continue; }
+                    vector<uint8_t> body;
+                    ImageHeader header = read_image(ifs, body);
+                    OptimizeStats stats = optimize_image(header, body, c.reg_num);
+                    ofstream ofs(tok[2], ios::binary);
+                    if (!ofs) { cout << "Failed to open output file: " << tok[2] << endl; continue; }
+                    write_image_header(ofs, header);
+                    ofs.write(reinterpret_cast<const char*>(body.data()), static_cast<streamsize>(body.size()));
+                    cout << "Optimized " << tok[1] << " -> " << tok[2] << " (" << stats.moves_before << " -> " << stats.moves_after
+                         << " moves: " << stats.dead << " dead, " << stats.reloads << " reloads, " << stats.folded << " folded, "
+                         << stats.propagated << " propagated)" << endl;
+                } catch (const std::exception &e) {
+                    cout << "Optimize error: " << e.what() << endl;
+                }
+            }
+        }
         else if (tok[0] == "load") {
-            // load <file.bin>
+            // load <file.bin> [start address] [copy|map|cow]
+            if (busy()) continue;
             if (tok.size() < 2) {
-                cout << "Usage: load <file.bin> <start address>" << endl;
+                cout << "Usage: load <file.bin> [start address] [copy|map|cow]" << endl;
             }
             else {
                 string file = tok[1];
                 int start = 0;
                 if (tok.size() >= 3) start = stoi(tok[2]);
-                // read binary file into memory and run
-                ifstream ifs(file, ios::binary);
-                if (!ifs) { cout << "Failed to open binary: " << file << endl; }
-                vector<uint8_t> buf((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
-                if (buf.empty()) { cout << "Empty or unreadable binary: " << file << endl; }
-                // create Computer sized to file
-                int mem_bytes = static_cast<int>(buf.size()); 
-                // copy bytes into c.memory
-                c.memory.assign(buf.begin(), buf.end());
+                // copy reads the slots into memory; map and cow run the file in
+                // place (read-only, or privately writable) when start is 0
+                string how = tok.size() >= 4 ? tok[3] : "copy";
+                if (how != "copy" && how != "map" && how != "cow") {
+                    cout << "Unknown load mode: " << how << " (expected copy, map or cow)" << endl;
+                }
+                else if (how != "copy" && start != 0) {
+                    cout << "Mapped images load at address 0" << endl;
+                }
+                else {
+                    try {
+                        ImageHeader header;
+                        if (how == "copy") {
+                            ifstream ifs(file, ios::binary);
+                            if (!ifs) { cout << "Failed to open binary: " << file << endl; continue; }
+                            // validate the header and place the slots at start
+                            vector<uint8_t> body;
+                            header = read_image(ifs, body);
+                            c.load_image(header, body, start);
+                        } else {
+                            c.map_image(file, how == "map" ? MEMORY_READ_ONLY : MEMORY_COPY_ON_WRITE);
+                            header.count = static_cast<uint32_t>(c.memory.size() / INSTR_SLOT_SIZE);
+                            header.width = static_cast<uint16_t>(c.bundle_width);
+                        }
+                        cout << "Loaded " << file << " (" << header.count << " instr";
+                        if (header.width > 1) cout << " in " << header.count / header.width << " bundles of " << header.width;
+                        cout << ", entry " << c.entry_point << ")" << endl;
+                    } catch (const std::exception &e) {
+                        cout << "Load error: " << e.what() << endl;
+                    }
+                }
             }
         }
         else if (tok[0] == "run") {
-            // run <start address>
-            if (tok.size() < 2) {
-                cout << "Usage: run <start address>" << endl;
-                continue;
+            // run [start address] [interp|threaded|jit]; defaults to the image entry point
+            if (busy()) continue;
+            int start = c.entry_point;
+            if (tok.size() >= 2) {
+                if (!(isdigit(tok[1][0]) || (tok[1][0] == '-' && tok[1].size() > 1 && isdigit(tok[1][1])))) {
+                    cout << "Invalid start address: " << tok[1] << endl;
+                    continue;
+                }
+                start = stoi(tok[1]);
             }
-            if (!(isdigit(tok[1][0]) || (tok[1][0] == '-' && tok[1].size() > 1 && isdigit(tok[1][1])))) {
-                cout << "Invalid start address: " << tok[1] << endl;
+            string engine = tok.size() >= 3 ? tok[2] : "interp";
+            void (Computer::*run_fn)(int) = nullptr;
+            if (engine == "interp") run_fn = &Computer::run_from_ram;
+            else if (engine == "threaded") run_fn = &Computer::run_threaded;
+            else if (engine == "jit") run_fn = &Computer::run_jit;
+            else {
+                cout << "Unknown engine: " << engine << " (expected interp, threaded or jit)" << endl;
                 continue;
             }
             try {
-                thread t(&Computer::run_from_ram, &c, stoi(tok[1]));
-                t.detach();
+                // a fault ends the run, not the shell; telemetry counts it
+                if (runner.joinable()) runner.join(); // the last run, finished
+                c.cpu.halted = 0; // a program that halted runs again
+                c.request_stop(false); // here, so a quick `stop` still lands
+                running = true;
+                runner = thread([&c, &running, run_fn, start] {
+                    try {
+                        (c.*run_fn)(start);
+                    } catch (const std::exception &e) {
+                        cout << "\nRuntime error: " << e.what() << endl;
+                    }
+                    running = false;
+                });
             } catch (const std::exception &e) {
                 cout << "Runtime error: " << e.what() << endl;
             }
         }
+        else if (tok[0] == "step") {
+            // step [n]: interpret n cycles from the current PC, then show state
+            if (busy()) continue;
+            uint64_t n = 1;
+            if (tok.size() >= 2) {
+                try {
+                    n = stoull(tok[1]);
+                } catch (const std::exception &) {
+                    cout << "Invalid cycle count: " << tok[1] << endl;
+                    continue;
+                }
+            }
+            RunStatus status = c.step(n);
+            c.cpu.print_register_file();
+            cout << "Status: " << run_status_name(status);
+            if (status == RUN_FAULT) cout << " (" << c.fault << ")";
+            cout << endl;
+        }
+        else if (tok[0] == "profile") {
+            // profile [start address] [max cycles] [out]: interpret with per-PC
+            // counters, report the hottest moves and loops, and optionally
+            // write out.folded (flamegraph.pl input) and out.dot (jump graph)
+            if (busy()) continue;
+            int start = c.entry_point;
+            uint64_t max_cycles = 100000000;
+            try {
+                if (tok.size() >= 2) start = stoi(tok[1]);
+                if (tok.size() >= 3) max_cycles = stoull(tok[2]);
+            } catch (const std::exception &) {
+                cout << "Usage: profile [start address] [max cycles] [out]" << endl;
+                continue;
+            }
+            Profile prof;
+            c.profile = &prof;
+            c.cpu.pc = start;
+            c.cpu.increment_pc = true;
+            c.cpu.halted = 0; // as for run, a program that halted profiles again
+            RunStatus status = c.step(max_cycles);
+            c.profile = nullptr;
+            cout << "Status: " << run_status_name(status);
+            if (status == RUN_FAULT) cout << " (" << c.fault << ")";
+            cout << endl;
+            prof.write_report(cout, c.memory.data(), c.memory.size(), c.bundle_width, 10);
+            if (tok.size() >= 4) {
+                ofstream folded(tok[3] + ".folded"), dot(tok[3] + ".dot");
+                if (!folded || !dot) { cout << "Failed to open output files: " << tok[3] << ".folded/.dot" << endl; continue; }
+                prof.write_folded(folded, c.memory.data(), c.memory.size(), c.bundle_width);
+                prof.write_dot(dot, c.memory.data(), c.memory.size(), c.bundle_width);
+                cout << "Wrote " << tok[3] << ".folded and " << tok[3] << ".dot" << endl;
+            }
+        }
+        else if (tok[0] == "trace") {
+            // trace <file> | trace off: record every interpreted move (run
+            // interp, step, profile) to a binary trace; `yatta trace <file>`
+            // prints one. A run may be recording, so not while one is active
+            if (busy()) continue;
+            if (tok.size() < 2) {
+                cout << "Usage: trace <file> | trace off" << endl;
+                continue;
+            }
+            try {
+                if (tracer) {
+                    c.tracer = nullptr;
+                    tracer->stop();
+                    cout << "Traced " << tracer->records() << " moves to " << tracer->path;
+                    if (tracer->stalls()) cout << " (waited for the writer " << tracer->stalls() << " times)";
+                    cout << endl;
+                    tracer.reset();
+                }
+                if (tok[1] != "off") {
+                    tracer = make_unique<Tracer>(tok[1]);
+                    c.tracer = tracer.get();
+                    cout << "Tracing to " << tok[1] << endl;
+                }
+            } catch (const std::exception &e) {
+                tracer.reset();
+                cout << "Trace error: " << e.what() << endl;
+            }
+        }
+        else if (tok[0] == "stats") {
+            // stats: counters since startup, safe while a run is going
+            // stats export <file|unix:path> [interval ms] | stats export off:
+            // keep them available in Prometheus text format
+            if (tok.size() == 1) {
+                write_stats(cout, c.telemetry.sample());
+                if (exporter) cout << "Exporting to " << exporter->target << " (" << exporter->exports() << " exports)" << endl;
+            }
+            else if (tok[1] != "export" || tok.size() < 3) {
+                cout << "Usage: stats | stats export <file|unix:path> [interval ms] | stats export off" << endl;
+            }
+            else {
+                try {
+                    if (exporter) {
+                        exporter->stop();
+                        cout << "Stopped exporting to " << exporter->target << endl;
+                        exporter.reset();
+                    }
+                    if (tok[2] != "off") {
+                        const long long interval = tok.size() >= 4 ? stoll(tok[3]) : 1000;
+                        exporter = make_unique<TelemetryExporter>(c.telemetry, tok[2], chrono::milliseconds(interval));
+                        cout << "Exporting to " << tok[2] << endl;
+                    }
+                } catch (const std::exception &e) {
+                    exporter.reset();
+                    cout << "Stats error: " << e.what() << endl;
+                }
+            }
+        }
+        else if (tok[0] == "snapshot") {
+            // snapshot [file]: keep the machine state, optionally as a checkpoint file
+            if (busy()) continue;
+            try {
+                saved = c.snapshot();
+                if (tok.size() >= 2) {
+                    ofstream ofs(tok[1], ios::binary);
+                    if (!ofs) { cout << "Failed to open output file: " << tok[1] << endl; continue; }
+                    write_snapshot(ofs, saved);
+                }
+                cout << "Snapshot at PC " << saved.cpu.pc << ", cycle " << saved.cpu.cycles << endl;
+            } catch (const std::exception &e) {
+                cout << "Snapshot error: " << e.what() << endl;
+            }
+        }
+        else if (tok[0] == "restore") {
+            // restore [file]: back to the last snapshot, or to a checkpoint file
+            if (busy()) continue;
+            try {
+                if (tok.size() >= 2) {
+                    ifstream ifs(tok[1], ios::binary);
+                    if (!ifs) { cout << "Failed to open snapshot: " << tok[1] << endl; continue; }
+                    saved = read_snapshot(ifs);
+                }
+                c.restore(saved);
+                cout << "Restored PC " << c.cpu.pc << ", cycle " << c.cpu.cycles << endl;
+            } catch (const std::exception &e) {
+                cout << "Restore error: " << e.what() << endl;
+            }
+        }
+        else if (tok[0] == "buses") {
+            // buses [count]; wide bundles need at least as many buses as moves
+            if (tok.size() >= 2 && !busy()) {
+                try {
+                    c.set_buses(stoi(tok[1]));
+                } catch (const std::exception &e) {
+                    cout << "Bus error: " << e.what() << endl;
+                }
+            }
+            cout << c.bus_num << " bus(es), bundle width " << c.bundle_width << endl;
+        }
+        else if (tok[0] == "alus") {
+            // alus [count]; ALU1 and up are addressed as ALU1.A1, ALU1.AF, ...
+            // The running engine indexes the ALU array, so not during a run
+            if (tok.size() >= 2 && !busy()) {
+                try {
+                    c.set_alus(stoi(tok[1]));
+                } catch (const std::exception &e) {
+                    cout << "ALU error: " << e.what() << endl;
+                }
+            }
+            cout << c.alu_num << " ALU(s)";
+            if (!c.verified) cout << ", loaded code names a missing ALU";
+            cout << endl;
+        }
+        else if (tok[0] == "trap") {
+            // trap [pc|off]; a guest fault jumps to pc with its code in TF
+            // instead of ending the run
+            if (tok.size() >= 2 && !busy()) {
+                try {
+                    const int vector = tok[1] == "off" ? -1 : stoi(tok[1]);
+                    if (vector < -1) throw out_of_range("negative PC");
+                    c.cpu.trap_vector = vector;
+                } catch (const std::exception &e) {
+                    cout << "Trap error: " << e.what() << endl;
+                }
+            }
+            if (c.cpu.trap_vector < 0) cout << "no trap vector";
+            else cout << "trap vector " << c.cpu.trap_vector;
+            cout << ", TF=" << c.cpu.fault;
+            if (c.cpu.fault) cout << " (at PC " << c.cpu.fault_pc << ")";
+            cout << endl;
+        }
+        else if (tok[0] == "memory") {
+            // memory [bytes]; room past the program for LSU and DMA data.
+            // Engines hold pointers into memory, so not during a run
+            if (tok.size() >= 2 && !busy()) {
+                try {
+                    const long long bytes = stoll(tok[1]);
+                    if (bytes < 0) throw out_of_range("negative size");
+                    c.resize_memory(static_cast<size_t>(bytes));
+                } catch (const std::exception &e) {
+                    cout << "Memory error: " << e.what() << endl;
+                }
+            }
+            cout << c.memory.size() << " bytes (" << c.memory.size() / 4 << " words)" << endl;
+        }
         else if (tok[0] == "fp") {
             frontPanel(c);
         }
@@ -234,5 +555,6 @@ void shell() {
         }
         cout << "> ";
     }
+    stop();
 }
 
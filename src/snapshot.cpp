@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+#include "cpu.hpp"
+#include "snapshot.hpp"
+
+using namespace std;
+
+CpuState save_cpu(const Cpu& cpu) {
+    CpuState s;
+    s.regs = cpu.regs;
+    s.bus = cpu.bus;
+    s.bus_active = cpu.bus_active;
+    copy(cpu.alu, cpu.alu + 3, s.alu);
+    s.alu_pending = cpu.alu_pending;
+    s.alu_lhs = cpu.alu_lhs;
+    s.alu_rhs = cpu.alu_rhs;
+    copy(cpu.lsu, cpu.lsu + 4, s.lsu);
+    copy(cpu.dma, cpu.dma + 4, s.dma);
+    s.alus = cpu.alus;
+    s.flags = cpu.flags;
+    s.pc = cpu.pc;
+    s.halted = cpu.halted;
+    s.increment_pc = cpu.increment_pc;
+    s.cycles = cpu.cycles;
+    s.fault = cpu.fault;
+    s.fault_pc = cpu.fault_pc;
+    s.trap_vector = cpu.trap_vector;
+    return s;
+}
+
+void load_cpu(Cpu& cpu, const CpuState& s) {
+    if (s.regs.size() != cpu.regs.size()) {
+        throw runtime_error("load_cpu: snapshot has " + to_string(s.regs.size()) + " registers, machine has " + to_string(cpu.regs.size()));
+    }
+    // assign in place so pointers bound by the threaded engine stay valid
+    copy(s.regs.begin(), s.regs.end(), cpu.regs.begin());
+    if (s.bus.size() != cpu.bus.size()) cpu.set_bus_count(static_cast<int>(s.bus.size()));
+    cpu.bus = s.bus;
+    cpu.bus_active = s.bus_active;
+    copy(s.alu, s.alu + 3, cpu.alu);
+    cpu.alu_pending = s.alu_pending;
+    cpu.alu_lhs = s.alu_lhs;
+    cpu.alu_rhs = s.alu_rhs;
+    copy(s.lsu, s.lsu + 4, cpu.lsu);
+    copy(s.dma, s.dma + 4, cpu.dma);
+    if (s.alus.size() != cpu.alus.size()) cpu.set_alu_count(1 + static_cast<int>(s.alus.size()));
+    copy(s.alus.begin(), s.alus.end(), cpu.alus.begin());
+    cpu.flags = s.flags;
+    cpu.pc = s.pc;
+    cpu.halted = s.halted;
+    cpu.increment_pc = s.increment_pc;
+    cpu.cycles = s.cycles;
+    cpu.fault = s.fault;
+    cpu.fault_pc = s.fault_pc;
+    cpu.trap_vector = s.trap_vector;
+    cpu.trap = TRAP_NONE;
+}
+
+// --- Serialisation ---
+
+static void put_u32(ostream& out, uint32_t v) {
+    char b[4];
+    for (int i = 0; i < 4; ++i) b[i] = static_cast<char>(v >> (8 * i));
+    out.write(b, 4);
+}
+
+static void put_u64(ostream& out, uint64_t v) {
+    put_u32(out, static_cast<uint32_t>(v));
+    put_u32(out, static_cast<uint32_t>(v >> 32));
+}
+
+static uint32_t get_u32(istream& in) {
+    unsigned char b[4];
+    if (!in.read(reinterpret_cast<char*>(b), 4)) throw runtime_error("read_snapshot: file truncated");
+    return static_cast<uint32_t>(b[0]) | (static_cast<uint32_t>(b[1]) << 8)
+        | (static_cast<uint32_t>(b[2]) << 16) | (static_cast<uint32_t>(b[3]) << 24);
+}
+
+static uint64_t get_u64(istream& in) {
+    const uint64_t lo = get_u32(in);
+    return lo | (static_cast<uint64_t>(get_u32(in)) << 32);
+}
+
+static int get_int(istream& in) {
+    return static_cast<int>(get_u32(in));
+}
+
+void write_snapshot(ostream& out, const Snapshot& snap) {
+    const CpuState& s = snap.cpu;
+    put_u32(out, SNAPSHOT_MAGIC);
+    put_u32(out, SNAPSHOT_VERSION);
+
+    put_u32(out, static_cast<uint32_t>(s.regs.size()));
+    for (unsigned int r : s.regs) put_u32(out, r);
+    put_u32(out, static_cast<uint32_t>(s.bus.size()));
+    for (size_t i = 0; i < s.bus.size(); ++i) {
+        put_u32(out, s.bus[i]);
+        put_u32(out, i < s.bus_active.size() ? s.bus_active[i] : 0);
+    }
+    for (int k = 0; k < 3; ++k) put_u32(out, static_cast<uint32_t>(s.alu[k]));
+    put_u32(out, static_cast<uint32_t>(s.alu_pending));
+    put_u32(out, static_cast<uint32_t>(s.alu_lhs));
+    put_u32(out, static_cast<uint32_t>(s.alu_rhs));
+    for (int k = 0; k < 4; ++k) put_u32(out, static_cast<uint32_t>(s.lsu[k]));
+    for (int k = 0; k < 4; ++k) put_u32(out, static_cast<uint32_t>(s.dma[k]));
+    put_u32(out, static_cast<uint32_t>(s.alus.size()));
+    for (const AluUnit& unit : s.alus) {
+        for (int k = 0; k < 3; ++k) put_u32(out, static_cast<uint32_t>(unit.port[k]));
+        put_u32(out, unit.flags);
+    }
+    put_u32(out, s.flags);
+    put_u32(out, static_cast<uint32_t>(s.pc));
+    put_u32(out, static_cast<uint32_t>(s.halted));
+    put_u32(out, s.increment_pc ? 1 : 0);
+    put_u64(out, s.cycles);
+    put_u32(out, static_cast<uint32_t>(s.fault));
+    put_u32(out, static_cast<uint32_t>(s.fault_pc));
+    put_u32(out, static_cast<uint32_t>(s.trap_vector));
+
+    put_u32(out, static_cast<uint32_t>(snap.entry_point));
+    put_u32(out, static_cast<uint32_t>(snap.bundle_width));
+    put_u64(out, snap.memory_size);
+    if (snap.pages) {
+        for (const auto& page : *snap.pages) out.write(reinterpret_cast<const char*>(page->data()), static_cast<streamsize>(page->size()));
+    }
+    if (!out) throw runtime_error("write_snapshot: write failed");
+}
+
+Snapshot read_snapshot(istream& in) {
+    if (get_u32(in) != SNAPSHOT_MAGIC) throw runtime_error("read_snapshot: bad magic (not a yatta snapshot)");
+    const uint32_t version = get_u32(in);
+    if (version < 1 || version > SNAPSHOT_VERSION) throw runtime_error("read_snapshot: unsupported snapshot version " + to_string(version));
+
+    Snapshot snap;
+    CpuState& s = snap.cpu;
+    s.regs.resize(get_u32(in));
+    for (auto& r : s.regs) r = get_u32(in);
+    const uint32_t buses = get_u32(in);
+    s.bus.resize(buses);
+    s.bus_active.resize(buses);
+    for (size_t i = 0; i < buses; ++i) {
+        s.bus[i] = get_u32(in);
+        s.bus_active[i] = static_cast<uint8_t>(get_u32(in) != 0);
+    }
+    for (int k = 0; k < 3; ++k) s.alu[k] = get_int(in);
+    s.alu_pending = get_int(in);
+    s.alu_lhs = get_int(in);
+    s.alu_rhs = get_int(in);
+    // trigger_alu only latches ADD to DIV, and never a DIV by zero; settling
+    // anything else would fault in the host
+    if (s.alu_pending < 0 || s.alu_pending > 4 || (s.alu_pending == 4 && s.alu_rhs == 0)) {
+        throw runtime_error("read_snapshot: corrupt pending ALU op");
+    }
+    if (version >= 2) {
+        for (int k = 0; k < 4; ++k) s.lsu[k] = get_int(in);
+        for (int k = 0; k < 4; ++k) s.dma[k] = get_int(in);
+    }
+    if (version >= 3) {
+        const uint32_t extra = get_u32(in);
+        if (extra >= static_cast<uint32_t>(MAX_ALUS)) throw runtime_error("read_snapshot: corrupt ALU count");
+        s.alus.resize(extra);
+        for (AluUnit& unit : s.alus) {
+            for (int k = 0; k < 3; ++k) unit.port[k] = get_int(in);
+            unit.flags = get_u32(in);
+        }
+    }
+    s.flags = get_u32(in);
+    s.pc = get_int(in);
+    s.halted = get_int(in);
+    s.increment_pc = get_u32(in) != 0;
+    s.cycles = get_u64(in);
+    if (version >= 4) {
+        s.fault = get_int(in);
+        s.fault_pc = get_int(in);
+        s.trap_vector = get_int(in);
+    }
+
+    snap.entry_point = get_int(in);
+    snap.bundle_width = get_int(in);
+    if (buses < 1 || snap.bundle_width < 1) throw runtime_error("read_snapshot: corrupt bus configuration");
+    snap.memory_size = static_cast<size_t>(get_u64(in));
+
+    auto pages = make_shared<PageTable>();
+    for (size_t offset = 0; offset < snap.memory_size; offset += PAGE_SIZE) {
+        auto page = make_shared<Page>(min(PAGE_SIZE, snap.memory_size - offset));
+        if (!in.read(reinterpret_cast<char*>(page->data()), static_cast<streamsize>(page->size()))) {
+            throw runtime_error("read_snapshot: memory truncated");
+        }
+        pages->push_back(move(page));
+    }
+    snap.pages = move(pages);
+    return snap;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "cpu.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <vector>
+
+// Memory is snapshotted in pages. A page is immutable once published, so any
+// number of snapshots share unchanged pages; the Computer's own memory stays
+// one flat buffer, and a snapshot copies the pages written since the last.
+constexpr size_t PAGE_SIZE = 4096;
+using Page = std::vector<uint8_t>; // PAGE_SIZE bytes; the last page may be shorter
+using PageTable = std::vector<std::shared_ptr<const Page>>;
+
+constexpr uint32_t SNAPSHOT_MAGIC = 0x4E535459; // "YTSN"
+constexpr uint16_t SNAPSHOT_VERSION = 4; // 2 added the LSU and DMA ports, 3 the extra ALUs, 4 the trap state
+
+// Everything in a Cpu that execution can change
+struct CpuState {
+    std::vector<unsigned int> regs, bus;
+    std::vector<uint8_t> bus_active;
+    int alu[3] = { 0, 0, 0 };
+    int alu_pending = 0, alu_lhs = 0, alu_rhs = 0;
+    int lsu[4] = { 0, 0, 0, 0 };
+    int dma[4] = { 0, 0, 0, 0 };
+    std::vector<AluUnit> alus; // ALU1 and up
+    uint32_t flags = 0;
+    int pc = 0;
+    int halted = 0;
+    bool increment_pc = true;
+    uint64_t cycles = 0;
+    int fault = 0, fault_pc = 0, trap_vector = -1; // TF and the guest trap vector
+};
+
+CpuState save_cpu(const Cpu& cpu);
+// Throws std::runtime_error if the register counts differ
+void load_cpu(Cpu& cpu, const CpuState& state);
+
+// Full machine state, see Computer::snapshot. Copying a Snapshot is cheap:
+// the page table is shared, not duplicated.
+struct Snapshot {
+    CpuState cpu;
+    int entry_point = 0;
+    int bundle_width = 1;
+    size_t memory_size = 0;
+    std::shared_ptr<const PageTable> pages;
+};
+
+// Checkpoint files: a small header, the Cpu state and the memory bytes.
+// Little endian throughout, like program images.
+void write_snapshot(std::ostream& out, const Snapshot& snap);
+// Throws std::runtime_error on a bad magic, unsupported version or truncation.
+// Version 1 files load with the LSU and DMA ports zeroed, versions 1 and 2
+// with a single ALU, and versions before 4 with TF clear and no trap vector.
+Snapshot read_snapshot(std::istream& in);
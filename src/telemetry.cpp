@@ -0,0 +1,207 @@
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "computer.hpp"
+#include "telemetry.hpp"
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#define YATTA_UNIX_SOCKETS 1
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#else
+#define YATTA_UNIX_SOCKETS 0
+#endif
+
+using namespace std;
+
+const char* alu_op_name(AluOpKind kind) {
+    switch (kind) {
+    case ALU_ADD: return "add";
+    case ALU_SUB: return "sub";
+    case ALU_MUL: return "mul";
+    case ALU_DIV: return "div";
+    default: return "other";
+    }
+}
+
+void Telemetry::add(const MoveTally& tally) {
+    bump(executed, tally.executed);
+    bump(skipped, tally.skipped);
+    bump(jumps, tally.jumps);
+    for (int k = 0; k < ALU_KINDS; ++k) {
+        if (tally.alu[k]) bump(alu[k], tally.alu[k]);
+    }
+}
+
+TelemetrySample Telemetry::sample() const {
+    TelemetrySample s;
+    s.cycles = cycles.load(memory_order_relaxed);
+    s.executed = executed.load(memory_order_relaxed);
+    s.skipped = skipped.load(memory_order_relaxed);
+    s.jumps = jumps.load(memory_order_relaxed);
+    for (int k = 0; k < ALU_KINDS; ++k) s.alu[k] = alu[k].load(memory_order_relaxed);
+    s.faults = faults.load(memory_order_relaxed);
+    s.run_ns = run_ns.load(memory_order_relaxed);
+    s.running = running.load(memory_order_relaxed);
+    s.status = last_status.load(memory_order_relaxed);
+    return s;
+}
+
+static void metric_header(ostream& out, const char* name, const char* type, const char* help) {
+    out << "# HELP " << name << ' ' << help << '\n' << "# TYPE " << name << ' ' << type << '\n';
+}
+
+void write_prometheus(ostream& out, const TelemetrySample& s) {
+    metric_header(out, "yatta_cycles_total", "counter", "Machine cycles retired by all engines.");
+    out << "yatta_cycles_total " << s.cycles << '\n';
+    metric_header(out, "yatta_run_seconds_total", "counter", "Wall time spent running the machine.");
+    out << "yatta_run_seconds_total " << fixed << setprecision(6) << static_cast<double>(s.run_ns) / 1e9 << defaultfloat << '\n';
+    metric_header(out, "yatta_moves_total", "counter", "Moves issued, by whether their condition held.");
+    out << "yatta_moves_total{outcome=\"executed\"} " << s.executed << '\n';
+    out << "yatta_moves_total{outcome=\"skipped\"} " << s.skipped << '\n';
+    metric_header(out, "yatta_alu_ops_total", "counter", "ALU operations triggered, by op.");
+    for (int k = 0; k < ALU_KINDS; ++k) {
+        out << "yatta_alu_ops_total{op=\"" << alu_op_name(static_cast<AluOpKind>(k)) << "\"} " << s.alu[k] << '\n';
+    }
+    metric_header(out, "yatta_jumps_total", "counter", "Taken PC writes.");
+    out << "yatta_jumps_total " << s.jumps << '\n';
+    metric_header(out, "yatta_faults_total", "counter", "Runs that stopped on a fault.");
+    out << "yatta_faults_total " << s.faults << '\n';
+    metric_header(out, "yatta_running", "gauge", "1 while an engine is running the machine.");
+    out << "yatta_running " << (s.running ? 1 : 0) << '\n';
+    metric_header(out, "yatta_last_status", "gauge", "Why the last run returned; 1 for that status.");
+    for (int k = RUN_HALTED; k <= RUN_FAULT; ++k) {
+        out << "yatta_last_status{status=\"" << run_status_name(static_cast<RunStatus>(k)) << "\"} " << (s.status == k ? 1 : 0) << '\n';
+    }
+}
+
+void write_stats(ostream& out, const TelemetrySample& s) {
+    const double seconds = static_cast<double>(s.run_ns) / 1e9;
+    out << "Cycles:  " << s.cycles << " in " << fixed << setprecision(3) << seconds << " s";
+    if (s.run_ns) out << " (" << setprecision(1) << static_cast<double>(s.cycles) / seconds / 1e6 << " M/s)";
+    out << defaultfloat << '\n';
+    out << "Moves:   " << s.executed << " executed, " << s.skipped << " skipped, " << s.jumps << " jumps\n";
+    out << "ALU ops:";
+    for (int k = 0; k < ALU_KINDS; ++k) out << ' ' << alu_op_name(static_cast<AluOpKind>(k)) << '=' << s.alu[k];
+    out << '\n';
+    out << "Faults:  " << s.faults << '\n';
+    out << "State:   " << (s.running ? "running" : run_status_name(static_cast<RunStatus>(s.status))) << '\n';
+}
+
+TelemetryExporter::TelemetryExporter(const Telemetry& source, const string& target_, chrono::milliseconds interval_)
+    : target(target_), telemetry(source), interval(interval_) {
+    if (interval.count() <= 0) throw runtime_error("telemetry: interval must be positive");
+    if (target.rfind("unix:", 0) != 0) {
+        path = target;
+        write_file(); // fail here rather than on the thread
+        written.store(1, memory_order_relaxed);
+        worker = thread(&TelemetryExporter::run_file, this);
+        return;
+    }
+    path = target.substr(5);
+#if YATTA_UNIX_SOCKETS
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) throw runtime_error("telemetry: bad socket path '" + path + "'");
+    path.copy(address.sun_path, path.size());
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) throw runtime_error("telemetry: cannot create a socket");
+    ::unlink(path.c_str()); // a socket left by an earlier run
+    if (::bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listener, 8) != 0) {
+        ::close(listener);
+        throw runtime_error("telemetry: cannot listen on " + path);
+    }
+    worker = thread(&TelemetryExporter::run_socket, this);
+#else
+    throw runtime_error("telemetry: Unix domain sockets are not supported on this platform");
+#endif
+}
+
+TelemetryExporter::~TelemetryExporter() {
+    stop();
+}
+
+void TelemetryExporter::stop() {
+    if (!worker.joinable()) return;
+    stopping.store(true, memory_order_relaxed);
+    worker.join();
+#if YATTA_UNIX_SOCKETS
+    if (listener >= 0) {
+        ::close(listener);
+        ::unlink(path.c_str());
+        listener = -1;
+    }
+#endif
+}
+
+void TelemetryExporter::write_file() const {
+    const string partial = path + ".part";
+    {
+        ofstream out(partial, ios::trunc);
+        if (!out) throw runtime_error("telemetry: cannot write " + partial);
+        write_prometheus(out, telemetry.sample());
+        if (!out.flush()) throw runtime_error("telemetry: write to " + partial + " failed");
+    }
+    filesystem::rename(partial, path);
+}
+
+void TelemetryExporter::run_file() {
+    // wakes often enough that stop() never waits a whole interval
+    const auto tick = min(interval, chrono::milliseconds(50));
+    auto next = chrono::steady_clock::now() + interval;
+    while (!stopping.load(memory_order_relaxed)) {
+        this_thread::sleep_for(tick);
+        if (chrono::steady_clock::now() < next) continue;
+        next += interval;
+        try {
+            write_file();
+            written.store(written.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        } catch (const exception&) {
+            // a full disk or a removed directory may recover; try next interval
+        }
+    }
+    // leave the final counts behind
+    try {
+        write_file();
+    } catch (const exception&) {
+    }
+}
+
+void TelemetryExporter::run_socket() {
+#if YATTA_UNIX_SOCKETS
+#ifdef MSG_NOSIGNAL
+    const int send_flags = MSG_NOSIGNAL; // a scraper hanging up must not raise SIGPIPE
+#else
+    const int send_flags = 0;
+#endif
+    while (!stopping.load(memory_order_relaxed)) {
+        fd_set ready;
+        FD_ZERO(&ready);
+        FD_SET(listener, &ready);
+        timeval timeout {};
+        timeout.tv_usec = 50000;
+        if (select(listener + 1, &ready, nullptr, nullptr, &timeout) <= 0) continue;
+        const int client = ::accept(listener, nullptr, nullptr);
+        if (client < 0) continue;
+        ostringstream text;
+        write_prometheus(text, telemetry.sample());
+        const string body = text.str();
+        for (size_t sent = 0; sent < body.size();) {
+            const ssize_t n = ::send(client, body.data() + sent, body.size() - sent, send_flags);
+            if (n <= 0) break;
+            sent += static_cast<size_t>(n);
+        }
+        ::close(client);
+        written.store(written.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+#endif
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "cpu.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <thread>
+
+// ALU ops by the code written to AF; any other non-zero code is "other"
+enum AluOpKind : uint8_t { ALU_ADD = 0, ALU_SUB, ALU_MUL, ALU_DIV, ALU_OTHER, ALU_KINDS };
+const char* alu_op_name(AluOpKind kind);
+
+// Move counts an engine keeps in plain integers while it runs and hands to
+// Telemetry::add when it returns
+struct MoveTally {
+    uint64_t executed = 0; // condition held (or none)
+    uint64_t skipped = 0;  // condition failed
+    uint64_t jumps = 0;    // taken PC writes
+    uint64_t alu[ALU_KINDS] = {};
+
+    // A trigger's value picks the ALU op; engines that only know constant
+    // sources pass -1 for the rest, which counts them as "other"
+    void count(const Instruction& move, bool taken, int value) {
+        if (!taken) {
+            ++skipped;
+            return;
+        }
+        ++executed;
+        if (move.dest_type == 4) ++jumps;
+        else if (move.dest_type == 3 && move.dest_value == 1 && value != 0) {
+            ++alu[value >= 1 && value <= 4 ? value - 1 : ALU_OTHER];
+        }
+    }
+    // Counted as if taken, with the value known before it runs
+    void count_static(const Instruction& move, bool taken) {
+        count(move, taken, move.source_type == 0 ? move.source_value : -1);
+    }
+    // Counted as if taken, leaving out the op of an AF write for engines
+    // that count those as they happen
+    void count_move(const Instruction& move, bool taken) { count(move, taken, 0); }
+    void add(const MoveTally& other, uint64_t times = 1) {
+        executed += other.executed * times;
+        skipped += other.skipped * times;
+        jumps += other.jumps * times;
+        for (int k = 0; k < ALU_KINDS; ++k) alu[k] += other.alu[k] * times;
+    }
+};
+
+// Plain copy of the counters, as of one read
+struct TelemetrySample {
+    uint64_t cycles = 0;
+    uint64_t executed = 0, skipped = 0, jumps = 0;
+    uint64_t alu[ALU_KINDS] = {};
+    uint64_t faults = 0;
+    uint64_t run_ns = 0;   // wall time spent inside the engines
+    bool running = false;
+    uint8_t status = 0;    // RunStatus of the last run that returned
+};
+
+// Counters for dashboards and the shell's `stats`. Updates are relaxed
+// fetch_adds, handed over once per slice; any thread may read. Each counter
+// is exact on its own, but a read may see one counter a slice ahead of
+// another.
+//
+// Every engine counts cycles, faults, run time, status, moves and jumps.
+// The threaded and JIT engines count a block's moves once and then only its
+// runs (and, in compiled code, failed conditions). The threaded engine
+// counts AF writes by the value moved as they happen; the JIT compiles only
+// constant ones and leaves the rest to the interpreter.
+class Telemetry {
+public:
+    void add(const MoveTally& tally);
+    void add_cycles(uint64_t retired, uint64_t ns) {
+        bump(cycles, retired);
+        bump(run_ns, ns);
+    }
+    void add_fault() { bump(faults, 1); }
+    void set_running(bool on) { running.store(on, std::memory_order_relaxed); }
+    void set_status(uint8_t status) { last_status.store(status, std::memory_order_relaxed); }
+
+    TelemetrySample sample() const;
+
+private:
+    static void bump(std::atomic<uint64_t>& counter, uint64_t by) {
+        counter.fetch_add(by, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> cycles{0};
+    std::atomic<uint64_t> executed{0}, skipped{0}, jumps{0};
+    std::atomic<uint64_t> alu[ALU_KINDS] = {};
+    std::atomic<uint64_t> faults{0};
+    std::atomic<uint64_t> run_ns{0};
+    std::atomic<bool> running{false};
+    std::atomic<uint8_t> last_status{0};
+};
+
+// Prometheus text exposition format (version 0.0.4)
+void write_prometheus(std::ostream& out, const TelemetrySample& s);
+// What `stats` prints
+void write_stats(std::ostream& out, const TelemetrySample& s);
+
+// Background thread that exports a Telemetry in Prometheus format. A plain
+// `target` is a file rewritten every `interval` (through a temporary and a
+// rename, so a collector never reads half of one); "unix:<path>" listens on
+// a Unix domain socket and answers every connection with a fresh sample.
+class TelemetryExporter {
+public:
+    // Throws std::runtime_error if the target cannot be written or bound
+    TelemetryExporter(const Telemetry& source, const std::string& target, std::chrono::milliseconds interval);
+    TelemetryExporter(const TelemetryExporter&) = delete;
+    TelemetryExporter& operator=(const TelemetryExporter&) = delete;
+    ~TelemetryExporter();
+
+    // Join the thread; a socket is closed and its path removed. Later calls do nothing.
+    void stop();
+
+    uint64_t exports() const { return written.load(std::memory_order_relaxed); }
+    const std::string target;
+
+private:
+    void write_file() const;
+    void run_file();
+    void run_socket();
+
+    const Telemetry& telemetry;
+    std::chrono::milliseconds interval;
+    std::string path;     // file, or socket path without the prefix
+    int listener = -1;    // listening socket in socket mode
+    std::atomic<bool> stopping{false};
+    std::atomic<uint64_t> written{0};
+    std::thread worker;
+};
@@ -0,0 +1,887 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+#include "cpu.hpp"
+#include "threaded.hpp"
+#include "encoding.hpp"
+
+using namespace std;
+
+namespace {
+
+using Dest = OpShape::Kind;
+
+template <Comparator C>
+inline bool holds(int a, int b) {
+    if constexpr (C == CMP_EQ) return a == b;
+    else if constexpr (C == CMP_NE) return a != b;
+    else if constexpr (C == CMP_LT) return a < b;
+    else if constexpr (C == CMP_LE) return a <= b;
+    else if constexpr (C == CMP_GT) return a > b;
+    else return a >= b;
+}
+
+// Same effect as Cpu::step for a move whose operands were validated and bound
+// at translation time. Settle is set when an operand reads A0 or a flag.
+template <Dest D, Comparator C, bool Settle>
+void op_move(Cpu& cpu, const ThreadedOp& op) {
+    if constexpr (Settle) cpu.settle_alu();
+    if constexpr (C != CMP_NONE) {
+        if (!holds<C>(op.lhs.read(), op.rhs.read())) {
+            ++cpu.not_taken;
+            cpu.pc++;
+            return;
+        }
+    }
+    const int v = op.src.read();
+    if constexpr (D == OpShape::Store) {
+        *op.dst = v;
+    }
+    else if constexpr (D == OpShape::Trigger) {
+        cpu.trigger_alu(v);
+        if (cpu.trap) return; // DIV by zero keeps its PC
+        cpu.count_trigger(v);
+    }
+    else if constexpr (D == OpShape::Halt) {
+        if (v != 0) cpu.halted = 1;
+    }
+
+    if constexpr (D == OpShape::Jump) {
+        cpu.pc = v;
+    } else {
+        cpu.pc++;
+    }
+}
+
+// Moves the translator could not resolve go through the interpreter so they
+// raise a trap (or silently fail a condition) exactly as run_from_ram would.
+void op_fallback(Cpu& cpu, const ThreadedOp& op) {
+    const bool taken = cpu.step(*op.inst);
+    if (cpu.trap) return;
+    if (!taken) ++cpu.not_taken;
+    else if (op.inst->dest_type == 3 && op.inst->dest_value == 1) cpu.count_trigger(cpu.moved);
+}
+
+// Issue `n` moves through Cpu::step_bundle, counting the ALU0 ops they
+// trigger and the conditions that failed.
+void bundle_checked(Cpu& cpu, const Instruction* moves, int n) {
+    cpu.step_bundle(moves, n);
+    if (cpu.trap) return;
+    for (int i = 0; i < n; ++i) {
+        if (!cpu.bus_active[static_cast<size_t>(i)]) ++cpu.not_taken;
+        else if (moves[i].dest_type == 3 && moves[i].dest_value == 1) cpu.count_trigger(static_cast<int>(cpu.bus[static_cast<size_t>(i)]));
+    }
+}
+
+// A whole bundle (op.imm moves from op.inst) in one dispatch.
+void op_bundle(Cpu& cpu, const ThreadedOp& op) {
+    bundle_checked(cpu, op.inst, op.imm);
+}
+
+// Wider bundles always take op_bundle
+constexpr int MAX_BOUND_WIDTH = 4;
+
+// A bundle whose moves all bound, with the same two phases as
+// Cpu::issue_bundle: every source is read onto its bus, then stores, HF and
+// PC commit, then triggers. Binding ruled out conflicts and every fault but
+// a DIV by zero, which is left to bundle_checked to raise with nothing
+// committed. Width 0 takes the width from `n`; the others unroll.
+template <int Width, bool Triggers>
+inline void bundle_bound(Cpu& cpu, const BundleMove* m, const Instruction* moves, int n) {
+    if constexpr (Width > 0) n = Width;
+    // the bus lives in locals until the commit: a store through cpu.bus_active
+    // may alias the moves, which would be reloaded after every write
+    int value[MAX_BOUND_WIDTH];
+    bool on[MAX_BOUND_WIDTH];
+    cpu.settle_alu();
+    for (int i = 0; i < n; ++i) {
+        on[i] = m[i].cmp == CMP_NONE || compare(m[i].cmp, m[i].lhs.read(), m[i].rhs.read());
+        value[i] = on[i] ? m[i].src.read() : 0;
+    }
+    if constexpr (Triggers) {
+        for (int i = 0; i < n; ++i) {
+            if (m[i].kind != OpShape::Trigger || !on[i] || value[i] != 4) continue;
+            const int k = m[i].a2_slot;
+            if ((k >= 0 && on[k] ? value[k] : *m[i].a2) == 0) {
+                bundle_checked(cpu, moves, n);
+                return;
+            }
+        }
+    }
+    bool jumped = false;
+    for (int i = 0; i < n; ++i) {
+        if (!on[i]) continue;
+        switch (m[i].kind) {
+        case OpShape::Store: *m[i].dst = value[i]; break;
+        case OpShape::Halt: if (value[i] != 0) cpu.halted = 1; break;
+        case OpShape::Jump: cpu.pc = value[i]; jumped = true; break;
+        default: break;
+        }
+    }
+    if constexpr (Triggers) {
+        for (int i = 0; i < n; ++i) {
+            if (m[i].kind != OpShape::Trigger || !on[i]) continue;
+            if (m[i].unit) {
+                m[i].unit->trigger(value[i]);
+            } else {
+                cpu.trigger_alu(value[i]);
+                cpu.count_trigger(value[i]);
+            }
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        cpu.bus_active[static_cast<size_t>(i)] = on[i];
+        if (on[i]) cpu.bus[static_cast<size_t>(i)] = static_cast<unsigned int>(value[i]);
+        else ++cpu.not_taken;
+    }
+    if (!jumped) cpu.pc++;
+}
+
+template <int Width, bool Triggers>
+void op_bundle_bound(Cpu& cpu, const ThreadedOp& op) {
+    bundle_bound<Width, Triggers>(cpu, op.bundle, op.inst, op.imm);
+}
+
+// A bound two-move bundle, as bundle_bound but specialised on each move's
+// kind like op_move. Cond is set when either move has a condition.
+template <Dest K0, Dest K1, bool Cond>
+void op_bundle2(Cpu& cpu, const ThreadedOp& op) {
+    const BundleMove* m = op.bundle;
+    cpu.settle_alu();
+    bool on0 = true, on1 = true;
+    if constexpr (Cond) {
+        on0 = m[0].cmp == CMP_NONE || compare(m[0].cmp, m[0].lhs.read(), m[0].rhs.read());
+        on1 = m[1].cmp == CMP_NONE || compare(m[1].cmp, m[1].lhs.read(), m[1].rhs.read());
+    }
+    const int v0 = m[0].src.read(), v1 = m[1].src.read();
+    if constexpr (K0 == OpShape::Trigger || K1 == OpShape::Trigger) {
+        // the A2 a DIV in slot `i` divides by, once the other move has landed
+        auto divisor = [&](int i) {
+            const int k = m[i].a2_slot;
+            return k < 0 || !(k == 0 ? on0 : on1) ? *m[i].a2 : k == 0 ? v0 : v1;
+        };
+        if ((K0 == OpShape::Trigger && on0 && v0 == 4 && divisor(0) == 0)
+            || (K1 == OpShape::Trigger && on1 && v1 == 4 && divisor(1) == 0)) {
+            bundle_checked(cpu, op.inst, 2);
+            return;
+        }
+    }
+    bool jumped = false;
+    auto commit = [&](auto kind, const BundleMove& move, bool on, int v) {
+        if (!on) return;
+        if constexpr (kind() == OpShape::Store) *move.dst = v;
+        else if constexpr (kind() == OpShape::Halt) { if (v != 0) cpu.halted = 1; }
+        else if constexpr (kind() == OpShape::Jump) { cpu.pc = v; jumped = true; }
+    };
+    auto trigger = [&](auto kind, const BundleMove& move, bool on, int v) {
+        if constexpr (kind() == OpShape::Trigger) {
+            if (!on) return;
+            if (move.unit) {
+                move.unit->trigger(v);
+            } else {
+                cpu.trigger_alu(v);
+                cpu.count_trigger(v);
+            }
+        }
+    };
+    using Kind0 = integral_constant<Dest, K0>;
+    using Kind1 = integral_constant<Dest, K1>;
+    commit(Kind0{}, m[0], on0, v0);
+    commit(Kind1{}, m[1], on1, v1);
+    trigger(Kind0{}, m[0], on0, v0);
+    trigger(Kind1{}, m[1], on1, v1);
+    cpu.bus_active[0] = on0;
+    cpu.bus_active[1] = on1;
+    if (on0) cpu.bus[0] = static_cast<unsigned int>(v0);
+    else ++cpu.not_taken;
+    if (on1) cpu.bus[1] = static_cast<unsigned int>(v1);
+    else ++cpu.not_taken;
+    if (!jumped) cpu.pc++;
+}
+
+template <Dest K0, bool Cond>
+OpHandler bundle2_for(Dest k1) {
+    switch (k1) {
+    case OpShape::Discard: return &op_bundle2<K0, OpShape::Discard, Cond>;
+    case OpShape::Store: return &op_bundle2<K0, OpShape::Store, Cond>;
+    case OpShape::Trigger: return &op_bundle2<K0, OpShape::Trigger, Cond>;
+    case OpShape::Halt: return &op_bundle2<K0, OpShape::Halt, Cond>;
+    default: return &op_bundle2<K0, OpShape::Jump, Cond>;
+    }
+}
+
+template <bool Cond>
+OpHandler pick_bundle2(Dest k0, Dest k1) {
+    switch (k0) {
+    case OpShape::Discard: return bundle2_for<OpShape::Discard, Cond>(k1);
+    case OpShape::Store: return bundle2_for<OpShape::Store, Cond>(k1);
+    case OpShape::Trigger: return bundle2_for<OpShape::Trigger, Cond>(k1);
+    case OpShape::Halt: return bundle2_for<OpShape::Halt, Cond>(k1);
+    default: return bundle2_for<OpShape::Jump, Cond>(k1);
+    }
+}
+
+// A conditional jump alone in a bundle of two, as loops end, specialised on
+// its comparator like op_move.
+template <Comparator C>
+void op_bundle_jump(Cpu& cpu, const ThreadedOp& op) {
+    const BundleMove* m = op.bundle;
+    cpu.settle_alu();
+    const bool on = holds<C>(m[0].lhs.read(), m[0].rhs.read());
+    const int v0 = m[0].src.read(), v1 = m[1].src.read();
+    unsigned int* bus = cpu.bus.data();
+    bus[1] = static_cast<unsigned int>(v1);
+    if (on) {
+        bus[0] = static_cast<unsigned int>(v0);
+        cpu.pc = v0;
+    } else {
+        ++cpu.not_taken;
+        cpu.pc++;
+    }
+    cpu.bus_active[0] = on;
+    cpu.bus_active[1] = 1;
+}
+
+OpHandler bundle_jump_for(Comparator cmp) {
+    switch (cmp) {
+    case CMP_EQ: return &op_bundle_jump<CMP_EQ>;
+    case CMP_NE: return &op_bundle_jump<CMP_NE>;
+    case CMP_LT: return &op_bundle_jump<CMP_LT>;
+    case CMP_LE: return &op_bundle_jump<CMP_LE>;
+    case CMP_GT: return &op_bundle_jump<CMP_GT>;
+    default: return &op_bundle_jump<CMP_GE>;
+    }
+}
+
+template <int Width>
+OpHandler pick_bundle(bool triggers) {
+    return triggers ? &op_bundle_bound<Width, true> : &op_bundle_bound<Width, false>;
+}
+
+// --- Superinstructions ---
+// Each replays the fused moves in order and advances PC between them, so a
+// PC source or a faulting trigger sees exactly the state the unfused moves
+// would have. Settling a pending ALU op is cheap, so they always do it.
+
+// Two plain stores.
+void op_store2(Cpu& cpu, const ThreadedOp& op) {
+    cpu.settle_alu();
+    *op.dst = op.src.read();
+    cpu.pc++;
+    *op.dst2 = op.lhs.read();
+    cpu.pc++;
+}
+
+// One or two operand loads, a constant ALU trigger, optionally a store of
+// the result (or a flag): `X A1`, `Y A2`, `n AF`, `A0 Rk`.
+template <int Loads, bool Result>
+void op_alu_fused(Cpu& cpu, const ThreadedOp& op) {
+    cpu.settle_alu();
+    *op.dst = op.src.read();
+    cpu.pc++;
+    if constexpr (Loads == 2) {
+        *op.dst2 = op.lhs.read();
+        cpu.pc++;
+    }
+    cpu.trigger_alu(op.imm);
+    if (cpu.trap) return;
+    cpu.count_trigger(op.imm);
+    cpu.pc++;
+    if constexpr (Result) {
+        cpu.settle_alu();
+        *op.dst3 = op.rhs.read();
+        cpu.pc++;
+    }
+}
+
+// Bundles of two moves, fused like the two above. Every move is a plain
+// store, a trigger or a discard, which only drives its bus; the bus is
+// written once, from the last bundle.
+
+// Both moves of a store bundle; returns their bus values.
+inline pair<int, int> store_bundle(Cpu& cpu, const BundleMove* m) {
+    cpu.settle_alu();
+    const int v0 = m[0].src.read(), v1 = m[1].src.read();
+    if (m[0].dst) *m[0].dst = v0;
+    if (m[1].dst) *m[1].dst = v1;
+    cpu.pc++;
+    return { v0, v1 };
+}
+
+inline void drive_bus(Cpu& cpu, pair<int, int> v) {
+    unsigned int* bus = cpu.bus.data();
+    bus[0] = static_cast<unsigned int>(v.first);
+    bus[1] = static_cast<unsigned int>(v.second);
+    cpu.bus_active[0] = cpu.bus_active[1] = 1;
+}
+
+// Two store bundles.
+void op_bundle_store2(Cpu& cpu, const ThreadedOp& op) {
+    store_bundle(cpu, op.bundle);
+    drive_bus(cpu, store_bundle(cpu, op.bundle + 2));
+}
+
+// ALU0's op evaluated at once instead of latched, as the result bundle right
+// behind it would settle it anyway. A DIV by zero was ruled out.
+inline void trigger_alu_now(Cpu& cpu, int op) {
+    if (op == 0) return;
+    cpu.alu_lhs = cpu.alu[1];
+    cpu.alu_rhs = cpu.alu[2];
+    const AluResult r = alu_compute(op, cpu.alu_lhs, cpu.alu_rhs, cpu.alu[0]);
+    cpu.alu[0] = r.value;
+    cpu.flags = r.flags;
+}
+
+// Up to two operand load bundles, a trigger bundle and a result bundle, which
+// is required when the operands already sit in the ALUs. Nothing before the
+// triggers can leave ALU0 pending, and with a result nothing after them does
+// either. PerAlu is set when the first trigger is ALU0's and the second
+// another ALU's, the usual way to give each ALU its own chain. A DIV by zero
+// is left to bundle_checked, from the trigger bundle.
+template <int Loads, bool Result, bool PerAlu>
+void op_bundle_alu(Cpu& cpu, const ThreadedOp& op) {
+    const BundleMove* m = op.bundle;
+    cpu.settle_alu();
+    for (int b = 0; b < Loads; ++b, m += 2) {
+        const int v0 = m[0].src.read(), v1 = m[1].src.read();
+        if (m[0].dst) *m[0].dst = v0;
+        if (m[1].dst) *m[1].dst = v1;
+        cpu.pc++;
+    }
+    pair<int, int> v = { m[0].src.read(), m[1].src.read() };
+    auto trigger_alu0 = [&](int op_code) {
+        if constexpr (Result) trigger_alu_now(cpu, op_code);
+        else cpu.trigger_alu(op_code);
+        cpu.count_trigger(op_code);
+    };
+    // a trigger bundle stores nothing, so each DIV divides by its A2 as it is
+    if constexpr (PerAlu) {
+        AluUnit& unit = *m[1].unit;
+        if ((v.first == 4 && cpu.alu[2] == 0) || (v.second == 4 && unit.port[2] == 0)) {
+            bundle_checked(cpu, op.inst + 2 * Loads, 2);
+            return;
+        }
+        trigger_alu0(v.first);
+        unit.trigger(v.second);
+    } else {
+        if ((m[0].kind == OpShape::Trigger && v.first == 4 && *m[0].a2 == 0)
+            || (m[1].kind == OpShape::Trigger && v.second == 4 && *m[1].a2 == 0)) {
+            bundle_checked(cpu, op.inst + 2 * Loads, 2);
+            return;
+        }
+        auto trigger = [&](const BundleMove& move, int op_code) {
+            if (move.kind != OpShape::Trigger) return;
+            if (move.unit) move.unit->trigger(op_code);
+            else trigger_alu0(op_code);
+        };
+        trigger(m[0], v.first);
+        trigger(m[1], v.second);
+    }
+    cpu.pc++;
+    if constexpr (Result) {
+        m += 2;
+        v = { m[0].src.read(), m[1].src.read() };
+        if (m[0].dst) *m[0].dst = v.first;
+        if (m[1].dst) *m[1].dst = v.second;
+        cpu.pc++;
+    }
+    drive_bus(cpu, v);
+}
+
+template <bool PerAlu>
+OpHandler bundle_alu_for(int loads, bool result) {
+    if (loads == 0) return &op_bundle_alu<0, true, PerAlu>;
+    if (loads == 1) return result ? &op_bundle_alu<1, true, PerAlu> : &op_bundle_alu<1, false, PerAlu>;
+    return result ? &op_bundle_alu<2, true, PerAlu> : &op_bundle_alu<2, false, PerAlu>;
+}
+
+template <Dest D, bool Settle>
+OpHandler handler_for(Comparator cmp) {
+    switch (cmp) {
+    case CMP_EQ: return &op_move<D, CMP_EQ, Settle>;
+    case CMP_NE: return &op_move<D, CMP_NE, Settle>;
+    case CMP_LT: return &op_move<D, CMP_LT, Settle>;
+    case CMP_LE: return &op_move<D, CMP_LE, Settle>;
+    case CMP_GT: return &op_move<D, CMP_GT, Settle>;
+    case CMP_GE: return &op_move<D, CMP_GE, Settle>;
+    default: return &op_move<D, CMP_NONE, Settle>;
+    }
+}
+
+template <bool Settle>
+OpHandler pick_handler(Dest d, Comparator cmp) {
+    switch (d) {
+    case OpShape::Discard: return handler_for<OpShape::Discard, Settle>(cmp);
+    case OpShape::Store: return handler_for<OpShape::Store, Settle>(cmp);
+    case OpShape::Trigger: return handler_for<OpShape::Trigger, Settle>(cmp);
+    case OpShape::Halt: return handler_for<OpShape::Halt, Settle>(cmp);
+    default: return handler_for<OpShape::Jump, Settle>(cmp);
+    }
+}
+
+int* reg_ptr(Cpu& cpu, int index) {
+    return reinterpret_cast<int*>(&cpu.regs[static_cast<size_t>(index)]);
+}
+
+// Resolve a readable (type, value) operand to the storage it names. Mirrors
+// the source switch in Cpu::exec_line; conditions may additionally read HF.
+// `lazy` is set when the operand depends on a pending ALU op.
+bool bind_source(Cpu& cpu, int type, int value, bool in_condition, int& imm, BoundOperand& out, bool& lazy) {
+    switch (type) {
+    case 0: // constant
+        imm = value;
+        out.ptr = &imm;
+        return true;
+    case 1: // register
+        if (value < 0 || value >= cpu.reg_amount) return false;
+        out.ptr = reg_ptr(cpu, value);
+        return true;
+    case 2: { // ALU port
+        const UnitPort* port = unit_port(UNIT_KINDS[0], value, cpu.alu_count());
+        if (!port || !(port->use & PORT_READ)) return false;
+        const int unit = value / ALU_STRIDE, p = value % ALU_STRIDE;
+        if (unit == 0) {
+            // type 2 spellings of its flags are left to the interpreter
+            if (p > 2) return false;
+            out.ptr = &cpu.alu[p];
+            lazy |= p == 0;
+            return true;
+        }
+        // the other ALUs evaluate on trigger, so nothing is lazy
+        const AluUnit& alu = cpu.alus[static_cast<size_t>(unit - 1)];
+        if (p <= 2) {
+            out.ptr = &alu.port[p];
+        } else {
+            out.ptr = reinterpret_cast<const int*>(&alu.flags);
+            out.shift = p - 4;
+            out.mask = 1;
+        }
+        return true;
+    }
+    case 3: // flag
+        switch (value) {
+        case 1: // AF always reads as consumed
+            imm = 0;
+            out.ptr = &imm;
+            return true;
+        case 2: case 3: case 4:
+            out.ptr = reinterpret_cast<const int*>(&cpu.flags);
+            out.shift = value - 2;
+            out.mask = 1;
+            lazy = true;
+            return true;
+        case 5:
+            if (!in_condition) return false;
+            out.ptr = &cpu.halted;
+            return true;
+        case 6: // TF
+            out.ptr = &cpu.fault;
+            return true;
+        default: return false;
+        }
+    case 4: // PC
+        out.ptr = &cpu.pc;
+        return true;
+    case 5: // LSU port
+        if (value < 0 || value > 3) return false;
+        out.ptr = &cpu.lsu[value];
+        return true;
+    case 6: // DMA port
+        if (value < 0 || value > 3) return false;
+        out.ptr = &cpu.dma[value];
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Resolve the destination of a move; false if exec_line would throw.
+bool bind_dest(Cpu& cpu, int type, int value, Dest& kind, int*& out) {
+    switch (type) {
+    case 0:
+        kind = OpShape::Discard;
+        return true;
+    case 1:
+        if (value < 0 || value >= cpu.reg_amount) return false;
+        kind = OpShape::Store;
+        out = reg_ptr(cpu, value);
+        return true;
+    case 2: {
+        // another ALU's AF takes the fallback path like the memory triggers
+        const UnitPort* port = unit_port(UNIT_KINDS[0], value, cpu.alu_count());
+        if (!port || !(port->use & PORT_WRITE)) return false;
+        const int unit = value / ALU_STRIDE, p = value % ALU_STRIDE;
+        kind = OpShape::Store;
+        out = unit == 0 ? &cpu.alu[p] : &cpu.alus[static_cast<size_t>(unit - 1)].port[p];
+        return true;
+    }
+    case 3:
+        if (value == 1) { kind = OpShape::Trigger; return true; }
+        if (value == 5) { kind = OpShape::Halt; return true; }
+        if (value == 6) { kind = OpShape::Store; out = &cpu.fault; return true; }
+        return false;
+    case 4:
+        kind = OpShape::Jump;
+        return true;
+    // memory unit operands are plain stores; their triggers take the
+    // fallback path, so a store to memory always ends its block
+    case 5:
+        if (value != 2) return false;
+        kind = OpShape::Store;
+        out = &cpu.lsu[2];
+        return true;
+    case 6:
+        if (value < 1 || value > 3) return false;
+        kind = OpShape::Store;
+        out = &cpu.dma[value];
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Bind the `width` moves of a bundle into `out`, or false to leave the
+// bundle to Cpu::step_bundle: one too wide, an operand that does not bind, a
+// memory unit trigger, or two moves naming the same destination, which may
+// conflict.
+bool bind_bundle(Cpu& cpu, const Instruction* moves, int width, BundleMove* out, OpShape& shape) {
+    if (width > MAX_BOUND_WIDTH) return false;
+    shape = OpShape{};
+    shape.kind = OpShape::Bundle;
+    for (int i = 0; i < width; ++i) {
+        const Instruction& inst = moves[i];
+        BundleMove& m = out[i];
+        m = BundleMove{};
+        m.cmp = inst.cmp;
+        bool lazy = false;
+        if (inst.cmp == CMP_INVALID || !bind_source(cpu, inst.source_type, inst.source_value, false, m.imm, m.src, lazy)) return false;
+        if (inst.cmp != CMP_NONE) {
+            if (!bind_source(cpu, inst.cond1_type, inst.cond1, true, m.lhs_imm, m.lhs, lazy)) return false;
+            if (!bind_source(cpu, inst.cond2_type, inst.cond2, true, m.rhs_imm, m.rhs, lazy)) return false;
+            shape.conditional = true;
+        }
+        if (inst.dest_type == 2 && inst.dest_value % ALU_STRIDE == 3) {
+            // ALU<n>.AF
+            // (the type 2 spelling of ALU0's is left to the interpreter)
+            const int unit = inst.dest_value / ALU_STRIDE;
+            if (unit == 0 || unit >= cpu.alu_count()) return false;
+            m.kind = OpShape::Trigger;
+            m.unit = &cpu.alus[static_cast<size_t>(unit - 1)];
+            m.a2 = &m.unit->port[2];
+        } else {
+            Dest kind = OpShape::Discard;
+            if (!bind_dest(cpu, inst.dest_type, inst.dest_value, kind, m.dst)) return false;
+            m.kind = kind;
+            if (kind == OpShape::Trigger) m.a2 = &cpu.alu[2];
+        }
+        if (m.kind == OpShape::Jump) shape.kind = OpShape::Jump;
+        else if (m.kind == OpShape::Halt && shape.kind != OpShape::Jump) shape.kind = OpShape::Halt;
+        for (int j = 0; j < i; ++j) {
+            if (inst.dest_type != 0 && moves[j].dest_type == inst.dest_type && moves[j].dest_value == inst.dest_value) return false;
+        }
+    }
+    // a DIV is checked against the A2 its bundle leaves behind
+    for (int i = 0; i < width; ++i) {
+        if (out[i].kind != OpShape::Trigger) continue;
+        for (int j = 0; j < width; ++j) {
+            if (out[j].kind == OpShape::Store && out[j].dst == out[i].a2) out[i].a2_slot = j;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+void ThreadedProgram::translate(Cpu& cpu, const uint8_t* image, size_t image_bytes, int width) {
+    const size_t slots = static_cast<size_t>(width);
+    const size_t count = image_bytes / INSTR_SLOT_SIZE / slots;
+
+    this->width = width;
+    ops.assign(count, ThreadedOp{});
+    shapes.assign(count, OpShape{});
+    moves.assign(count * slots, Instruction{});
+    bound.assign(width > 1 ? count * slots : 0, BundleMove{});
+    blocks.clear();
+    block_at.assign(count, -1);
+    in_block.assign(count, 0);
+    for (size_t i = 0; i < count; ++i) bind(cpu, image, i);
+}
+
+bool ThreadedProgram::refresh(Cpu& cpu, const uint8_t* image, size_t first, size_t end) {
+    end = min(end, ops.size());
+    for (size_t i = first; i < end; ++i) {
+        if (in_block[i]) return false;
+    }
+    for (size_t i = first; i < end; ++i) bind(cpu, image, i);
+    return true;
+}
+
+void ThreadedProgram::bind(Cpu& cpu, const uint8_t* image, size_t pc) {
+    const size_t slots = static_cast<size_t>(width);
+    Instruction* decoded = &moves[pc * slots];
+    for (size_t i = 0; i < slots; ++i) decoded[i] = decode_instruction(image + (pc * slots + i) * INSTR_SLOT_SIZE);
+
+    ThreadedOp& op = ops[pc];
+    OpShape& shape = shapes[pc];
+    op = ThreadedOp{};
+    shape = OpShape{};
+    if (width > 1) {
+        op.inst = decoded;
+        op.imm = width;
+        if (bind_bundle(cpu, decoded, width, &bound[pc * slots], shape)) {
+            op.bundle = &bound[pc * slots];
+            const BundleMove* m = op.bundle;
+            const bool triggers = any_of(m, m + width, [](const BundleMove& move) { return move.kind == OpShape::Trigger; });
+            if (width == 2 && m[0].kind == OpShape::Jump && m[0].cmp != CMP_NONE && m[1].kind == OpShape::Discard && m[1].cmp == CMP_NONE) op.fn = bundle_jump_for(m[0].cmp);
+            else if (width == 2) op.fn = shape.conditional ? pick_bundle2<true>(m[0].kind, m[1].kind) : pick_bundle2<false>(m[0].kind, m[1].kind);
+            else op.fn = width == 4 ? pick_bundle<4>(triggers) : pick_bundle<0>(triggers);
+        } else {
+            op.fn = &op_bundle;
+            shape = OpShape{};
+        }
+        return;
+    }
+
+    const Instruction& inst = *decoded;
+    const Comparator cmp = inst.cmp;
+    Dest kind = OpShape::Discard;
+    bool lazy = false;
+    bool ok = cmp != CMP_INVALID
+        && bind_source(cpu, inst.source_type, inst.source_value, false, op.imm, op.src, lazy)
+        && bind_dest(cpu, inst.dest_type, inst.dest_value, kind, op.dst);
+    if (ok && cmp != CMP_NONE) {
+        ok = bind_source(cpu, inst.cond1_type, inst.cond1, true, op.lhs_imm, op.lhs, lazy)
+            && bind_source(cpu, inst.cond2_type, inst.cond2, true, op.rhs_imm, op.rhs, lazy);
+    }
+
+    if (ok) {
+        op.fn = lazy ? pick_handler<true>(kind, cmp) : pick_handler<false>(kind, cmp);
+        shape.kind = kind;
+        shape.conditional = cmp != CMP_NONE;
+        shape.const_src = inst.source_type == 0;
+    } else {
+        op = ThreadedOp{};
+        op.fn = &op_fallback;
+        op.inst = decoded;
+    }
+}
+
+ThreadedBlock& ThreadedProgram::block_for(int pc) {
+    int& index = block_at[static_cast<size_t>(pc)];
+    if (index >= 0) return blocks[static_cast<size_t>(index)];
+
+    ThreadedBlock block;
+    block.entry = pc;
+    const size_t count = ops.size();
+    for (size_t i = static_cast<size_t>(pc); i < count && block.length < MAX_BLOCK_MOVES; ++i) {
+        ++block.length;
+        const OpShape& shape = shapes[i];
+        if (shape.conditional || shape.kind == OpShape::Jump || shape.kind == OpShape::Halt
+            || shape.kind == OpShape::Fallback) {
+            break;
+        }
+    }
+    for (int i = 0; i < block.length; ++i) in_block[static_cast<size_t>(pc + i)] = 1;
+    // a last bundle with more than one condition is read back from the buses
+    const Instruction* last = &moves[static_cast<size_t>(pc + block.length - 1) * static_cast<size_t>(width)];
+    block.recount = count_if(last, last + width, [](const Instruction& move) { return move.cmp != CMP_NONE; }) > 1;
+    const int counted = block.recount ? block.length - 1 : block.length;
+    for (int i = 0; i < counted; ++i) {
+        for (int k = 0; k < width; ++k) {
+            const Instruction& move = moves[static_cast<size_t>(pc + i) * static_cast<size_t>(width) + static_cast<size_t>(k)];
+            block.taken.count_move(move, true);
+            block.skipped.count_move(move, i + 1 < block.length || move.cmp == CMP_NONE);
+        }
+    }
+    index = static_cast<int>(blocks.size());
+    blocks.push_back(move(block));
+    return blocks.back();
+}
+
+void ThreadedProgram::fuse(ThreadedBlock& block) {
+    auto plain_store = [&](int i) {
+        const OpShape& shape = shapes[static_cast<size_t>(i)];
+        return shape.kind == OpShape::Store && !shape.conditional;
+    };
+    auto const_trigger = [&](int i) {
+        const OpShape& shape = shapes[static_cast<size_t>(i)];
+        return shape.kind == OpShape::Trigger && !shape.conditional && shape.const_src;
+    };
+
+    // an unconditional bound bundle of two moves, each of them `kind` or a
+    // discard, and at least one `kind`
+    auto bundle_of = [&](int i, Dest kind) {
+        const OpShape& shape = shapes[static_cast<size_t>(i)];
+        if (shape.kind != OpShape::Bundle || shape.conditional) return false;
+        const BundleMove* m = ops[static_cast<size_t>(i)].bundle;
+        const Dest k0 = m[0].kind, k1 = m[1].kind;
+        return (k0 == kind || k0 == OpShape::Discard) && (k1 == kind || k1 == OpShape::Discard) && (k0 == kind || k1 == kind);
+    };
+
+    const int end = block.entry + block.length;
+    block.code.clear();
+    int i = block.entry;
+    while (i < end) {
+        const ThreadedOp& a = ops[static_cast<size_t>(i)];
+
+        // operand load(s) + trigger (+ result store)
+        int loads = 0;
+        while (loads < 2 && i + loads < end && plain_store(i + loads)) ++loads;
+        if (loads > 0 && i + loads < end && const_trigger(i + loads)) {
+            const ThreadedOp& trig = ops[static_cast<size_t>(i + loads)];
+            const bool result = i + loads + 1 < end && plain_store(i + loads + 1);
+            ThreadedOp f;
+            f.src = a.src;
+            f.dst = a.dst;
+            if (loads == 2) {
+                f.lhs = ops[static_cast<size_t>(i + 1)].src;
+                f.dst2 = ops[static_cast<size_t>(i + 1)].dst;
+            }
+            f.imm = trig.src.read();
+            if (result) {
+                const ThreadedOp& r = ops[static_cast<size_t>(i + loads + 1)];
+                f.rhs = r.src;
+                f.dst3 = r.dst;
+            }
+            if (loads == 1) f.fn = result ? &op_alu_fused<1, true> : &op_alu_fused<1, false>;
+            else f.fn = result ? &op_alu_fused<2, true> : &op_alu_fused<2, false>;
+            block.code.push_back(f);
+            i += loads + 1 + (result ? 1 : 0);
+            continue;
+        }
+
+        // two plain stores
+        if (plain_store(i) && i + 1 < end && plain_store(i + 1)) {
+            ThreadedOp f;
+            f.fn = &op_store2;
+            f.src = a.src;
+            f.dst = a.dst;
+            f.lhs = ops[static_cast<size_t>(i + 1)].src;
+            f.dst2 = ops[static_cast<size_t>(i + 1)].dst;
+            block.code.push_back(f);
+            i += 2;
+            continue;
+        }
+
+        // the same two idioms in bundles of two moves
+        if (width == 2) {
+            int loads = 0;
+            while (loads < 2 && i + loads < end && bundle_of(i + loads, OpShape::Store)) ++loads;
+            const bool result = i + loads + 1 < end && bundle_of(i + loads + 1, OpShape::Store);
+            // operands may already sit in the ALUs, but then a result is kept
+            if ((loads > 0 || result) && i + loads < end && bundle_of(i + loads, OpShape::Trigger)) {
+                const BundleMove* t = ops[static_cast<size_t>(i + loads)].bundle;
+                const bool per_alu = t[0].kind == OpShape::Trigger && !t[0].unit && t[1].kind == OpShape::Trigger && t[1].unit;
+                ThreadedOp f = a;
+                f.fn = per_alu ? bundle_alu_for<true>(loads, result) : bundle_alu_for<false>(loads, result);
+                block.code.push_back(f);
+                i += loads + 1 + (result ? 1 : 0);
+                continue;
+            }
+            if (loads == 2) {
+                ThreadedOp f = a;
+                f.fn = &op_bundle_store2;
+                block.code.push_back(f);
+                i += 2;
+                continue;
+            }
+        }
+
+        // operands still point into ops (constants included), which never move
+        block.code.push_back(a);
+        ++i;
+    }
+    block.fused = true;
+}
+
+void ThreadedProgram::count(const Cpu& cpu, int pc, bool taken, MoveTally& tally) const {
+    const Instruction* bundle = &moves[static_cast<size_t>(pc) * static_cast<size_t>(width)];
+    if (width == 1) {
+        tally.count_move(*bundle, taken);
+        return;
+    }
+    for (size_t i = 0; i < static_cast<size_t>(width); ++i) tally.count_move(bundle[i], cpu.bus_active[i]);
+}
+
+void ThreadedProgram::count_taken(int pc, MoveTally& tally) const {
+    const Instruction* bundle = &moves[static_cast<size_t>(pc) * static_cast<size_t>(width)];
+    for (size_t i = 0; i < static_cast<size_t>(width); ++i) tally.count_move(bundle[i], true);
+}
+
+void ThreadedProgram::run(Cpu& cpu, uint64_t budget, MoveTally& tally) {
+    execute(cpu, budget, tally);
+    for (ThreadedBlock& block : blocks) {
+        tally.add(block.taken, block.taken_runs);
+        tally.add(block.skipped, block.skipped_runs);
+        block.taken_runs = block.skipped_runs = 0;
+    }
+    // AF writes were counted by the value they carried
+    static_assert(sizeof(cpu.triggered) / sizeof(cpu.triggered[0]) == ALU_KINDS);
+    for (int k = 0; k < ALU_KINDS; ++k) {
+        tally.alu[k] += cpu.triggered[k];
+        cpu.triggered[k] = 0;
+    }
+}
+
+void ThreadedProgram::execute(Cpu& cpu, uint64_t budget, MoveTally& tally) {
+    const size_t count = ops.size();
+    while (budget > 0 && !cpu.halted && !cpu.resync && cpu.pc >= 0 && static_cast<size_t>(cpu.pc) < count) {
+        ThreadedBlock& block = block_for(cpu.pc);
+        if (static_cast<uint64_t>(block.length) > budget) {
+            // not enough budget for the whole block: finish one move at a
+            // time; the block's last move is never reached, so PC stays linear
+            for (; budget > 0; --budget) {
+                const int at = cpu.pc;
+                const ThreadedOp& op = ops[static_cast<size_t>(at)];
+                op.fn(cpu, op);
+                if (cpu.trap) break;
+                this->count(cpu, at, true, tally);
+                ++cpu.cycles;
+            }
+            // a trap the guest takes costs the faulting move's cycle
+            if (!cpu.trap || !cpu.take_trap()) return;
+            ++cpu.cycles;
+            --budget;
+            continue;
+        }
+        if (!block.fused && ++block.runs >= FUSE_THRESHOLD) fuse(block);
+
+        const ThreadedOp* op;
+        const ThreadedOp* last;
+        if (block.fused) {
+            op = block.code.data();
+            last = op + block.code.size();
+        } else {
+            op = &ops[static_cast<size_t>(block.entry)];
+            last = op + block.length;
+        }
+        // only the final move of a block can jump, halt or fail a condition
+        const uint64_t not_taken = cpu.not_taken;
+        for (; op != last; ++op) {
+            op->fn(cpu, *op);
+            if (cpu.trap) break;
+        }
+        if (cpu.trap) {
+            // the faulting move kept its PC; everything before it retired
+            const uint64_t retired = static_cast<uint64_t>(cpu.pc - block.entry);
+            for (int at = block.entry; at < cpu.pc; ++at) count_taken(at, tally);
+            cpu.cycles += retired;
+            budget -= retired;
+            if (!cpu.take_trap()) return;
+            ++cpu.cycles;
+            --budget;
+            continue;
+        }
+        if (block.recount) {
+            ++block.taken_runs;
+            this->count(cpu, block.entry + block.length - 1, true, tally);
+        } else {
+            ++(cpu.not_taken != not_taken ? block.skipped_runs : block.taken_runs);
+        }
+        cpu.cycles += static_cast<uint64_t>(block.length);
+        budget -= static_cast<uint64_t>(block.length);
+    }
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "cpu.hpp"
+#include "telemetry.hpp"
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+struct ThreadedOp;
+using OpHandler = void (*)(Cpu& cpu, const ThreadedOp& op);
+
+// A readable operand bound to its storage: (*ptr >> shift) & mask. Plain
+// storage uses shift 0 / mask -1; a flag reads its bit of Cpu::flags.
+struct BoundOperand {
+    const int* ptr = nullptr;
+    int shift = 0;
+    int mask = -1;
+    int read() const { return (*ptr >> shift) & mask; }
+};
+
+// What the fusion pass needs to know about a translated move. A bundle
+// whose moves all bound is a Bundle, or a Jump or Halt if one of its moves
+// writes PC or HF.
+struct OpShape {
+    enum Kind : uint8_t { Discard, Store, Trigger, Halt, Jump, Fallback, Bundle };
+    Kind kind = Fallback;
+    bool conditional = false;
+    bool const_src = false;
+};
+
+// One move of a bound bundle. Triggers name ALU0 (unit null) or another ALU;
+// a2 is the A2 a DIV would divide by and a2_slot the move in the bundle
+// that writes it, if any, so the divide can be checked before the commit.
+struct BundleMove {
+    BoundOperand src, lhs, rhs;
+    int imm = 0, lhs_imm = 0, rhs_imm = 0;
+    Comparator cmp = CMP_NONE;
+    OpShape::Kind kind = OpShape::Discard;
+    int* dst = nullptr;
+    AluUnit* unit = nullptr;
+    const int* a2 = nullptr;
+    int a2_slot = -1;
+};
+
+// A pre-resolved move. The handler is picked from the dest/condition kinds at
+// translation time and every operand is bound to a pointer into the Cpu, so
+// executing a move is one indirect call with no decoding or range checks.
+struct ThreadedOp {
+    OpHandler fn = nullptr;
+    BoundOperand src;          // value to transport
+    int* dst = nullptr;        // register / ALU operand port for plain stores
+    BoundOperand lhs;          // condition operands
+    BoundOperand rhs;
+    int imm = 0;               // storage for a constant source
+    int lhs_imm = 0;           // storage for constant condition operands
+    int rhs_imm = 0;
+    const Instruction* inst = nullptr; // original move(s) for fallback ops and bundles
+    const BundleMove* bundle = nullptr; // a bound bundle's imm moves; fused, the first bundle's
+    // Superinstructions chain further stores: lhs -> dst2, rhs -> dst3
+    int* dst2 = nullptr;
+    int* dst3 = nullptr;
+};
+
+// Blocks are fused into superinstructions once they have run this many times.
+constexpr uint32_t FUSE_THRESHOLD = 8;
+// Upper bound on the moves in one block.
+constexpr int MAX_BLOCK_MOVES = 1024;
+
+// A straight-line run of moves entered at `entry`. It ends after a PC or HF
+// write, a condition-guarded move or a fallback move, so only its last move
+// can leave the fall-through path.
+struct ThreadedBlock {
+    int entry = 0;
+    int length = 0;           // moves covered, i.e. PC advance on fall-through
+    uint32_t runs = 0;
+    bool fused = false;
+    // Moves counted once at discovery: every move taken, and the same with
+    // the last one's condition failing (the only move that can have one),
+    // with the runs of each since run() last counted them. AF writes are
+    // counted by their handlers instead (see Cpu::triggered). A last bundle
+    // with more than one condition is left out (`recount`) and read back
+    // from the buses after each run
+    MoveTally taken, skipped;
+    bool recount = false;
+    uint64_t taken_runs = 0, skipped_runs = 0;
+    std::vector<ThreadedOp> code; // fused translation, once hot
+};
+
+// Translates a packed image (see encoding.hpp) once and runs it through call-threaded
+// dispatch. Anything the translator does not resolve (bad operands, unknown
+// comparators) is bound to a handler that runs the move through Cpu::step, so
+// the architectural result always matches Computer::run_from_ram.
+//
+// Execution is block at a time: blocks are discovered lazily and cached by
+// entry PC, and a block that turns hot has its operand-load/trigger/result
+// idioms fused into single superinstructions.
+//
+// Images with bundles wider than one slot translate each bundle to a single
+// op. One whose moves all bind reads and commits them without checks, and
+// bundles with no condition, PC or HF write share blocks like single moves.
+// In bundles of two, fusion runs the same idioms a bundle at a time, with one
+// ALU per move; the rest issue through Cpu::step_bundle.
+class ThreadedProgram {
+public:
+    void translate(Cpu& cpu, const uint8_t* image, size_t image_bytes, int width = 1);
+    // Translate bundles [first, end) again after the image changed there.
+    // False, with nothing changed, if one of them is already part of a
+    // block; only a full translate() brings those up to date.
+    bool refresh(Cpu& cpu, const uint8_t* image, size_t first, size_t end);
+    // Run until halt, PC leaves the image, `budget` cycles have retired or
+    // cpu.resync is set, adding the moves that retired to `tally`
+    void run(Cpu& cpu, uint64_t budget, MoveTally& tally);
+    size_t size() const { return ops.size(); }
+
+    std::vector<ThreadedOp> ops;      // one per PC, never resized after translate
+    std::vector<OpShape> shapes;      // parallel to ops
+    std::vector<Instruction> moves;   // decoded bundles, contiguous per PC; ThreadedOp::inst points here
+    std::vector<BundleMove> bound;    // bound bundles, width per PC; ThreadedOp::bundle points here
+
+    std::vector<ThreadedBlock> blocks;
+    std::vector<int> block_at;        // entry PC -> index into blocks, -1 if none
+    std::vector<uint8_t> in_block;    // per PC: covered by some block
+
+private:
+    void bind(Cpu& cpu, const uint8_t* image, size_t pc);
+    ThreadedBlock& block_for(int pc);
+    void fuse(ThreadedBlock& block);
+    // run() before the block runs are counted into the tally
+    void execute(Cpu& cpu, uint64_t budget, MoveTally& tally);
+    // The moves at `pc` after they ran; bundles read back which were taken
+    void count(const Cpu& cpu, int pc, bool taken, MoveTally& tally) const;
+    // The moves at `pc` as all taken, for those before a block's last
+    void count_taken(int pc, MoveTally& tally) const;
+    int width = 1;
+};
@@ -0,0 +1,163 @@
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "trace.hpp"
+#include "units.hpp"
+
+using namespace std;
+
+static void put_u16(uint8_t* p, uint16_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+}
+
+static void put_u32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; ++i) p[i] = static_cast<uint8_t>(v >> (8 * i));
+}
+
+static uint16_t get_u16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8)
+        | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static void encode_record(const TraceRecord& r, uint8_t* p) {
+    put_u32(p, static_cast<uint32_t>(r.cycle));
+    put_u32(p + 4, static_cast<uint32_t>(r.cycle >> 32));
+    put_u32(p + 8, static_cast<uint32_t>(r.pc));
+    put_u32(p + 12, static_cast<uint32_t>(r.value));
+    put_u16(p + 16, static_cast<uint16_t>(r.dest_value));
+    put_u16(p + 18, r.slot);
+    p[20] = r.dest_type;
+    p[21] = r.flags;
+    p[22] = p[23] = 0;
+}
+
+static TraceRecord decode_record(const uint8_t* p) {
+    TraceRecord r;
+    r.cycle = get_u32(p) | static_cast<uint64_t>(get_u32(p + 4)) << 32;
+    r.pc = static_cast<int32_t>(get_u32(p + 8));
+    r.value = static_cast<int32_t>(get_u32(p + 12));
+    r.dest_value = static_cast<int16_t>(get_u16(p + 16));
+    r.slot = get_u16(p + 18);
+    r.dest_type = p[20];
+    r.flags = p[21];
+    return r;
+}
+
+Tracer::Tracer(const string& path_, size_t capacity) : path(path_) {
+    size_t size = 1;
+    while (size < capacity) size <<= 1;
+    ring.resize(size);
+    mask = size - 1;
+
+    out.open(path, ios::binary | ios::trunc);
+    if (!out) throw runtime_error("trace: cannot create " + path);
+    uint8_t header[TRACE_HEADER_SIZE];
+    put_u32(header, TRACE_MAGIC);
+    put_u16(header + 4, TRACE_VERSION);
+    put_u16(header + 6, static_cast<uint16_t>(TRACE_RECORD_SIZE));
+    out.write(reinterpret_cast<const char*>(header), TRACE_HEADER_SIZE);
+    drainer = thread(&Tracer::drain, this);
+}
+
+Tracer::~Tracer() {
+    try {
+        stop();
+    } catch (...) {
+        // a failed write was only reportable through stop()
+    }
+}
+
+void Tracer::stop() {
+    if (!drainer.joinable()) return;
+    stopping.store(true, memory_order_release);
+    drainer.join();
+    out.close();
+    if (failed || !out) throw runtime_error("trace: write to " + path + " failed");
+}
+
+void Tracer::drain() {
+    // records are encoded off the hot path, a batch at a time
+    vector<uint8_t> buffer;
+    for (;;) {
+        const bool last = stopping.load(memory_order_acquire);
+        const uint64_t t = tail.load(memory_order_relaxed);
+        const uint64_t h = head.load(memory_order_acquire);
+        if (h == t) {
+            if (last) return; // the producer had stopped before this look
+            this_thread::sleep_for(chrono::microseconds(200));
+            continue;
+        }
+        buffer.resize(static_cast<size_t>(h - t) * TRACE_RECORD_SIZE);
+        for (uint64_t i = t; i < h; ++i) {
+            encode_record(ring[i & mask], buffer.data() + static_cast<size_t>(i - t) * TRACE_RECORD_SIZE);
+        }
+        tail.store(h, memory_order_release);
+        // keep consuming after a failure so the producer never waits forever
+        if (!failed && !out.write(reinterpret_cast<const char*>(buffer.data()), static_cast<streamsize>(buffer.size()))) failed = true;
+    }
+}
+
+// How the assembler spells a destination
+static string dest_text(int type, int value) {
+    switch (type) {
+    case 0: return "-";
+    case 1: return "R" + to_string(value);
+    case 3: return value == 1 ? "AF" : value == 5 ? "HF" : value == 6 ? "TF" : "flag " + to_string(value);
+    case 4: return "PC";
+    default: return unit_kind(type) ? unit_operand_name(type, value) : "dest " + to_string(type);
+    }
+}
+
+void decode_trace(istream& in, ostream& out) {
+    uint8_t header[TRACE_HEADER_SIZE];
+    if (!in.read(reinterpret_cast<char*>(header), TRACE_HEADER_SIZE) || get_u32(header) != TRACE_MAGIC) {
+        throw runtime_error("decode_trace: not a yatta trace");
+    }
+    if (get_u16(header + 4) != TRACE_VERSION) {
+        throw runtime_error("decode_trace: unsupported trace version " + to_string(get_u16(header + 4)));
+    }
+    const size_t record_size = get_u16(header + 6);
+    if (record_size < TRACE_RECORD_SIZE) throw runtime_error("decode_trace: records of " + to_string(record_size) + " bytes are too short");
+
+    vector<uint8_t> raw(record_size);
+    uint64_t count = 0;
+    while (in.read(reinterpret_cast<char*>(raw.data()), static_cast<streamsize>(record_size))) {
+        const TraceRecord r = decode_record(raw.data());
+        // moves after the first in a bundle show as pc.slot
+        const string at = r.slot ? to_string(r.pc) + "." + to_string(r.slot) : to_string(r.pc);
+        out << setw(12) << r.cycle << "  pc " << setw(8) << at << "  ";
+        if (r.flags & TRACE_TAKEN) out << dest_text(r.dest_type, r.dest_value) << " <- " << r.value;
+        else out << "(" << dest_text(r.dest_type, r.dest_value) << " skipped)";
+        if (r.flags & TRACE_GUARDED) out << (r.flags & TRACE_TAKEN ? "  [condition held]" : "  [condition failed]");
+        out << '\n';
+        ++count;
+    }
+    if (in.gcount() != 0) throw runtime_error("decode_trace: trace truncated after " + to_string(count) + " records");
+}
+
+int trace_main(int argc, char** argv) {
+    if (argc != 1) {
+        cerr << "Usage: yatta trace <file.trace>" << endl;
+        return 2;
+    }
+    try {
+        ifstream in(argv[0], ios::binary);
+        if (!in) throw runtime_error(string("cannot open ") + argv[0]);
+        decode_trace(in, cout);
+    } catch (const exception& e) {
+        cout.flush();
+        cerr << "trace: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "cpu.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iosfwd>
+#include <string>
+#include <thread>
+#include <vector>
+
+// --- Binary execution trace ---
+// A trace file is a header followed by one fixed-size record per move the
+// interpreter issued, little endian like program images:
+//   header  u32 magic, u16 version, u16 record size
+//   record  u64 cycle, u32 PC, u32 value moved, i16 dest value, u16 slot in
+//           the bundle, u8 dest type, u8 flags (TRACE_*), 2 reserved bytes
+// A move whose condition failed carries value 0.
+constexpr uint32_t TRACE_MAGIC = 0x52545459; // "YTTR"
+constexpr uint16_t TRACE_VERSION = 1;
+constexpr size_t TRACE_HEADER_SIZE = 8;
+constexpr size_t TRACE_RECORD_SIZE = 24;
+
+constexpr uint8_t TRACE_GUARDED = 1 << 0; // the move had a condition
+constexpr uint8_t TRACE_TAKEN = 1 << 1;   // ... and it held (always set if unguarded)
+
+struct TraceRecord {
+    uint64_t cycle = 0;
+    int32_t pc = 0;
+    int32_t value = 0;
+    int16_t dest_value = 0;
+    uint16_t slot = 0;
+    uint8_t dest_type = 0;
+    uint8_t flags = 0;
+};
+
+// Records moves into a single-producer ring buffer that a background thread
+// drains to a trace file, so the thread running the machine only copies a
+// record and publishes an index. If the file cannot keep up the producer
+// waits for room rather than dropping records; stalls() counts those waits.
+// Point Computer::tracer at one to trace the interpreter.
+class Tracer {
+public:
+    // Opens `path` and starts the drain thread; `capacity` records, rounded
+    // up to a power of two. Throws std::runtime_error if the file cannot be
+    // created.
+    explicit Tracer(const std::string& path, size_t capacity = 1 << 16);
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+    ~Tracer();
+
+    void record(uint64_t cycle, int pc, int slot, const Instruction& move, bool taken, int value) {
+        TraceRecord r;
+        r.cycle = cycle;
+        r.pc = pc;
+        r.value = taken ? value : 0;
+        r.dest_value = static_cast<int16_t>(move.dest_value);
+        r.slot = static_cast<uint16_t>(slot);
+        r.dest_type = static_cast<uint8_t>(move.dest_type);
+        r.flags = static_cast<uint8_t>((move.cmp != CMP_NONE ? TRACE_GUARDED : 0) | (taken ? TRACE_TAKEN : 0));
+        push(r);
+    }
+
+    // Drain what is left, join the thread and close the file. Throws
+    // std::runtime_error if a write failed; later calls do nothing.
+    void stop();
+
+    uint64_t records() const { return head.load(std::memory_order_relaxed); }
+    // Times record() found the ring full; readable while a run records
+    uint64_t stalls() const { return stall_count.load(std::memory_order_relaxed); }
+    const std::string path;
+
+private:
+    void push(const TraceRecord& r) {
+        const uint64_t h = head.load(std::memory_order_relaxed);
+        if (h - tail_seen > mask) {
+            tail_seen = tail.load(std::memory_order_acquire);
+            while (h - tail_seen > mask) {
+                stall_count.fetch_add(1, std::memory_order_relaxed);
+                std::this_thread::yield();
+                tail_seen = tail.load(std::memory_order_acquire);
+            }
+        }
+        ring[h & mask] = r;
+        head.store(h + 1, std::memory_order_release);
+    }
+    void drain();
+
+    std::vector<TraceRecord> ring;
+    uint64_t mask = 0;
+    uint64_t tail_seen = 0; // producer's last look at tail
+    // producer and drain thread each own one index; kept on separate lines
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    std::atomic<bool> stopping{false};
+    std::atomic<uint64_t> stall_count{0}; // bumped by the producer only
+    std::ofstream out;
+    bool failed = false; // set by the drain thread, read after the join
+    std::thread drainer;
+};
+
+// Print a trace file as one line per move. Throws std::runtime_error on a
+// bad header or a truncated record.
+void decode_trace(std::istream& in, std::ostream& out);
+
+// `yatta trace <file.trace>`: decode_trace to stdout
+int trace_main(int argc, char** argv);
@@ -0,0 +1,128 @@
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "units.hpp"
+
+using namespace std;
+
+static constexpr UnitPort ALU_PORTS[ALU_STRIDE] = {
+    { "A0", PORT_READ }, { "A1", PORT_READ | PORT_WRITE }, { "A2", PORT_READ | PORT_WRITE }, { "AF", PORT_TRIGGER },
+    { "ZF", PORT_READ }, { "NF", PORT_READ }, { "OF", PORT_READ }, { "", 0 },
+};
+static constexpr UnitPort LSU_PORTS[4] = {
+    { "L0", PORT_READ }, { "L1", PORT_READ | PORT_TRIGGER }, { "L2", PORT_READ | PORT_WRITE }, { "L3", PORT_READ | PORT_TRIGGER },
+};
+static constexpr UnitPort DMA_PORTS[4] = {
+    { "D0", PORT_READ | PORT_TRIGGER }, { "D1", PORT_READ | PORT_WRITE }, { "D2", PORT_READ | PORT_WRITE }, { "D3", PORT_READ | PORT_WRITE },
+};
+
+const UnitKind UNIT_KINDS[3] = {
+    { "ALU", 2, ALU_STRIDE, ALU_PORTS, 1, FLAG_ZF | FLAG_NF | FLAG_OF, MAX_ALUS },
+    { "LSU", 5, 4, LSU_PORTS, 1, 0, 1 },
+    { "DMA", 6, 4, DMA_PORTS, 1, 0, 1 },
+};
+
+const UnitKind* unit_kind(int type) {
+    for (const UnitKind& kind : UNIT_KINDS) {
+        if (kind.type == type) return &kind;
+    }
+    return nullptr;
+}
+
+const UnitPort* unit_port(const UnitKind& kind, int value, int instances) {
+    if (value < 0 || value / kind.stride >= instances) return nullptr;
+    const UnitPort& port = kind.ports[value % kind.stride];
+    return port.use ? &port : nullptr;
+}
+
+bool parse_unit_operand(string_view token, int& type, int& value) {
+    const size_t dot = token.find('.');
+    if (dot == string_view::npos) return false;
+    for (const UnitKind& kind : UNIT_KINDS) {
+        const string_view name(kind.name);
+        if (token.substr(0, name.size()) != name || dot == name.size()) continue;
+
+        const string_view digits = token.substr(name.size(), dot - name.size());
+        int instance = 0;
+        for (char c : digits) {
+            if (c < '0' || c > '9') return false;
+            instance = instance * 10 + (c - '0');
+            if (instance >= kind.max_instances) throw runtime_error("unit " + string(token) + " is beyond " + to_string(kind.max_instances) + " " + kind.name + "s");
+        }
+        const string_view port_name = token.substr(dot + 1);
+        for (int p = 0; p < kind.stride; ++p) {
+            if (!kind.ports[p].use || port_name != kind.ports[p].name) continue;
+            if (kind.type == 2 && instance == 0 && p >= 3) {
+                // AF, ZF, NF, OF of the first ALU are flag operands 1-4
+                type = 3;
+                value = p - 2;
+            } else {
+                type = kind.type;
+                value = instance * kind.stride + p;
+            }
+            return true;
+        }
+        throw runtime_error("unit " + string(kind.name) + " has no port '" + string(port_name) + "'");
+    }
+    return false;
+}
+
+string unit_operand_name(int type, int value) {
+    const UnitKind* kind = unit_kind(type);
+    if (!kind) return "operand type " + to_string(type);
+    if (value < 0) return string(kind->name) + " port " + to_string(value);
+    const int instance = value / kind->stride;
+    const UnitPort& port = kind->ports[value % kind->stride];
+    const string name = port.use ? string(port.name) : "port " + to_string(value % kind->stride);
+    return instance == 0 && port.use ? name : string(kind->name) + to_string(instance) + "." + name;
+}
+
+static bool add_overflows(int a, int b, int& result) {
+    if (b > 0 && a > numeric_limits<int>::max() - b) return true;
+    if (b < 0 && a < numeric_limits<int>::min() - b) return true;
+    result = a + b;
+    return false;
+}
+
+static bool mul_overflows(int a, int b, int& result) {
+    if (a == 0 || b == 0) {
+        result = 0;
+        return false;
+    }
+    if (a > 0 && b > 0 && a > numeric_limits<int>::max() / b) return true;
+    if (a < 0 && b < 0 && a < numeric_limits<int>::max() / b) return true;
+    if (a > 0 && b < 0 && b < numeric_limits<int>::min() / a) return true;
+    if (a < 0 && b > 0 && a < numeric_limits<int>::min() / b) return true;
+    result = a * b;
+    return false;
+}
+
+AluResult alu_compute(int op, int lhs, int rhs, int current) {
+    int result = 0;
+    uint32_t f = 0;
+    switch (op) {
+    case 1: // ADD
+        if (add_overflows(lhs, rhs, result)) f |= FLAG_OF;
+        break;
+    case 2: // SUB (A - B), computed as A + (-B) with -INT_MIN wrapping
+        if (add_overflows(lhs, static_cast<int>(0u - static_cast<unsigned int>(rhs)), result)) f |= FLAG_OF;
+        break;
+    case 3: // MUL
+        if (mul_overflows(lhs, rhs, result)) f |= FLAG_OF;
+        break;
+    case 4: // DIV (divisor checked non-zero by the caller)
+        // INT_MIN / -1 overflows like MUL instead of trapping the host
+        if (lhs == numeric_limits<int>::min() && rhs == -1) f |= FLAG_OF;
+        else result = lhs / rhs;
+        break;
+    default:
+        result = current;
+        break;
+    }
+    if (result == 0) f |= FLAG_ZF;
+    if (result < 0) f |= FLAG_NF;
+    return { result, f };
+}
+
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// --- Function units ---
+// Moves reach the ALUs, the LSU and the DMA unit through operand types 2, 5
+// and 6. Each kind is described once in UNIT_KINDS, and the assembler,
+// disassembler and verifier take port names, access rules and instance
+// counts from there instead of keeping switches of their own.
+//
+// A unit operand value packs instance * stride + port, so ALU1.A2 is type 2,
+// value 10. The first instance keeps the short spellings (A1, L2, D0, ...),
+// and the first ALU's trigger and flags stay the flag operands AF, ZF, NF
+// and OF, which every engine handles inline.
+
+// ALU flag bits in Cpu::flags and AluUnit::flags; flag operand codes 2/3/4 (ZF/NF/OF) map to bit code - 2
+constexpr uint32_t FLAG_ZF = 1u << 0;
+constexpr uint32_t FLAG_NF = 1u << 1;
+constexpr uint32_t FLAG_OF = 1u << 2;
+
+enum PortUse : uint8_t {
+    PORT_READ = 1,    // sources and conditions may read it
+    PORT_WRITE = 2,   // plain store
+    PORT_TRIGGER = 4, // a write starts the unit; in a bundle it commits after the stores
+};
+
+struct UnitPort {
+    const char* name; // spelled after the unit prefix, e.g. "A1"
+    uint8_t use;      // PortUse bits; 0 for a gap in the numbering
+};
+
+struct UnitKind {
+    const char* name;       // prefix of the long spelling, e.g. "ALU"
+    int type;               // operand type code
+    int stride;             // port values per instance
+    const UnitPort* ports;  // stride entries
+    int latency;            // cycles from a trigger until its results read back
+    uint32_t flags;         // FLAG_* bits a trigger updates
+    int max_instances;
+};
+
+constexpr int ALU_STRIDE = 8; // A0, A1, A2, AF, ZF, NF, OF and a spare
+constexpr int MAX_ALUS = 64;
+
+// ALU, LSU, DMA
+extern const UnitKind UNIT_KINDS[3];
+
+// nullptr for operand types that are not units
+const UnitKind* unit_kind(int type);
+// The port `value` names on a machine with `instances` units of `kind`, or
+// nullptr if there is none
+const UnitPort* unit_port(const UnitKind& kind, int value, int instances);
+// Whether writing (type, value) starts a unit, AF included. Bundles ask this
+// twice per move each cycle, so it is spelled out here rather than looked up;
+// it must agree with the PORT_TRIGGER entries of UNIT_KINDS.
+inline bool is_trigger(int type, int value) {
+    switch (type) {
+    case 2: return value % ALU_STRIDE == 3; // ALU<n>.AF
+    case 3: return value == 1;              // AF
+    case 5: return value == 1 || value == 3;
+    case 6: return value == 0;
+    default: return false;
+    }
+}
+// Long spellings such as ALU1.A2 or LSU0.L1; false for anything else. The
+// first ALU's AF, ZF, NF and OF come back as their flag operands.
+bool parse_unit_operand(std::string_view token, int& type, int& value);
+// How the assembler spells a unit operand
+std::string unit_operand_name(int type, int value);
+
+struct AluResult {
+    int value;
+    uint32_t flags;
+};
+// One ALU op on latched operands: 1 ADD, 2 SUB, 3 MUL, 4 DIV. Any other op
+// keeps `current` and refreshes the flags from it. An overflowing result
+// reads 0 with OF set; the caller rejects DIV by zero.
+AluResult alu_compute(int op, int lhs, int rhs, int current);
+
+// ALU1 and up. The first ALU latches its op and evaluates it when A0 or a
+// flag is read (see Cpu::trigger_alu); these evaluate when triggered, so
+// every port is plain storage the engines can bind to.
+struct AluUnit {
+    int port[3] = { 0, 0, 0 }; // A0 result, A1, A2
+    uint32_t flags = 0;
+
+    // False on DIV by zero, leaving the flags clear; the caller raises the trap
+    bool trigger(int op) {
+        if (op == 0) return true; // no operation requested
+        if (op == 4 && port[2] == 0) {
+            flags = 0;
+            return false;
+        }
+        const AluResult r = alu_compute(op, port[1], port[2], port[0]);
+        port[0] = r.value;
+        flags = r.flags;
+        return true;
+    }
+    // Ports 0-2, or 4-6 for ZF, NF and OF
+    int read(int p) const { return p <= 2 ? port[p] : static_cast<int>((flags >> (p - 4)) & 1); }
+};
@@ -0,0 +1,123 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cpu.hpp"
+#include "encoding.hpp"
+#include "units.hpp"
+#include "verifier.hpp"
+
+using namespace std;
+
+static const char* const FLAG_NAMES[7] = { "", "AF", "ZF", "NF", "OF", "HF", "TF" };
+
+// How the assembler spells an operand, for diagnostics
+static string operand_name(int type, int value) {
+    switch (type) {
+    case 0: return to_string(value);
+    case 1: return "R" + to_string(value);
+    case 3: return value >= 1 && value <= 6 ? string(FLAG_NAMES[value]) : "flag " + to_string(value);
+    case 4: return "PC";
+    default: return unit_operand_name(type, value);
+    }
+}
+
+static string check_register(int value, int reg_count, const char* role) {
+    if (value >= 0 && value < reg_count) return {};
+    return string(role) + " register R" + to_string(value) + " out of range (machine has " + to_string(reg_count) + " registers)";
+}
+
+// Units of a kind on the machine being checked
+static int instances(const UnitKind& kind, int alu_count) {
+    return kind.type == 2 ? alu_count : kind.max_instances;
+}
+
+// Readable operands: sources, and condition operands, which may also read HF
+// A unit port for `role`; `use` is the access it needs
+static string check_unit(const UnitKind& kind, int value, int alu_count, uint8_t use, const char* role) {
+    const int type = kind.type;
+    const UnitPort* port = unit_port(kind, value, instances(kind, alu_count));
+    if (!port) return string(role) + " " + kind.name + " port " + operand_name(type, value) + " does not exist";
+    if (!(port->use & use)) return string(role) + " " + operand_name(type, value) + (use == PORT_READ ? " is not readable" : " is not writable");
+    return {};
+}
+
+static string check_readable(int type, int value, int reg_count, int alu_count, bool in_condition, const char* role) {
+    switch (type) {
+    case 0:
+    case 4:
+        return {};
+    case 1:
+        return check_register(value, reg_count, role);
+    case 3:
+        if ((value >= 1 && value <= 4) || value == 6) return {};
+        if (value == 5 && in_condition) return {};
+        if (value == 5) return string(role) + " HF is only readable in conditions";
+        return string(role) + " flag code " + to_string(value) + " does not exist";
+    case -1:
+        return string(role) + " is missing";
+    default:
+        if (const UnitKind* kind = unit_kind(type)) return check_unit(*kind, value, alu_count, PORT_READ, role);
+        return string(role) + " has unknown operand type " + to_string(type);
+    }
+}
+
+string check_move(const Instruction& move, int reg_count, int alu_count) {
+    string problem = check_readable(move.source_type, move.source_value, reg_count, alu_count, false, "source");
+    if (!problem.empty()) return problem;
+
+    switch (move.dest_type) {
+    case 0:
+    case 4:
+        break;
+    case 1:
+        problem = check_register(move.dest_value, reg_count, "dest");
+        break;
+    case 3:
+        if (move.dest_value != 1 && move.dest_value != 5 && move.dest_value != 6) {
+            problem = "dest " + operand_name(3, move.dest_value) + " is not a writable flag (only AF, HF and TF are)";
+        }
+        break;
+    default:
+        if (const UnitKind* kind = unit_kind(move.dest_type)) problem = check_unit(*kind, move.dest_value, alu_count, PORT_WRITE | PORT_TRIGGER, "dest");
+        else problem = "unknown dest type " + to_string(move.dest_type);
+        break;
+    }
+    if (!problem.empty() || move.cmp == CMP_NONE) return problem;
+
+    if (move.cmp >= CMP_INVALID) return "unknown comparator " + to_string(static_cast<int>(move.cmp));
+    problem = check_readable(move.cond1_type, move.cond1, reg_count, alu_count, true, "left condition operand");
+    if (problem.empty()) problem = check_readable(move.cond2_type, move.cond2, reg_count, alu_count, true, "right condition operand");
+    return problem;
+}
+
+string check_bundle(const Instruction* moves, int width, int reg_count, size_t pc, int alu_count) {
+    auto where = [&](int i) {
+        return width == 1 ? "instruction " + to_string(pc) : "bundle " + to_string(pc) + " move " + to_string(i);
+    };
+    for (int i = 0; i < width; ++i) {
+        const Instruction& m = moves[i];
+        string problem = check_move(m, reg_count, alu_count);
+        if (!problem.empty()) return where(i) + ": " + problem;
+        // same rule as Cpu::step_bundle, for moves that are always taken
+        if (m.dest_type == 0 || m.cmp != CMP_NONE) continue;
+        for (int j = 0; j < i; ++j) {
+            if (moves[j].cmp == CMP_NONE && moves[j].dest_type == m.dest_type && moves[j].dest_value == m.dest_value) {
+                return where(i) + ": always writes " + operand_name(m.dest_type, m.dest_value) + " in the same cycle as move " + to_string(j);
+            }
+        }
+    }
+    return {};
+}
+
+string verify_slots(const uint8_t* image, size_t first, size_t bundle_count, int width, int reg_count, int alu_count) {
+    const size_t w = static_cast<size_t>(width);
+    vector<Instruction> bundle(w);
+    for (size_t pc = first; pc < first + bundle_count; ++pc) {
+        const uint8_t* slot = image + pc * w * INSTR_SLOT_SIZE;
+        for (size_t i = 0; i < w; ++i) bundle[i] = decode_instruction(slot + i * INSTR_SLOT_SIZE);
+        string problem = check_bundle(bundle.data(), width, reg_count, pc, alu_count);
+        if (!problem.empty()) return problem;
+    }
+    return {};
+}
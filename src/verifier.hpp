@@ -0,0 +1,25 @@
+#pragma once
+
+#include "cpu.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Load-time checks on machine code. Operands are static fields of a move, so
+// whether a move can address its source, destination and condition operands
+// on a machine with `reg_count` registers and `alu_count` ALUs is known
+// before it runs. A program that passes needs no per-move operand checks at
+// run time; only a DIV by zero, a bus conflict between conditional moves and
+// a jump out of range remain dynamic.
+//
+// Each check returns a description of the first problem found, or an empty
+// string if there is none.
+
+// One move on its own
+std::string check_move(const Instruction& move, int reg_count, int alu_count = 1);
+// A bundle of `width` moves issued at `pc`: each move, plus pairs of
+// unconditional moves that would always write the same destination
+std::string check_bundle(const Instruction* moves, int width, int reg_count, size_t pc, int alu_count = 1);
+// `bundle_count` packed bundles (see encoding.hpp) starting at bundle `first`
+// of `image`
+std::string verify_slots(const uint8_t* image, size_t first, size_t bundle_count, int width, int reg_count, int alu_count = 1);
@@ -1,7 +1,19 @@
+#include <string>
+
+#include "batch.hpp"
 #include "shell.hpp"
+#include "trace.hpp"
 
 using namespace std;
 
-int main(){
+int main(int argc, char** argv){
+    // yatta batch ... runs images headless; otherwise start the shell
+    if (argc > 1 && string(argv[1]) == "batch") {
+        return batch_main(argc - 2, argv + 2);
+    }
+    // yatta trace <file> prints a binary execution trace
+    if (argc > 1 && string(argv[1]) == "trace") {
+        return trace_main(argc - 2, argv + 2);
+    }
     shell();
 }
\ No newline at end of file